@@ -1,5 +1,17 @@
 #python generate_pointcloud.py data/diffuse_albedo.png data/dist0.exr data/syn.tif before_correction_overlap/output 100
 
+# grid_merge is built with the rest of the trimesh2 utilities
+# (make -C trimesh2-2.16/trimesh2), into bin.<platform>
+GRID_MERGE=
+for f in trimesh2-2.16/trimesh2/bin.*/grid_merge
+    do
+    if [ -x "$f" ]; then GRID_MERGE=$f; break; fi
+done
+if [ -z "$GRID_MERGE" ]; then
+    echo "grid_merge not found - run make -C trimesh2-2.16/trimesh2 first" >&2
+    exit 1
+fi
+
 SET=$(seq 0 4)
 
 for i in $SET
@@ -12,4 +24,4 @@ for i in $SET
     done
 done
 
-python mesh_merge.py after_correction/result test.ply 100
\ No newline at end of file
+"$GRID_MERGE" -s 2160x3840 -n 5 -o 100 after_correction/result test.ply
\ No newline at end of file
@@ -0,0 +1,205 @@
+#ifndef ARENA_H
+#define ARENA_H
+/*
+trimesh2 contributors
+Added to this tree; not part of the upstream trimesh2 distribution.
+
+Arena.h
+Region allocator for scratch memory.  Allocations bump a pointer through
+large chunks obtained from the system, and are given back all at once by
+reset(), which keeps the chunks for the next job.  Freeing the most recent
+allocation also gives its memory back, so scratch arrays with nested
+lifetimes do not pile up within a job.
+
+For code that frees in no particular order (such as C libraries with
+pluggable malloc and free), pool_malloc() and friends round each block up
+to a power of two, and keep freed blocks on per-size free lists for reuse
+until the next reset().
+
+Library functions allocate their large temporary arrays with
+ArenaAllocator, which draws from the arena installed with
+Arena::set_current(), or from the heap if none is installed.  Allocations
+made inside OpenMP parallel regions always go to the heap.
+
+Usage:
+	Arena arena;
+	Arena::set_current(&arena);
+	for (each job) {
+		// Do stuff
+		arena.reset();
+	}
+	arena.print_stats();
+	Arena::set_current(NULL);
+*/
+
+#include <cstddef>
+#include <cstdio>
+#include <new>
+#include <vector>
+
+
+namespace trimesh {
+
+class Arena {
+public:
+	// Statistics, accumulated over the lifetime of the arena
+	struct Stats {
+		size_t nallocs;         // Allocations served
+		size_t bytes_alloced;   // Total bytes in those allocations
+		size_t nfrees;          // Frees that gave memory back
+		size_t in_use;          // Bytes currently in use
+		size_t peak_in_use;     // High-water mark of in_use
+		size_t nchunks;         // Chunks obtained from the system
+		size_t bytes_reserved;  // Total size of those chunks
+		size_t nresets;         // Calls to reset()
+		size_t npool_reused;    // pool_malloc()s served by free lists
+		size_t npool_heap;      // pool_malloc()s sent to the heap
+	};
+
+	// Position to rewind() to
+	struct Mark {
+		size_t chunk, offset, base;
+	};
+
+private:
+	struct Chunk {
+		char *mem;
+		size_t size;
+		size_t used;  // Offset at which we moved on to the next chunk
+	};
+	::std::vector<Chunk> chunks;
+	size_t cur, offset;  // Current chunk, and offset of first free byte
+	size_t base;         // Total size of the chunks before cur
+	size_t min_chunk;
+	Stats st;
+
+	// Free lists of pool blocks, by log2 of size
+	enum { NPOOLS = 8 * sizeof(size_t) };
+	void *pool_free_list[NPOOLS];
+
+	// Not copyable
+	Arena(const Arena &);
+	Arena &operator = (const Arena &);
+
+	void update_in_use()
+	{
+		st.in_use = base + offset;
+		if (st.in_use > st.peak_in_use)
+			st.peak_in_use = st.in_use;
+	}
+
+public:
+	// Chunks are at least min_chunk_ bytes, and grow geometrically
+	explicit Arena(size_t min_chunk_ = 1 << 20);
+	~Arena() { release(); }
+
+	// Allocate bytes, aligned to align (a power of two).  Returns NULL
+	// only if the system is out of memory.
+	void *alloc(size_t bytes, size_t align = 16);
+
+	// Give back memory, if p is the most recent allocation
+	void free(void *p, size_t bytes);
+
+	// Is p in one of our chunks?
+	bool owns(const void *p) const;
+
+	// Give back everything allocated since mark(), or all allocations.
+	// Chunks are kept for reuse.
+	Mark mark() const
+	{
+		Mark m = { cur, offset, base };
+		return m;
+	}
+	void rewind(const Mark &m)
+	{
+		cur = m.chunk;
+		offset = m.offset;
+		base = m.base;
+		update_in_use();
+	}
+	void reset();
+
+	// Return all chunks to the system
+	void release();
+
+	// malloc-style allocation from pools of power-of-two-sized blocks.
+	// Calls made inside OpenMP parallel regions go to the heap.
+	void *pool_malloc(size_t bytes);
+	void *pool_calloc(size_t n, size_t bytes);
+	void *pool_realloc(void *p, size_t bytes);
+	void pool_free(void *p);
+
+	const Stats &stats() const { return st; }
+	void print_stats(FILE *f = stderr) const;
+
+	// The arena used by ArenaAllocator, or NULL to use the heap.
+	// current() always returns NULL inside OpenMP parallel regions.
+	static Arena *current();
+	static void set_current(Arena *a);
+};
+
+
+// STL allocator drawing from the current arena, as of its construction
+template <class T>
+class ArenaAllocator {
+public:
+	typedef T value_type;
+	typedef T *pointer;
+	typedef const T *const_pointer;
+	typedef T &reference;
+	typedef const T &const_reference;
+	typedef ::std::size_t size_type;
+	typedef ::std::ptrdiff_t difference_type;
+	template <class U> struct rebind { typedef ArenaAllocator<U> other; };
+
+	Arena *arena;
+
+	ArenaAllocator() : arena(Arena::current())
+		{}
+	explicit ArenaAllocator(Arena *arena_) : arena(arena_)
+		{}
+	template <class U> ArenaAllocator(const ArenaAllocator<U> &a) :
+		arena(a.arena)
+		{}
+
+	pointer allocate(size_type n, const void * = 0)
+	{
+		if (!arena)
+			return static_cast<pointer>(::operator new(n * sizeof(T)));
+		void *p = arena->alloc(n * sizeof(T));
+		if (!p)
+			throw ::std::bad_alloc();
+		return static_cast<pointer>(p);
+	}
+	void deallocate(pointer p, size_type n)
+	{
+		if (arena)
+			arena->free(p, n * sizeof(T));
+		else
+			::operator delete(p);
+	}
+
+	size_type max_size() const { return size_type(-1) / sizeof(T); }
+	pointer address(reference x) const { return &x; }
+	const_pointer address(const_reference x) const { return &x; }
+	void construct(pointer p, const T &val) { new (p) T(val); }
+	void destroy(pointer p) { p->~T(); }
+};
+
+template <class T, class U>
+static inline bool operator == (const ArenaAllocator<T> &a,
+                                const ArenaAllocator<U> &b)
+{
+	return a.arena == b.arena;
+}
+
+template <class T, class U>
+static inline bool operator != (const ArenaAllocator<T> &a,
+                                const ArenaAllocator<U> &b)
+{
+	return a.arena != b.arena;
+}
+
+} // namespace trimesh
+
+#endif
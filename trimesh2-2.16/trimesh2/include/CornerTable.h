@@ -0,0 +1,95 @@
+#ifndef CORNERTABLE_H
+#define CORNERTABLE_H
+/*
+trimesh2 contributors
+Added to this tree; not part of the upstream trimesh2 distribution.
+
+CornerTable.h
+Lightweight view of the connectivity of a TriMesh, through its table of
+opposite corners.
+
+Corner c = 3*f+j is vertex j of face f.  Each corner faces the edge between
+the other two vertices of its face, and opposite(c) is the corner facing
+the same edge from the other side, or negative if there is none with
+consistent orientation.  This is enough to walk around vertices and along
+boundaries in constant time per step.  On non-manifold vertices, or across
+flipped faces, walking around the vertex covers only one of its fans.
+*/
+
+#include "TriMesh.h"
+
+
+namespace trimesh {
+
+class CornerTable {
+private:
+	const TriMesh *mesh;
+
+public:
+	// Builds the mesh's opposite corners, if necessary.  The view
+	// remains valid until the faces of the mesh change.
+	explicit CornerTable(TriMesh *mesh_) : mesh(mesh_)
+		{ mesh_->need_opposite_corners(); }
+
+	// Corners of a face
+	static inline int face(int c) { return c / 3; }
+	static inline int corner(int f, int j) { return 3 * f + j; }
+	static inline int next(int c) { return (c % 3 == 2) ? c - 2 : c + 1; }
+	static inline int prev(int c) { return (c % 3 == 0) ? c + 2 : c - 1; }
+
+	int num_corners() const { return int(mesh->opposite_corners.size()); }
+	int vertex(int c) const { return mesh->faces[c / 3][c % 3]; }
+	int opposite(int c) const { return mesh->opposite_corners[c]; }
+
+	// Is the edge facing corner c unmatched?  This includes edges shared
+	// only with inconsistently oriented faces, unlike TriMesh::is_bdy().
+	bool is_bdy_edge(int c) const { return opposite(c) < 0; }
+
+	// Some corner at vertex v, or -1 if v is in no faces.  For boundary
+	// vertices of consistently oriented meshes, this is the first corner
+	// of the fan around v.
+	int corner_of(int v) const { return mesh->vertex_corners[v]; }
+
+	// The corner at the same vertex as c in the face across the edge
+	// from vertex(c) to vertex(next(c)), or -1 if that edge is
+	// unmatched.  Starting from corner_of(v), this visits the faces
+	// around v in order.
+	int swing(int c) const
+	{
+		int o = opposite(prev(c));
+		return (o < 0) ? -1 : prev(o);
+	}
+
+	// Same as above, but returns -1 instead of coming back around to
+	// first.  Visit all the faces around v with
+	//   for (int c = ct.corner_of(v); c >= 0; c = ct.swing(c, ct.corner_of(v)))
+	int swing(int c, int first) const
+	{
+		int s = swing(c);
+		return (s == first) ? -1 : s;
+	}
+
+	// The unmatched corner whose edge continues the boundary from the
+	// end of the edge facing unmatched corner c, found by swinging
+	// around that vertex.  Returns a matched corner only if the topology
+	// is too broken to find one.
+	int next_bdy(int c) const
+	{
+		int x = next(c);
+		for (int i = 0; i < num_corners() && !is_bdy_edge(x); i++)
+			x = next(opposite(x));
+		return x;
+	}
+
+	// Find the boundary loops of the mesh.  Each loop lists its vertices
+	// in order, consistent with the orientation of the faces.  Loops
+	// start at the unmatched edge (v1,v2) with the smallest v1, then v2,
+	// among the edges not yet visited.  A loop follows the fan of faces
+	// around each vertex, so where several fans meet at a vertex, it may
+	// pass through that vertex more than once.
+	void boundary_loops(::std::vector< ::std::vector<int> > &loops) const;
+};
+
+} // namespace trimesh
+
+#endif
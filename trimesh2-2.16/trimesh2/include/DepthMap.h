@@ -0,0 +1,108 @@
+#ifndef DEPTHMAP_H
+#define DEPTHMAP_H
+/*
+trimesh2 contributors
+Added to this tree; not part of the upstream trimesh2 distribution.
+
+DepthMap.h
+Depth, normal, and confidence maps stored as float images, and conversion
+between them and range grids.
+
+Images are read from PFM, NPY (float32 or float64, C order), or headerless
+little-endian float32 files, and written as float32 in the same formats.
+They are kept top row first, with channels interleaved, whatever the order
+on disk.
+
+Depths are distances along the -z axis of a camera looking down -z with y
+up, and are back-projected with the intrinsics of a .fc file:
+	X = (x - cx) * depth / fx
+	Y = (cy - y) * depth / fy
+	Z = -depth
+
+Usage:
+	DepthCamera cam;
+	if (!cam.read_fc("camera.fc"))
+		...
+	cam.zmin = 1.9f;  cam.zmax = 7.9f;
+	TriMesh *mesh = read_depth_grid("depth.pfm", "normals.npy", NULL, cam);
+	...
+	mesh->write("norm:depth.npy");  // Also writes depth_normals.npy
+*/
+
+#include "TriMesh.h"
+
+
+namespace trimesh {
+
+class FloatImage {
+public:
+	int width, height, channels;
+	::std::vector<float> pixels;
+
+	FloatImage() : width(0), height(0), channels(0)
+		{}
+
+	float &at(int x, int y, int c = 0)
+		{ return pixels[(size_t(y) * width + x) * channels + c]; }
+	const float &at(int x, int y, int c = 0) const
+		{ return pixels[(size_t(y) * width + x) * channels + c]; }
+
+	// Read a PFM or NPY file, recognized by its header.  Anything else
+	// is taken to be raw float32 data of size raw_width x raw_height,
+	// with the number of channels given by the size of the file.
+	bool read(const char *filename, int raw_width = 0, int raw_height = 0);
+
+	// Write a PFM or NPY file, chosen by extension, or else raw
+	// little-endian float32.  PFM can only hold 1 or 3 channels.
+	bool write(const char *filename) const;
+
+	// Write to f, in the format the filename would select
+	bool write(FILE *f, const char *filename) const;
+};
+
+
+// Camera for back-projecting depth maps, and the range of depths accepted.
+// Depths of zero, NaN, or outside [zmin, zmax] mark invalid pixels.
+struct DepthCamera {
+	float fx, fy, cx, cy;
+	float zmin, zmax;
+
+	DepthCamera();
+
+	// Read fx fy cx cy from a .fc file
+	bool read_fc(const char *filename);
+};
+
+
+// Does the file name look like a depth map (.pfm, .npy, or .raw)?
+extern bool is_depth_map(const char *filename);
+
+// Build a range grid from a depth map, and optional normal (3 channels)
+// and confidence maps of the same size.  Only the first channel of the
+// depth and confidence maps is used.  Vertices are in row-major order.
+extern TriMesh *depth_to_grid(const FloatImage &depth,
+	const FloatImage *normals, const FloatImage *confidences,
+	const DepthCamera &cam);
+
+// Extract the depth (-z) and optionally normal maps of a range grid, with
+// NaN in the invalid cells.  The inverse of depth_to_grid.
+extern bool grid_to_depth(const TriMesh *mesh, FloatImage &depth,
+	FloatImage *normals = NULL);
+
+// Write the depth map of a range grid to depthfile, and the normal map
+// (if normalfile is not NULL)
+extern bool write_depth_grid(const TriMesh *mesh, const char *depthfile,
+	const char *normalfile = NULL);
+
+// The name of the normal map to go with a depth map: depth_normals.ext
+extern ::std::string normal_map_name(const char *depthfile);
+
+// Read the maps from files (any of which but depthfile may be NULL)
+// and build a range grid from them
+extern TriMesh *read_depth_grid(const char *depthfile,
+	const char *normalfile, const char *conffile, const DepthCamera &cam,
+	int raw_width = 0, int raw_height = 0);
+
+} // namespace trimesh
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef GRIDCODEC_H
+#define GRIDCODEC_H
+/*
+trimesh2 contributors
+Added to this tree; not part of the upstream trimesh2 distribution.
+
+GridCodec.h
+Lossless compression of per-vertex attributes of range grids.
+
+Records belong to the valid cells of a piece of a range grid (one per
+cell, in row-major order) and have ncomp components of csize = 1, 2, or 4
+bytes, little-endian.  Each component is predicted from the left, upper,
+and upper-left neighbors of its cell (left + up - upleft, computed on the
+integer bits, so floats are handled exactly), falling back to the left or
+upper neighbor or the previous record.  The residuals are split into byte
+planes, each of which is entropy coded with a static order-0 rANS coder,
+or stored as a constant or raw bytes if that is smaller.
+
+Pieces are independent, so they can be compressed and decompressed in
+parallel.
+
+Usage:
+	// cells[i] = first + index of the record of cell i, or < 0 if invalid
+	vector<unsigned char> packed;
+	grid_encode(&data[0], n, 3, 4, cells, width, rows, first, packed);
+	...
+	if (!grid_decode(&packed[0], packed.size(), n, 3, 4, cells,
+	                 width, rows, first, &data[0]))
+		...
+*/
+
+#include <cstddef>
+#include <vector>
+
+
+namespace trimesh {
+
+// Compress n records of ncomp components of csize bytes each, appending
+// the result to out
+extern void grid_encode(const unsigned char *src, size_t n,
+	int ncomp, int csize, const int *cells, int width, int rows,
+	int first, ::std::vector<unsigned char> &out);
+
+// Decompress len bytes of src into n records at dst.  Returns false if
+// the data are corrupt.
+extern bool grid_decode(const unsigned char *src, size_t len, size_t n,
+	int ncomp, int csize, const int *cells, int width, int rows,
+	int first, unsigned char *dst);
+
+} // namespace trimesh
+
+#endif
@@ -40,11 +40,26 @@ public:
 			{}
 	};
 
+	// Read-only view of a run of indices, as returned by neighbors_of()
+	// and adjacentfaces_of()
+	struct IndexList {
+		const int *first, *last;
+		IndexList(const int *first_ = 0, const int *last_ = 0) :
+			first(first_), last(last_)
+			{}
+		const int *begin() const { return first; }
+		const int *end() const { return last; }
+		size_t size() const { return last - first; }
+		bool empty() const { return first == last; }
+		int operator [] (size_t i) const { return first[i]; }
+	};
+
 	//
 	// Enums
 	//
 	enum TstripRep { TSTRIP_LENGTH, TSTRIP_TERM };
 	enum { GRID_INVALID = -1 };
+	enum { UNMATCHED_CORNER = -2 };
 	enum StatOp {
 		STAT_MIN, STAT_MINABS, STAT_MAX, STAT_MAXABS,
 		STAT_SUM, STAT_SUMABS, STAT_SUMSQR,
@@ -56,7 +71,10 @@ public:
 	//
 	// Constructor
 	//
-	TriMesh() : grid_width(-1), grid_height(-1), flag_curr(0)
+	TriMesh() : grid_width(-1), grid_height(-1), flag_curr(0),
+		cached_feature_size(0.0f), geometry_gen(1), normals_gen(0),
+		pointareas_gen(0), curvatures_gen(0), dcurv_gen(0),
+		bbox_gen(0), bsphere_gen(0), compact_connectivity(false)
 		{}
 
 	//
@@ -92,6 +110,22 @@ public:
 	BBox bbox;
 	BSphere bsphere;
 
+	// Result of feature_size(), or 0 if not yet computed.  Cleared by
+	// operations that change the scale of the mesh, but not by smoothing.
+	float cached_feature_size;
+
+	// Generation of the vertex positions and faces, advanced by
+	// changed_geometry().  need_normals(), need_pointareas(),
+	// need_curvatures(), need_dcurv(), need_bbox(), and need_bsphere()
+	// record the generation they computed from, and compute again if it
+	// has changed since.  The connectivity structures are not tracked
+	// this way: see changed_faces().  A recorded generation of 0 means the data did
+	// not come from need_*() (for example, normals read from a file or
+	// smoothed by diffuse_normals()), so it is kept until cleared.
+	unsigned geometry_gen;
+	unsigned normals_gen, pointareas_gen, curvatures_gen, dcurv_gen;
+	unsigned bbox_gen, bsphere_gen;
+
 	// Connectivity structures:
 	//  For each vertex, all neighboring vertices
 	::std::vector< ::std::vector<int> > neighbors;
@@ -101,6 +135,30 @@ public:
 	//  (for example, across_edge[3][2] is the number of the face
 	//   that's touching the edge opposite vertex 2 of face 3)
 	::std::vector<Face> across_edge;
+	//  For each corner c = 3*f+j (vertex j of face f), the corner in the
+	//  face across the edge opposite it, or -1 on the boundary.  Edges
+	//  whose other faces are all oriented the same way as f, and
+	//  degenerate edges, give UNMATCHED_CORNER instead.
+	//  across_edge is derived from this.  See CornerTable.h.
+	::std::vector<int> opposite_corners;
+	//  For each vertex, a corner at that vertex, or -1 if there is none.
+	//  On the boundary, it is the corner from which walking around the
+	//  vertex covers the whole fan of faces.
+	::std::vector<int> vertex_corners;
+
+	// The same vertex neighbors and adjacent faces, in compressed form:
+	// the neighbors of vertex v are neighbor_list[neighbor_offsets[v]]
+	// through neighbor_list[neighbor_offsets[v+1]-1].  These are built
+	// instead of neighbors and adjacentfaces if compact_connectivity is
+	// set.  neighbors_of() and adjacentfaces_of() work with either form.
+	::std::vector<int> neighbor_offsets, neighbor_list;
+	::std::vector<int> adjacentface_offsets, adjacentface_list;
+
+	// If set, need_neighbors() and need_adjacentfaces() build only the
+	// compressed form (in parallel), and neighbors and adjacentfaces
+	// stay empty.  This saves a heap allocation per vertex on large
+	// meshes.
+	bool compact_connectivity;
 
 	//
 	// Compute all this stuff...
@@ -125,6 +183,17 @@ public:
 		grid.resize(grid_width * grid_height, GRID_INVALID);
 	}
 	void triangulate_grid(bool remove_slivers = true);
+	// Is grid cell i usable?  It must refer to a vertex that is not at
+	// the origin, as checked by triangulate_grid().
+	bool grid_valid(int i) const
+	{
+		int v = grid[i];
+		return v >= 0 && v < int(vertices.size()) && !!vertices[v];
+	}
+	// Squared edge length past which triangulate_grid() checks faces
+	// for slivers.  Grid neighbors farther apart than this are taken to
+	// be across a depth discontinuity.  Zero if there are no grid faces.
+	float grid_sliver_threshold() const;
 	void need_normals(bool simple_area_weighted = false);
 	void need_curvatures();
 	void need_dcurv();
@@ -134,11 +203,44 @@ public:
 	void need_neighbors();
 	void need_adjacentfaces();
 	void need_across_edge();
+	void need_opposite_corners();
+
+	// Call after moving vertices in place.  Normals, point areas,
+	// curvatures, dcurv, bbox, and bsphere are recomputed by the next
+	// need_*() call that uses them.  Connectivity is left alone, so call
+	// changed_faces() instead if the faces changed too.
+	void changed_geometry()
+	{
+		if (unlikely(!++geometry_gen))
+			geometry_gen = 1;
+	}
+	bool current(unsigned gen) const
+		{ return gen == 0 || gen == geometry_gen; }
+
+	// Call after changing faces in place.  Besides changed_geometry(),
+	// this drops neighbors, adjacentfaces, across_edge, and the opposite
+	// corners, which are rebuilt by the next need_*() call.
+	void changed_faces()
+	{
+		clear_neighbors(); clear_adjacentfaces(); clear_across_edge();
+		changed_geometry();
+	}
+
+	// Add a value per corner (corner 3*f+j is vertex j of face f) into
+	// the value of its vertex.  Each vertex sums its corners in order
+	// of increasing face, so the result does not depend on the number
+	// of threads.  Running in parallel uses adjacentfaces, building the
+	// compressed form if neither form is present.
+	void sum_corners(const float *corner_vals, float *vert_vals);
+	void sum_corners(const vec *corner_vals, vec *vert_vals);
+	void sum_corners(const Vec<4,float> *corner_vals,
+	                 Vec<4,float> *vert_vals);
 
 	//
 	// Delete everything and release storage
 	//
-	void clear_vertices()      { clear_and_release(vertices); }
+	void clear_vertices()      { clear_and_release(vertices);
+	                             clear_feature_size(); }
 	void clear_faces()         { clear_and_release(faces); }
 	void clear_tstrips()       { clear_and_release(tstrips); }
 	void clear_grid()          { clear_and_release(grid);
@@ -156,9 +258,17 @@ public:
 	                             clear_and_release(cornerareas); }
 	void clear_bbox()          { bbox.clear(); }
 	void clear_bsphere()       { bsphere.valid = false; }
-	void clear_neighbors()     { clear_and_release(neighbors); }
-	void clear_adjacentfaces() { clear_and_release(adjacentfaces); }
-	void clear_across_edge()   { clear_and_release(across_edge); }
+	void clear_feature_size()  { cached_feature_size = 0.0f; }
+	void clear_neighbors()     { clear_and_release(neighbors);
+	                             clear_and_release(neighbor_offsets);
+	                             clear_and_release(neighbor_list); }
+	void clear_adjacentfaces() { clear_and_release(adjacentfaces);
+	                             clear_and_release(adjacentface_offsets);
+	                             clear_and_release(adjacentface_list); }
+	void clear_across_edge()   { clear_and_release(across_edge);
+	                             clear_opposite_corners(); }
+	void clear_opposite_corners() { clear_and_release(opposite_corners);
+	                                clear_and_release(vertex_corners); }
 	void clear()
 	{
 		clear_vertices(); clear_faces(); clear_tstrips(); clear_grid();
@@ -176,6 +286,14 @@ protected:
 public:
 	static TriMesh *read(const char *filename);
 	static TriMesh *read(const ::std::string &filename);
+	// Read the part of a range grid with x0 <= x < x1 and y0 <= y < y1
+	// (clipped to the grid), and only the vertices it references.
+	// Binary ply files are read straight from disk, touching just the
+	// grid rows up to y1 and the referenced vertex records.
+	static TriMesh *read_window(const char *filename,
+		int x0, int y0, int x1, int y1);
+	static TriMesh *read_window(const ::std::string &filename,
+		int x0, int y0, int x1, int y1);
 	bool write(const char *filename);
 	bool write(const ::std::string &filename);
 
@@ -184,12 +302,66 @@ public:
 	// Useful queries
 	//
 
-	// Is vertex v on the mesh boundary?
+	// View of a nested list, or of entry i of a compressed one
+	static IndexList index_list(const ::std::vector<int> &l)
+	{
+		if (l.empty())
+			return IndexList();
+		return IndexList(&l[0], &l[0] + l.size());
+	}
+	static IndexList index_list(const ::std::vector<int> &offsets,
+		const ::std::vector<int> &list, int i)
+	{
+		const int *l = list.empty() ? 0 : &list[0];
+		return IndexList(l + offsets[i], l + offsets[i+1]);
+	}
+
+	// Neighbors of vertex v, from whichever form of the lists is
+	// present.  The const versions require that need_neighbors() has
+	// already been called.
+	inline IndexList neighbors_of(int v) const
+	{
+		if (neighbor_offsets.empty())
+			return index_list(neighbors[v]);
+		return index_list(neighbor_offsets, neighbor_list, v);
+	}
+	inline IndexList neighbors_of(int v)
+	{
+		if (unlikely(neighbor_offsets.empty() && neighbors.empty()))
+			need_neighbors();
+		return const_cast<const TriMesh *>(this)->neighbors_of(v);
+	}
+
+	// Faces touching vertex v, from whichever form of the lists is
+	// present.  The const versions require that need_adjacentfaces()
+	// has already been called.
+	inline IndexList adjacentfaces_of(int v) const
+	{
+		if (adjacentface_offsets.empty())
+			return index_list(adjacentfaces[v]);
+		return index_list(adjacentface_offsets, adjacentface_list, v);
+	}
+	inline IndexList adjacentfaces_of(int v)
+	{
+		if (unlikely(adjacentface_offsets.empty() &&
+		             adjacentfaces.empty()))
+			need_adjacentfaces();
+		return const_cast<const TriMesh *>(this)->adjacentfaces_of(v);
+	}
+
+	// Is vertex v on the mesh boundary, i.e. on an edge that no other
+	// face shares, however it is oriented?  Isolated vertices are not.
 	inline bool is_bdy(int v)
 	{
-		if (unlikely(neighbors.empty())) need_neighbors();
-		if (unlikely(adjacentfaces.empty())) need_adjacentfaces();
-		return neighbors[v].size() != adjacentfaces[v].size();
+		if (unlikely(vertex_corners.empty())) need_opposite_corners();
+		int c = vertex_corners[v];
+		if (c < 0)
+			return false;
+		// Is there a boundary edge coming into or going out of v?
+		// need_opposite_corners() picks such a corner if there is one.
+		int in = (c % 3 == 2) ? c - 2 : c + 1;
+		int out = (c % 3 == 0) ? c + 2 : c - 1;
+		return opposite_corners[in] == -1 || opposite_corners[out] == -1;
 	}
 
 	// Centroid of face f
@@ -243,6 +415,20 @@ public:
 	float stat(StatOp op, StatVal val);
 	float feature_size();
 
+	// Memory used by each attribute: bytes in use (by the elements of
+	// each vector) and allocated (by its capacity).  For neighbors and
+	// adjacentfaces, this includes the nested vectors and their headers.
+	struct MemoryUsage {
+		struct Entry {
+			const char *name;
+			size_t bytes, capacity;
+		};
+		::std::vector<Entry> entries;
+		size_t total_bytes, total_capacity;
+	};
+	MemoryUsage memory_usage() const;
+	void print_memory_usage(FILE *f, const char *stage = 0) const;
+
 	//
 	// Debugging
 	//
@@ -47,9 +47,15 @@ extern void remove_sliver_faces(TriMesh *mesh);
 // Remap vertices according to the given table
 extern void remap_verts(TriMesh *mesh, const ::std::vector<int> &remap_table);
 
-// Reorder vertices in a mesh according to the order in which
-// they are referenced by the tstrips or faces.
-extern void reorder_verts(TriMesh *mesh);
+// Reorder vertices in a mesh.  REORDER_REFS orders them as they are
+// referenced by the grid, tstrips, or faces.  The others order them
+// along a Morton or Hilbert curve through the bounding box, or by
+// tile_size x tile_size tiles of a range grid (or a Hilbert curve if
+// there is no grid), and then sort the faces to match.
+enum ReorderScheme { REORDER_REFS,
+	REORDER_MORTON, REORDER_HILBERT, REORDER_GRID_TILES };
+extern void reorder_verts(TriMesh *mesh,
+	ReorderScheme scheme = REORDER_REFS, int tile_size = 32);
 
 // Perform one iteration of subdivision on a mesh.
 enum SubdivScheme { SUBDIV_PLANAR,
@@ -63,6 +69,9 @@ extern void smooth_mesh(TriMesh *themesh, float sigma);
 // Bilateral smoothing
 extern void bilateral_smooth_mesh(TriMesh *themesh, float sigma1, float sigma2);
 
+// Bilateral smoothing of a range grid, over a window of grid cells
+extern void bilateral_smooth_grid(TriMesh *themesh, float sigma1, float sigma2);
+
 // Diffuse an arbitrary per-vertex vector (or scalar) field
 template <class T>
 extern void diffuse_vector(TriMesh *themesh, ::std::vector<T> &field, float sigma);
@@ -70,6 +79,15 @@ extern void diffuse_vector(TriMesh *themesh, ::std::vector<T> &field, float sigm
 // Diffuse the normals across the mesh
 extern void diffuse_normals(TriMesh *themesh, float sigma);
 
+// Diffuse an arbitrary per-vertex field on a range grid, with a Gaussian
+// of width sigma given in grid cells.  Uses an image pyramid, so the
+// cost does not depend on sigma.
+template <class T>
+extern void diffuse_grid_vector(TriMesh *themesh, ::std::vector<T> &field, float sigma);
+
+// Diffuse the normals on a range grid (sigma in grid cells)
+extern void diffuse_grid_normals(TriMesh *themesh, float sigma);
+
 // Diffuse the curvatures across the mesh
 extern void diffuse_curv(TriMesh *themesh, float sigma);
 
@@ -0,0 +1,247 @@
+/*
+trimesh2 contributors
+Added to this tree; not part of the upstream trimesh2 distribution.
+
+Arena.cc
+Region allocator for scratch memory.
+*/
+
+#include "Arena.h"
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <stdint.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+using namespace std;
+
+
+namespace trimesh {
+
+// The arena used by ArenaAllocator
+static Arena *current_arena = NULL;
+
+
+Arena::Arena(size_t min_chunk_) :
+	cur(0), offset(0), base(0), min_chunk(min_chunk_)
+{
+	memset(&st, 0, sizeof(st));
+	memset(pool_free_list, 0, sizeof(pool_free_list));
+}
+
+
+// Sizes are rounded up to a multiple of 16, so that consecutive blocks
+// with the default alignment are contiguous and free() can unwind them
+static inline size_t round_size(size_t bytes)
+{
+	return (bytes + 15) & ~size_t(15);
+}
+
+
+// Allocate bytes, aligned to align
+void *Arena::alloc(size_t bytes, size_t align)
+{
+	bytes = round_size(bytes);
+	// Find the first chunk, starting at the current one, with room
+	while (cur < chunks.size()) {
+		uintptr_t p = uintptr_t(chunks[cur].mem + offset);
+		size_t pad = size_t((align - (p & (align - 1))) & (align - 1));
+		if (offset + pad + bytes <= chunks[cur].size) {
+			offset += pad;
+			break;
+		}
+		chunks[cur].used = offset;
+		base += chunks[cur].size;
+		cur++;
+		offset = 0;
+	}
+
+	// None - get a new one from the system, at least as big as
+	// everything before it
+	if (cur == chunks.size()) {
+		size_t size = max(max(min_chunk, base), bytes + align);
+		Chunk c = { (char *) malloc(size), size, 0 };
+		if (!c.mem)
+			return NULL;
+		chunks.push_back(c);
+		st.nchunks++;
+		st.bytes_reserved += size;
+		uintptr_t p = uintptr_t(c.mem);
+		offset = size_t((align - (p & (align - 1))) & (align - 1));
+	}
+
+	void *p = chunks[cur].mem + offset;
+	offset += bytes;
+	st.nallocs++;
+	st.bytes_alloced += bytes;
+	update_in_use();
+	return p;
+}
+
+
+// Give back memory, if p is the most recent allocation
+void Arena::free(void *p, size_t bytes)
+{
+	if (cur == chunks.size() || !p)
+		return;
+	// Step back to the end of the previous chunk, if nothing is left
+	// in this one
+	while (offset == 0 && cur > 0) {
+		cur--;
+		base -= chunks[cur].size;
+		offset = chunks[cur].used;
+	}
+	char *c = (char *) p;
+	bytes = round_size(bytes);
+	if (c + bytes == chunks[cur].mem + offset && c >= chunks[cur].mem) {
+		offset = size_t(c - chunks[cur].mem);
+		st.nfrees++;
+		update_in_use();
+	}
+}
+
+
+// Is p in one of our chunks?
+bool Arena::owns(const void *p) const
+{
+	const char *c = (const char *) p;
+	for (size_t i = 0; i < chunks.size(); i++)
+		if (c >= chunks[i].mem && c < chunks[i].mem + chunks[i].size)
+			return true;
+	return false;
+}
+
+
+// Give back all allocations, keeping the chunks
+void Arena::reset()
+{
+	cur = offset = base = 0;
+	st.in_use = 0;
+	st.nresets++;
+	memset(pool_free_list, 0, sizeof(pool_free_list));
+}
+
+
+// Return all chunks to the system
+void Arena::release()
+{
+	for (size_t i = 0; i < chunks.size(); i++)
+		::free(chunks[i].mem);
+	chunks.clear();
+	cur = offset = base = 0;
+	st.in_use = 0;
+	memset(pool_free_list, 0, sizeof(pool_free_list));
+}
+
+
+// Pool blocks start with a header holding the log2 of the block size,
+// or 0 and the requested size if the block came from the heap.  Free
+// blocks hold the next block on their free list just past the header.
+static const size_t POOL_HDR = 16;
+
+static inline size_t *pool_header(void *p)
+{
+	return (size_t *) ((char *) p - POOL_HDR);
+}
+
+void *Arena::pool_malloc(size_t bytes)
+{
+	size_t lg = 5;
+	while ((size_t(1) << lg) < bytes + POOL_HDR)
+		lg++;
+
+	size_t *h;
+	if (current() != this) {
+		st.npool_heap++;
+		h = (size_t *) malloc(bytes + POOL_HDR);
+		lg = 0;
+	} else if (pool_free_list[lg]) {
+		st.npool_reused++;
+		char *p = (char *) pool_free_list[lg];
+		pool_free_list[lg] = *(void **) p;
+		return p;
+	} else {
+		h = (size_t *) alloc(size_t(1) << lg);
+	}
+	if (!h)
+		return NULL;
+	h[0] = lg;
+	h[1] = bytes;
+	return (char *) h + POOL_HDR;
+}
+
+
+void *Arena::pool_calloc(size_t n, size_t bytes)
+{
+	void *p = pool_malloc(n * bytes);
+	if (p)
+		memset(p, 0, n * bytes);
+	return p;
+}
+
+
+void *Arena::pool_realloc(void *p, size_t bytes)
+{
+	if (!p)
+		return pool_malloc(bytes);
+	size_t lg = pool_header(p)[0];
+	if (lg && bytes + POOL_HDR <= (size_t(1) << lg))
+		return p;
+
+	void *q = pool_malloc(bytes);
+	if (!q)
+		return NULL;
+	size_t old = lg ? (size_t(1) << lg) - POOL_HDR : pool_header(p)[1];
+	memcpy(q, p, min(old, bytes));
+	pool_free(p);
+	return q;
+}
+
+
+void Arena::pool_free(void *p)
+{
+	if (!p)
+		return;
+	size_t lg = pool_header(p)[0];
+	if (!lg) {
+		::free(pool_header(p));
+		return;
+	}
+	*(void **) p = pool_free_list[lg];
+	pool_free_list[lg] = p;
+}
+
+
+void Arena::print_stats(FILE *f) const
+{
+	fprintf(f, "Arena: %lu allocations (%.1f MB), %lu given back early, "
+		"%lu resets\n", (unsigned long) st.nallocs,
+		st.bytes_alloced / 1048576.0, (unsigned long) st.nfrees,
+		(unsigned long) st.nresets);
+	fprintf(f, "       peak use %.1f MB, %lu chunks (%.1f MB) "
+		"from the system\n", st.peak_in_use / 1048576.0,
+		(unsigned long) st.nchunks, st.bytes_reserved / 1048576.0);
+	if (st.npool_reused || st.npool_heap)
+		fprintf(f, "       %lu pool blocks reused, %lu sent to "
+			"the heap\n", (unsigned long) st.npool_reused,
+			(unsigned long) st.npool_heap);
+}
+
+
+// The arena used by ArenaAllocator, or NULL to use the heap
+Arena *Arena::current()
+{
+#ifdef _OPENMP
+	if (omp_in_parallel())
+		return NULL;
+#endif
+	return current_arena;
+}
+
+void Arena::set_current(Arena *a)
+{
+	current_arena = a;
+}
+
+} // namespace trimesh
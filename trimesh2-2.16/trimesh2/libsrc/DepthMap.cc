@@ -0,0 +1,545 @@
+/*
+trimesh2 contributors
+Added to this tree; not part of the upstream trimesh2 distribution.
+
+DepthMap.cc
+Reading and writing depth, normal, and confidence maps, and converting
+between them and range grids.
+*/
+
+#include "DepthMap.h"
+#include "endianutil.h"
+#include "strutil.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <cfloat>
+#include <limits>
+#include <algorithm>
+using namespace std;
+
+#define dprintf TriMesh::dprintf
+#define eprintf TriMesh::eprintf
+
+
+namespace trimesh {
+
+// Largest width or height accepted, so that sizes can't overflow
+#define MAX_IMAGE_DIM (1 << 20)
+
+
+// Read n floats stored with the given byte order
+static bool read_floats(FILE *f, float *p, size_t n, bool little_endian)
+{
+	if (fread(p, sizeof(float), n, f) != n)
+		return false;
+	if (little_endian != we_are_little_endian())
+		for (size_t i = 0; i < n; i++)
+			swap_float(p[i]);
+	return true;
+}
+
+
+// Flip an image upside down, for formats that store the bottom row first
+static void flip_rows(FloatImage &img)
+{
+	size_t row_len = size_t(img.width) * img.channels;
+	for (int y = 0; y < img.height / 2; y++)
+		swap_ranges(img.pixels.begin() + y * row_len,
+			img.pixels.begin() + (y + 1) * row_len,
+			img.pixels.begin() + (img.height - 1 - y) * row_len);
+}
+
+
+// Size the image, checking for sensible dimensions
+static bool alloc_image(FloatImage &img, int width, int height, int channels)
+{
+	if (width <= 0 || height <= 0 || channels <= 0 ||
+	    width > MAX_IMAGE_DIM || height > MAX_IMAGE_DIM || channels > 4) {
+		eprintf("Bad image size %d x %d x %d.\n",
+			width, height, channels);
+		return false;
+	}
+	img.width = width;
+	img.height = height;
+	img.channels = channels;
+	img.pixels.resize(size_t(width) * height * channels);
+	return true;
+}
+
+
+// Read a PFM file.  The "PF" or "Pf" has already been read.  The scale
+// is negative for little-endian data, and rows are stored bottom first.
+static bool read_pfm(FILE *f, FloatImage &img, int channels)
+{
+	int width, height;
+	float scale;
+	if (fscanf(f, "%d %d %f", &width, &height, &scale) != 3 ||
+	    !isspace(fgetc(f))) {
+		eprintf("Bad PFM header.\n");
+		return false;
+	}
+	if (!alloc_image(img, width, height, channels))
+		return false;
+	if (!read_floats(f, &img.pixels[0], img.pixels.size(), scale < 0.0f))
+		return false;
+	flip_rows(img);
+	return true;
+}
+
+
+// Read an NPY file.  The magic number has already been read.  Handles
+// C-order float32 and float64 arrays of shape (h, w) or (h, w, c).
+static bool read_npy(FILE *f, FloatImage &img)
+{
+	unsigned char ver[2];
+	if (fread(ver, 1, 2, f) != 2)
+		return false;
+	unsigned char len_bytes[4] = { 0, 0, 0, 0 };
+	if (fread(len_bytes, 1, ver[0] == 1 ? 2 : 4, f) != (ver[0] == 1 ? 2u : 4u))
+		return false;
+	size_t header_len = len_bytes[0] | (len_bytes[1] << 8) |
+		(len_bytes[2] << 16) | (size_t(len_bytes[3]) << 24);
+	if (header_len > 65536) {
+		eprintf("Bad NPY header.\n");
+		return false;
+	}
+	string header(header_len, '\0');
+	if (fread(&header[0], 1, header_len, f) != header_len)
+		return false;
+
+	// The header is a Python dict literal, such as
+	// {'descr': '<f4', 'fortran_order': False, 'shape': (480, 640, 3), }
+	size_t d = header.find("'descr'"), s = header.find("'shape'");
+	if (d == string::npos || s == string::npos ||
+	    (d = header.find('\'', d + 7)) == string::npos ||
+	    (s = header.find('(', s)) == string::npos) {
+		eprintf("Bad NPY header.\n");
+		return false;
+	}
+	string descr = header.substr(d + 1, 3);
+	if (header.find("'fortran_order': True") != string::npos) {
+		eprintf("Fortran-order NPY arrays are not supported.\n");
+		return false;
+	}
+	bool little_endian = (descr[0] == '<' ||
+		(descr[0] == '=' && we_are_little_endian()));
+	bool is_double = (descr.compare(1, 2, "f8") == 0);
+	if (!is_double && descr.compare(1, 2, "f4") != 0) {
+		eprintf("Unsupported NPY data type %s.\n", descr.c_str());
+		return false;
+	}
+
+	int shape[3] = { 0, 0, 1 }, ndims = 0;
+	const char *p = header.c_str() + s + 1;
+	while (ndims < 4) {
+		char *end;
+		long n = strtol(p, &end, 10);
+		if (end == p)
+			break;
+		if (ndims < 3)
+			shape[ndims] = int(n);
+		ndims++;
+		p = end;
+		while (*p == ',' || *p == ' ')
+			p++;
+	}
+	if (ndims < 2 || ndims > 3) {
+		eprintf("NPY array must have 2 or 3 dimensions.\n");
+		return false;
+	}
+	if (!alloc_image(img, shape[1], shape[0], shape[2]))
+		return false;
+
+	size_t n = img.pixels.size();
+	if (!is_double)
+		return read_floats(f, &img.pixels[0], n, little_endian);
+
+	vector<double> tmp(n);
+	if (fread(&tmp[0], sizeof(double), n, f) != n)
+		return false;
+	bool need_swap = (little_endian != we_are_little_endian());
+	for (size_t i = 0; i < n; i++) {
+		if (need_swap)
+			swap_double(tmp[i]);
+		img.pixels[i] = float(tmp[i]);
+	}
+	return true;
+}
+
+
+// Read headerless little-endian float32 data
+static bool read_raw(FILE *f, FloatImage &img, int width, int height)
+{
+	if (width <= 0 || height <= 0) {
+		eprintf("Need the size of a raw image.\n");
+		return false;
+	}
+	if (fseek(f, 0, SEEK_END) != 0)
+		return false;
+	long len = ftell(f);
+	size_t npix = size_t(width) * size_t(height);
+	if (len <= 0 || size_t(len) % (4 * npix) != 0) {
+		eprintf("Raw image size does not match %d x %d.\n",
+			width, height);
+		return false;
+	}
+	rewind(f);
+	if (!alloc_image(img, width, height, int(size_t(len) / (4 * npix))))
+		return false;
+	return read_floats(f, &img.pixels[0], img.pixels.size(), true);
+}
+
+
+// Read an image, recognizing PFM and NPY by their headers
+bool FloatImage::read(const char *filename, int raw_width, int raw_height)
+{
+	FILE *f = fopen(filename, "rb");
+	if (!f) {
+		eprintf("Error opening [%s] for reading: %s.\n", filename,
+			strerror(errno));
+		return false;
+	}
+	dprintf("Reading %s... ", filename);
+
+	bool ok;
+	char magic[6] = { 0 };
+	size_t n = fread(magic, 1, 6, f);
+	if (n >= 3 && magic[0] == 'P' && (magic[1] == 'F' || magic[1] == 'f') &&
+	    isspace(magic[2])) {
+		fseek(f, 2, SEEK_SET);
+		ok = read_pfm(f, *this, magic[1] == 'F' ? 3 : 1);
+	} else if (n == 6 && !memcmp(magic, "\x93NUMPY", 6)) {
+		ok = read_npy(f, *this);
+	} else {
+		ok = read_raw(f, *this, raw_width, raw_height);
+	}
+	fclose(f);
+
+	if (!ok) {
+		eprintf("Error reading file [%s].\n", filename);
+		return false;
+	}
+	dprintf("%d x %d x %d.\n", width, height, channels);
+	return true;
+}
+
+
+// Write n floats in little-endian order
+static bool write_floats_le(FILE *f, const float *p, size_t n)
+{
+	if (we_are_little_endian())
+		return fwrite(p, sizeof(float), n, f) == n;
+
+	const size_t block = 1 << 16;
+	vector<float> tmp;
+	for (size_t i = 0; i < n; i += block) {
+		size_t m = min(block, n - i);
+		tmp.assign(p + i, p + i + m);
+		for (size_t j = 0; j < m; j++)
+			swap_float(tmp[j]);
+		if (fwrite(&tmp[0], sizeof(float), m, f) != m)
+			return false;
+	}
+	return true;
+}
+
+
+// Write a PFM file, in native byte order, bottom row first
+static bool write_pfm(FILE *f, const FloatImage &img)
+{
+	if (img.channels != 1 && img.channels != 3) {
+		eprintf("PFM files must have 1 or 3 channels.\n");
+		return false;
+	}
+	if (fprintf(f, "%s\n%d %d\n%s\n", img.channels == 3 ? "PF" : "Pf",
+			img.width, img.height,
+			we_are_little_endian() ? "-1.0" : "1.0") < 0)
+		return false;
+	size_t row_len = size_t(img.width) * img.channels;
+	for (int y = img.height - 1; y >= 0; y--)
+		if (fwrite(&img.pixels[y * row_len], sizeof(float), row_len, f) !=
+		    row_len)
+			return false;
+	return true;
+}
+
+
+// Write a version 1.0 NPY file, in native byte order
+static bool write_npy(FILE *f, const FloatImage &img)
+{
+	char shape[64];
+	if (img.channels == 1)
+		sprintf(shape, "(%d, %d)", img.height, img.width);
+	else
+		sprintf(shape, "(%d, %d, %d)", img.height, img.width,
+			img.channels);
+	string header = string("{'descr': '") +
+		(we_are_little_endian() ? "<" : ">") +
+		"f4', 'fortran_order': False, 'shape': " + shape + ", }";
+
+	// Pad with spaces and a newline so the data is 64-byte aligned
+	size_t total = 10 + header.length() + 1;
+	header.append((64 - total % 64) % 64, ' ');
+	header += '\n';
+	size_t len = header.length();
+	unsigned char prefix[10] = { 0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0,
+		(unsigned char) (len & 0xff), (unsigned char) (len >> 8) };
+	return fwrite(prefix, 1, 10, f) == 10 &&
+		fwrite(header.c_str(), 1, len, f) == len &&
+		fwrite(&img.pixels[0], sizeof(float), img.pixels.size(), f) ==
+			img.pixels.size();
+}
+
+
+// Write an image, choosing the format by extension
+bool FloatImage::write(const char *filename) const
+{
+	if (pixels.empty() || pixels.size() !=
+	    size_t(width) * size_t(height) * size_t(channels)) {
+		eprintf("Empty image - nothing to write.\n");
+		return false;
+	}
+
+	FILE *f = fopen(filename, "wb");
+	if (!f) {
+		eprintf("Error opening [%s] for writing: %s.\n", filename,
+			strerror(errno));
+		return false;
+	}
+	dprintf("Writing %s... ", filename);
+
+	bool ok = write(f, filename);
+	if (fclose(f) != 0)
+		ok = false;
+
+	if (!ok) {
+		eprintf("Error writing file [%s].\n", filename);
+		return false;
+	}
+	dprintf("Done.\n");
+	return true;
+}
+
+
+// Write to an already open file
+bool FloatImage::write(FILE *f, const char *filename) const
+{
+	if (pixels.empty() || pixels.size() !=
+	    size_t(width) * size_t(height) * size_t(channels)) {
+		eprintf("Empty image - nothing to write.\n");
+		return false;
+	}
+	if (ends_with(filename, ".pfm"))
+		return write_pfm(f, *this);
+	else if (ends_with(filename, ".npy"))
+		return write_npy(f, *this);
+	else
+		return write_floats_le(f, &pixels[0], pixels.size());
+}
+
+
+DepthCamera::DepthCamera() : fx(1), fy(1), cx(0), cy(0),
+	zmin(-FLT_MAX), zmax(FLT_MAX)
+{
+}
+
+
+// Read fx fy cx cy from a .fc file
+bool DepthCamera::read_fc(const char *filename)
+{
+	FILE *f = fopen(filename, "r");
+	if (!f) {
+		eprintf("Error opening [%s] for reading: %s.\n", filename,
+			strerror(errno));
+		return false;
+	}
+	bool ok = (fscanf(f, "%f %f %f %f", &fx, &fy, &cx, &cy) == 4);
+	fclose(f);
+	if (!ok)
+		eprintf("Couldn't read intrinsics from [%s].\n", filename);
+	return ok;
+}
+
+
+// Does the file name look like a depth map?
+bool is_depth_map(const char *filename)
+{
+	return ends_with(filename, ".pfm") || ends_with(filename, ".npy") ||
+		ends_with(filename, ".raw");
+}
+
+
+// Build a range grid from a depth map.  Rows are done in parallel: a first
+// pass counts the valid pixels in each row, and after a prefix sum over
+// rows a second pass fills in the vertices, so they come out in row-major
+// order no matter how many threads there are.
+TriMesh *depth_to_grid(const FloatImage &depth, const FloatImage *normals,
+	const FloatImage *confidences, const DepthCamera &cam)
+{
+	int w = depth.width, h = depth.height;
+	if (w <= 0 || h <= 0 || depth.channels <= 0) {
+		eprintf("Empty depth map.\n");
+		return NULL;
+	}
+	if (normals && (normals->width != w || normals->height != h ||
+	                normals->channels < 3)) {
+		eprintf("Depth and normal maps do not match.\n");
+		return NULL;
+	}
+	if (confidences && (confidences->width != w ||
+	                    confidences->height != h)) {
+		eprintf("Depth and confidence maps do not match.\n");
+		return NULL;
+	}
+
+	dprintf("Building %d x %d range grid... ", w, h);
+	TriMesh *mesh = new TriMesh;
+	mesh->grid_width = w;
+	mesh->grid_height = h;
+	mesh->grid.resize(size_t(w) * h);
+	vector<int> row_start(h + 1);
+	const int dc = depth.channels;
+	const float zmin = cam.zmin, zmax = cam.zmax;
+
+	// Mark valid pixels, and count them in each row
+#pragma omp parallel for
+	for (int y = 0; y < h; y++) {
+		const float *d = &depth.pixels[size_t(y) * w * dc];
+		int *g = &mesh->grid[size_t(y) * w];
+		int count = 0;
+		for (int x = 0; x < w; x++) {
+			float z = d[x * dc];
+			bool valid = (z != 0.0f && z >= zmin && z <= zmax);
+			g[x] = valid ? 0 : TriMesh::GRID_INVALID;
+			count += valid;
+		}
+		row_start[y + 1] = count;
+	}
+	for (int y = 0; y < h; y++)
+		row_start[y + 1] += row_start[y];
+
+	int nv = row_start[h];
+	mesh->vertices.resize(nv);
+	if (normals)
+		mesh->normals.resize(nv);
+	if (confidences)
+		mesh->confidences.resize(nv);
+
+	// Back-project
+	const float fx_inv = 1.0f / cam.fx, fy_inv = 1.0f / cam.fy;
+	const float cx = cam.cx, cy = cam.cy;
+#pragma omp parallel for
+	for (int y = 0; y < h; y++) {
+		const float *d = &depth.pixels[size_t(y) * w * dc];
+		int *g = &mesh->grid[size_t(y) * w];
+		float ry = (cy - y) * fy_inv;
+		int ind = row_start[y];
+		for (int x = 0; x < w; x++) {
+			if (g[x] == TriMesh::GRID_INVALID)
+				continue;
+			float z = d[x * dc];
+			mesh->vertices[ind] =
+				point((x - cx) * fx_inv * z, ry * z, -z);
+			if (normals)
+				mesh->normals[ind] = vec(&normals->at(x, y));
+			if (confidences)
+				mesh->confidences[ind] = confidences->at(x, y);
+			g[x] = ind++;
+		}
+	}
+
+	dprintf("%d vertices.\n", nv);
+	return mesh;
+}
+
+
+// Extract depth and normal maps from a range grid
+bool grid_to_depth(const TriMesh *mesh, FloatImage &depth, FloatImage *normals)
+{
+	int w = mesh->grid_width, h = mesh->grid_height;
+	if (mesh->grid.empty() || w <= 0 || h <= 0) {
+		eprintf("No range grid to make a depth map from.\n");
+		return false;
+	}
+	if (normals && mesh->normals.size() != mesh->vertices.size()) {
+		eprintf("No normals to make a normal map from.\n");
+		return false;
+	}
+
+	depth.width = w;
+	depth.height = h;
+	depth.channels = 1;
+	depth.pixels.resize(size_t(w) * h);
+	if (normals) {
+		normals->width = w;
+		normals->height = h;
+		normals->channels = 3;
+		normals->pixels.resize(size_t(w) * h * 3);
+	}
+
+	const float nan = numeric_limits<float>::quiet_NaN();
+	const int nv = mesh->vertices.size();
+#pragma omp parallel for
+	for (int y = 0; y < h; y++) {
+		const int *g = &mesh->grid[size_t(y) * w];
+		float *d = &depth.pixels[size_t(y) * w];
+		float *n = normals ? &normals->pixels[size_t(y) * w * 3] : NULL;
+		for (int x = 0; x < w; x++) {
+			int ind = g[x];
+			bool valid = (ind >= 0 && ind < nv);
+			d[x] = valid ? -mesh->vertices[ind][2] : nan;
+			if (!n)
+				continue;
+			for (int j = 0; j < 3; j++)
+				n[3 * x + j] = valid ? mesh->normals[ind][j] : nan;
+		}
+	}
+	return true;
+}
+
+
+// Write depth and normal maps of a range grid
+bool write_depth_grid(const TriMesh *mesh, const char *depthfile,
+	const char *normalfile)
+{
+	FloatImage depth, normals;
+	if (!grid_to_depth(mesh, depth, normalfile ? &normals : NULL))
+		return false;
+	if (!depth.write(depthfile))
+		return false;
+	return !normalfile || normals.write(normalfile);
+}
+
+
+// depth.ext -> depth_normals.ext
+string normal_map_name(const char *depthfile)
+{
+	string name = depthfile;
+	size_t slash = name.find_last_of("/\\");
+	size_t dot = name.rfind('.');
+	if (dot == string::npos || (slash != string::npos && dot < slash))
+		return name + "_normals";
+	return name.substr(0, dot) + "_normals" + name.substr(dot);
+}
+
+
+// Read maps from files and build a range grid
+TriMesh *read_depth_grid(const char *depthfile, const char *normalfile,
+	const char *conffile, const DepthCamera &cam,
+	int raw_width, int raw_height)
+{
+	FloatImage depth, normals, confidences;
+	if (!depth.read(depthfile, raw_width, raw_height))
+		return NULL;
+	if (normalfile && !normals.read(normalfile, depth.width, depth.height))
+		return NULL;
+	if (conffile && !confidences.read(conffile, depth.width, depth.height))
+		return NULL;
+	return depth_to_grid(depth, normalfile ? &normals : NULL,
+		conffile ? &confidences : NULL, cam);
+}
+
+} // namespace trimesh
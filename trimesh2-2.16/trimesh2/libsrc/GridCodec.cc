@@ -0,0 +1,424 @@
+/*
+trimesh2 contributors
+Added to this tree; not part of the upstream trimesh2 distribution.
+
+GridCodec.cc
+Lossless compression of per-vertex attributes of range grids.
+*/
+
+#include "GridCodec.h"
+#include <cstring>
+#include <algorithm>
+using namespace std;
+
+
+namespace trimesh {
+
+// How each byte plane is stored
+enum { PLANE_RAW, PLANE_CONST, PLANE_RANS };
+
+// rANS parameters: frequencies sum to PROB_SCALE, and the state is kept
+// in [RANS_L, 65536 * RANS_L) by moving 16-bit words in and out
+#define PROB_BITS 12
+#define PROB_SCALE (1u << PROB_BITS)
+#define RANS_L (1u << 16)
+#define RANS_STATES 4
+
+
+// Little-endian integers of various sizes
+template <class T>
+static inline T get_le(const unsigned char *p)
+{
+	T x = 0;
+	for (size_t b = 0; b < sizeof(T); b++)
+		x |= T(T(p[b]) << (8 * b));
+	return x;
+}
+
+template <class T>
+static inline void put_le(unsigned char *p, T x)
+{
+	for (size_t b = 0; b < sizeof(T); b++)
+		p[b] = (unsigned char) (x >> (8 * b));
+}
+
+
+// Map small negative differences to small unsigned numbers, and back
+template <class T>
+static inline T zigzag(T d)
+{
+	return T(T(d << 1) ^ T(T(0) - T(d >> (8 * sizeof(T) - 1))));
+}
+
+template <class T>
+static inline T unzigzag(T z)
+{
+	return T(T(z >> 1) ^ T(T(0) - T(z & 1)));
+}
+
+
+// The records from which a cell's record is predicted: left, up, and
+// upper-left if all are valid, else whichever of left, up, and the
+// previous record exists.  Returns the number of records used.
+static inline int neighbors(const int *cells, int width, int x, int y,
+	int first, size_t i, size_t ref[3])
+{
+	const int *c = cells + size_t(y) * width + x;
+	int l = x ? c[-1] : -1;
+	int u = y ? c[-width] : -1;
+	int ul = (x && y) ? c[-width-1] : -1;
+	if (l >= 0 && u >= 0 && ul >= 0) {
+		ref[0] = size_t(l - first);
+		ref[1] = size_t(u - first);
+		ref[2] = size_t(ul - first);
+		return 3;
+	} else if (l >= 0) {
+		ref[0] = size_t(l - first);
+		return 1;
+	} else if (u >= 0) {
+		ref[0] = size_t(u - first);
+		return 1;
+	} else if (i) {
+		ref[0] = i - 1;
+		return 1;
+	}
+	return 0;
+}
+
+
+// Compute the prediction residuals of src, split into byte planes
+template <class T>
+static void residuals(const unsigned char *src, size_t n, int ncomp,
+	const int *cells, int width, int rows, int first,
+	unsigned char *planes)
+{
+	const size_t nvals = n * ncomp;
+	vector<T> v(nvals), r(nvals);
+	for (size_t j = 0; j < nvals; j++)
+		v[j] = get_le<T>(src + j * sizeof(T));
+
+	for (int y = 0; y < rows; y++) {
+		for (int x = 0; x < width; x++) {
+			int ind = cells[size_t(y) * width + x];
+			if (ind < 0)
+				continue;
+			size_t i = size_t(ind - first), ref[3] = { 0, 0, 0 };
+			int nref = neighbors(cells, width, x, y, first, i, ref);
+			const T *vi = &v[i * ncomp], *a = &v[ref[0] * ncomp],
+				*b = &v[ref[1] * ncomp], *c = &v[ref[2] * ncomp];
+			T *ri = &r[i * ncomp];
+			if (nref == 3)
+				for (int k = 0; k < ncomp; k++)
+					ri[k] = zigzag(T(vi[k] - T(a[k] + b[k] - c[k])));
+			else if (nref == 1)
+				for (int k = 0; k < ncomp; k++)
+					ri[k] = zigzag(T(vi[k] - a[k]));
+			else
+				for (int k = 0; k < ncomp; k++)
+					ri[k] = zigzag(vi[k]);
+		}
+	}
+
+	for (int k = 0; k < ncomp; k++) {
+		for (size_t b = 0; b < sizeof(T); b++) {
+			unsigned char *p = planes + (k * sizeof(T) + b) * n;
+			for (size_t i = 0; i < n; i++)
+				p[i] = (unsigned char) (r[i * ncomp + k] >> (8 * b));
+		}
+	}
+}
+
+
+// Undo residuals(), writing the records to dst
+template <class T>
+static void reconstruct(const unsigned char *planes, size_t n, int ncomp,
+	const int *cells, int width, int rows, int first,
+	unsigned char *dst)
+{
+	const size_t nvals = n * ncomp;
+	vector<T> v(nvals);
+	for (int k = 0; k < ncomp; k++) {
+		const unsigned char *p = planes + k * sizeof(T) * n;
+		for (size_t i = 0; i < n; i++) {
+			T r = 0;
+			for (size_t b = 0; b < sizeof(T); b++)
+				r |= T(T(p[b * n + i]) << (8 * b));
+			v[i * ncomp + k] = r;
+		}
+	}
+
+	for (int y = 0; y < rows; y++) {
+		for (int x = 0; x < width; x++) {
+			int ind = cells[size_t(y) * width + x];
+			if (ind < 0)
+				continue;
+			size_t i = size_t(ind - first), ref[3] = { 0, 0, 0 };
+			int nref = neighbors(cells, width, x, y, first, i, ref);
+			T *vi = &v[i * ncomp];
+			const T *a = &v[ref[0] * ncomp], *b = &v[ref[1] * ncomp],
+				*c = &v[ref[2] * ncomp];
+			if (nref == 3)
+				for (int k = 0; k < ncomp; k++)
+					vi[k] = T(unzigzag(vi[k]) + a[k] + b[k] - c[k]);
+			else if (nref == 1)
+				for (int k = 0; k < ncomp; k++)
+					vi[k] = T(unzigzag(vi[k]) + a[k]);
+			else
+				for (int k = 0; k < ncomp; k++)
+					vi[k] = unzigzag(vi[k]);
+		}
+	}
+
+	for (size_t j = 0; j < nvals; j++)
+		put_le<T>(dst + j * sizeof(T), v[j]);
+}
+
+
+// Scale symbol counts (of n symbols in all) to frequencies summing to
+// PROB_SCALE, keeping every symbol that occurs
+static void normalize_freqs(const size_t count[256], size_t n,
+	unsigned freq[256])
+{
+	unsigned sum = 0;
+	int biggest = 0;
+	for (int s = 0; s < 256; s++) {
+		freq[s] = count[s] ? max(1u, unsigned((unsigned long long)
+			count[s] * PROB_SCALE / n)) : 0;
+		sum += freq[s];
+		if (count[s] > count[biggest])
+			biggest = s;
+	}
+
+	// Rounding up rare symbols can go over, so take the excess from
+	// the most frequent ones
+	while (sum > PROB_SCALE) {
+		int s = int(max_element(freq, freq + 256) - freq);
+		freq[s]--;
+		sum--;
+	}
+	freq[biggest] += PROB_SCALE - sum;
+}
+
+
+// Put a symbol of frequency f and cumulative frequency c into the rANS
+// state x, moving a word out to *ptr (which moves backwards) if need be
+static inline void rans_put(unsigned &x, unsigned char *&ptr,
+	unsigned f, unsigned c)
+{
+	if (x >= ((RANS_L >> PROB_BITS) << 16) * f) {
+		ptr -= 2;
+		put_le<unsigned short>(ptr, (unsigned short) (x & 0xffff));
+		x >>= 16;
+	}
+	x = ((x / f) << PROB_BITS) + (x % f) + c;
+}
+
+// Take a symbol out of the rANS state x, using the slot table, and move a
+// word in from ptr if need be.  Each slot holds the symbol in the low 8
+// bits, the offset of the slot within the symbol's range in the next 12,
+// and the symbol's frequency in the top 12.  The caller makes sure that
+// there are 2 bytes at ptr.
+static inline unsigned char rans_get(unsigned &x, const unsigned char *&ptr,
+	const unsigned *slots)
+{
+	unsigned s = slots[x & (PROB_SCALE - 1)];
+	x = (s >> 20) * (x >> PROB_BITS) + ((s >> 8) & (PROB_SCALE - 1));
+	unsigned w = get_le<unsigned short>(ptr);
+	bool more = (x < RANS_L);
+	x = more ? (x << 16) | w : x;
+	ptr += more ? 2 : 0;
+	return (unsigned char) (s & 0xff);
+}
+
+
+// Compress one byte plane of n bytes.  Symbol i goes into rANS state
+// i % RANS_STATES, which lets the decoder work on several at once.
+static void encode_plane(const unsigned char *p, size_t n,
+	vector<unsigned char> &out)
+{
+	size_t count[256] = { 0 };
+	for (size_t i = 0; i < n; i++)
+		count[p[i]]++;
+	int nsyms = 0;
+	for (int s = 0; s < 256; s++)
+		nsyms += (count[s] != 0);
+	if (nsyms == 1) {
+		out.push_back(PLANE_CONST);
+		out.push_back(p[0]);
+		return;
+	}
+
+	unsigned freq[256], cum[257];
+	normalize_freqs(count, n, freq);
+	cum[0] = 0;
+	for (int s = 0; s < 256; s++)
+		cum[s+1] = cum[s] + freq[s];
+
+	// rANS runs backwards, each symbol putting out at most one word
+	vector<unsigned char> buf(2 * n + 4 * RANS_STATES);
+	unsigned char *end = &buf[0] + buf.size(), *ptr = end;
+	unsigned x[RANS_STATES];
+	for (int j = 0; j < RANS_STATES; j++)
+		x[j] = RANS_L;
+	for (size_t i = n; i-- > 0; )
+		rans_put(x[i % RANS_STATES], ptr, freq[p[i]], cum[p[i]]);
+	for (int j = RANS_STATES; j-- > 0; ) {
+		ptr -= 4;
+		put_le<unsigned>(ptr, x[j]);
+	}
+	size_t len = size_t(end - ptr);
+
+	if (2 + 3 * nsyms + 4 + len >= 1 + n) {
+		out.push_back(PLANE_RAW);
+		out.insert(out.end(), p, p + n);
+		return;
+	}
+	out.push_back(PLANE_RANS);
+	out.push_back((unsigned char) (nsyms - 1));
+	for (int s = 0; s < 256; s++) {
+		if (!freq[s])
+			continue;
+		out.push_back((unsigned char) s);
+		out.push_back((unsigned char) (freq[s] & 0xff));
+		out.push_back((unsigned char) (freq[s] >> 8));
+	}
+	unsigned char l[4];
+	put_le<unsigned>(l, unsigned(len));
+	out.insert(out.end(), l, l + 4);
+	out.insert(out.end(), ptr, end);
+}
+
+
+// Decompress one byte plane of n bytes from [src, end), advancing src
+static bool decode_plane(const unsigned char *&src,
+	const unsigned char *end, size_t n, unsigned char *p)
+{
+	if (src == end)
+		return false;
+	int mode = *src++;
+	if (mode == PLANE_RAW) {
+		if (size_t(end - src) < n)
+			return false;
+		memcpy(p, src, n);
+		src += n;
+		return true;
+	} else if (mode == PLANE_CONST) {
+		if (src == end)
+			return false;
+		memset(p, *src++, n);
+		return true;
+	} else if (mode != PLANE_RANS) {
+		return false;
+	}
+
+	if (src == end)
+		return false;
+	int nsyms = *src++ + 1;
+	if (size_t(end - src) < size_t(3 * nsyms + 4))
+		return false;
+	unsigned slots[PROB_SCALE];
+	unsigned cum = 0;
+	for (int j = 0; j < nsyms; j++, src += 3) {
+		unsigned f = src[1] | (src[2] << 8);
+		if (!f || f >= PROB_SCALE || f > PROB_SCALE - cum)
+			return false;
+		for (unsigned k = 0; k < f; k++)
+			slots[cum + k] = src[0] | (k << 8) | (f << 20);
+		cum += f;
+	}
+	if (cum != PROB_SCALE)
+		return false;
+	size_t len = get_le<unsigned>(src);
+	src += 4;
+	if (len < 4 * RANS_STATES || size_t(end - src) < len)
+		return false;
+
+	const unsigned char *ptr = src, *stop = src + len;
+	unsigned x[RANS_STATES];
+	for (int j = 0; j < RANS_STATES; j++, ptr += 4)
+		x[j] = get_le<unsigned>(ptr);
+
+	// Each group of symbols takes at most one word per state, so the
+	// bounds only need checking once we get near the end
+	size_t i = 0;
+	for ( ; i + RANS_STATES <= n &&
+	        size_t(stop - ptr) >= 2 * RANS_STATES; i += RANS_STATES) {
+		for (int j = 0; j < RANS_STATES; j++)
+			p[i+j] = rans_get(x[j], ptr, slots);
+	}
+	for ( ; i < n; i++) {
+		unsigned &xj = x[i % RANS_STATES];
+		unsigned s = slots[xj & (PROB_SCALE - 1)];
+		xj = (s >> 20) * (xj >> PROB_BITS) + ((s >> 8) & (PROB_SCALE - 1));
+		if (xj < RANS_L) {
+			if (stop - ptr < 2)
+				return false;
+			xj = (xj << 16) | get_le<unsigned short>(ptr);
+			ptr += 2;
+		}
+		p[i] = (unsigned char) (s & 0xff);
+	}
+
+	// We should be back where the encoder started
+	src = stop;
+	for (int j = 0; j < RANS_STATES; j++)
+		if (x[j] != RANS_L)
+			return false;
+	return ptr == stop;
+}
+
+
+// Compress n records of ncomp components of csize bytes each, appending
+// the result to out
+void grid_encode(const unsigned char *src, size_t n,
+	int ncomp, int csize, const int *cells, int width, int rows,
+	int first, vector<unsigned char> &out)
+{
+	if (!n)
+		return;
+	int nplanes = ncomp * csize;
+	vector<unsigned char> planes(nplanes * n);
+	if (csize == 1)
+		residuals<unsigned char>(src, n, ncomp, cells, width, rows,
+			first, &planes[0]);
+	else if (csize == 2)
+		residuals<unsigned short>(src, n, ncomp, cells, width, rows,
+			first, &planes[0]);
+	else
+		residuals<unsigned>(src, n, ncomp, cells, width, rows,
+			first, &planes[0]);
+	for (int p = 0; p < nplanes; p++)
+		encode_plane(&planes[p * n], n, out);
+}
+
+
+// Decompress len bytes of src into n records at dst.  Returns false if
+// the data are corrupt.
+bool grid_decode(const unsigned char *src, size_t len, size_t n,
+	int ncomp, int csize, const int *cells, int width, int rows,
+	int first, unsigned char *dst)
+{
+	if (!n)
+		return len == 0;
+	int nplanes = ncomp * csize;
+	vector<unsigned char> planes(nplanes * n);
+	const unsigned char *end = src + len;
+	for (int p = 0; p < nplanes; p++)
+		if (!decode_plane(src, end, n, &planes[p * n]))
+			return false;
+	if (src != end)
+		return false;
+
+	if (csize == 1)
+		reconstruct<unsigned char>(&planes[0], n, ncomp, cells, width,
+			rows, first, dst);
+	else if (csize == 2)
+		reconstruct<unsigned short>(&planes[0], n, ncomp, cells, width,
+			rows, first, dst);
+	else
+		reconstruct<unsigned>(&planes[0], n, ncomp, cells, width,
+			rows, first, dst);
+	return true;
+}
+
+} // namespace trimesh
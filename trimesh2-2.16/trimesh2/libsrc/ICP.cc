@@ -625,12 +625,8 @@ float ICP(TriMesh *mesh1, TriMesh *mesh2,
 	mesh1->need_normals();
 	mesh2->need_normals();
 	if (REJECT_BDY) {
-		mesh1->need_faces();
-		mesh1->need_neighbors();
-		mesh1->need_adjacentfaces();
-		mesh2->need_faces();
-		mesh2->need_neighbors();
-		mesh2->need_adjacentfaces();
+		mesh1->need_opposite_corners();
+		mesh2->need_opposite_corners();
 	}
 
 	// Initial distance and angle thresholds
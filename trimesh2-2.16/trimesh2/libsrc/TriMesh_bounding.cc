@@ -17,13 +17,15 @@ namespace trimesh {
 // Find axis-aligned bounding box of the vertices
 void TriMesh::need_bbox()
 {
-	if (vertices.empty() || bbox.valid)
+	if (vertices.empty() || (bbox.valid && current(bbox_gen)))
 		return;
 
 	dprintf("Computing bounding box... ");
 
+	bbox.clear();
 	for (size_t i = 0; i < vertices.size(); i++)
 		bbox += vertices[i];
+	bbox_gen = geometry_gen;
 
 	dprintf("Done.\n  x = %g .. %g, y = %g .. %g, z = %g .. %g\n",
 		bbox.min[0], bbox.max[0], bbox.min[1],
@@ -38,7 +40,7 @@ void TriMesh::need_bbox()
 // Compute bounding sphere of the vertices.
 void TriMesh::need_bsphere()
 {
-	if (vertices.empty() || bsphere.valid)
+	if (vertices.empty() || (bsphere.valid && current(bsphere_gen)))
 		return;
 
 	dprintf("Computing bounding sphere... ");
@@ -49,6 +51,7 @@ void TriMesh::need_bsphere()
 	bsphere.center = mb.center();
 	bsphere.r = sqrt(mb.squared_radius());
 	bsphere.valid = true;
+	bsphere_gen = geometry_gen;
 
 	dprintf("Done.\n  center = (%g, %g, %g), radius = %g\n",
 		bsphere.center[0], bsphere.center[1],
@@ -78,7 +81,7 @@ static int farthest_vertex_along(const TriMesh &t, const vec &dir)
 // Approximate bounding sphere code based on an algorithm by Ritter
 void TriMesh::need_bsphere()
 {
-	if (vertices.empty() || bsphere.valid)
+	if (vertices.empty() || (bsphere.valid && current(bsphere_gen)))
 		return;
 
 	need_bbox();
@@ -119,6 +122,7 @@ void TriMesh::need_bsphere()
 	}
 
 	bsphere.valid = true;
+	bsphere_gen = geometry_gen;
 	dprintf("Done.\n  center = (%g, %g, %g), radius = %g\n",
 		bsphere.center[0], bsphere.center[1],
 		bsphere.center[2], bsphere.r);
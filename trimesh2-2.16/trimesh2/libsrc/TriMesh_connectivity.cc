@@ -8,16 +8,143 @@ Manipulate data structures that describe connectivity between faces and verts.
 
 
 #include "TriMesh.h"
+#include "CornerTable.h"
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 using namespace std;
 
 
 namespace trimesh {
 
+// Number of threads available to parallel loops
+static inline int num_threads()
+{
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+
+// Build the compressed list of faces touching each vertex.  Each face
+// appears once per corner, in increasing order.
+static void build_adjacentfaces(const vector<TriMesh::Face> &faces, int nv,
+	vector<int> &offsets, vector<int> &list)
+{
+	int nf = faces.size();
+	offsets.clear();
+	offsets.resize(nv + 1);
+	int *count = &offsets[1];
+
+	// With one thread, a plain pass over the faces produces the lists
+	// in order.  Otherwise, faces are counted and scattered in parallel
+	// with atomic updates, then each list is sorted so that the result
+	// does not depend on thread scheduling.  The atomics are several
+	// times slower than plain increments, so this only pays off with
+	// more than one thread.
+	bool parallel = num_threads() > 1;
+
+	// Count, then turn counts into offsets
+	if (parallel) {
+#pragma omp parallel for
+		for (int i = 0; i < nf; i++) {
+			for (int j = 0; j < 3; j++) {
+#pragma omp atomic
+				count[faces[i][j]]++;
+			}
+		}
+	} else {
+		for (int i = 0; i < nf; i++) {
+			count[faces[i][0]]++;
+			count[faces[i][1]]++;
+			count[faces[i][2]]++;
+		}
+	}
+	for (int i = 0; i < nv; i++)
+		offsets[i+1] += offsets[i];
+
+	list.resize(offsets[nv]);
+	vector<int> pos(offsets.begin(), offsets.end() - 1);
+	if (parallel) {
+#pragma omp parallel for
+		for (int i = 0; i < nf; i++) {
+			for (int j = 0; j < 3; j++) {
+				int k;
+#pragma omp atomic capture
+				k = pos[faces[i][j]]++;
+				list[k] = i;
+			}
+		}
+#pragma omp parallel for schedule(dynamic,4096)
+		for (int i = 0; i < nv; i++)
+			sort(list.begin() + offsets[i],
+			     list.begin() + offsets[i+1]);
+	} else {
+		for (int i = 0; i < nf; i++) {
+			for (int j = 0; j < 3; j++)
+				list[pos[faces[i][j]]++] = i;
+		}
+	}
+}
+
+
+// Expand a compressed list into a vector per entry
+static void unpack_lists(const vector<int> &offsets, const vector<int> &list,
+	vector< vector<int> > &lists)
+{
+	int n = int(offsets.size()) - 1;
+	lists.resize(n);
+#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+		lists[i].assign(list.begin() + offsets[i],
+		                list.begin() + offsets[i+1]);
+}
+
+
+// Gather the neighbors of vertex v from the faces touching it
+// (adj_begin through adj_end) into me, in the order they are first seen.
+// Returns the number of neighbors.
+static inline int gather_neighbors(const vector<TriMesh::Face> &faces,
+	const int *adj_begin, const int *adj_end, int v, int *me)
+{
+	int n = 0;
+	for (const int *a = adj_begin; a != adj_end; a++) {
+		int f = *a;
+		// Faces with repeated vertices appear more than once,
+		// but are handled all at once
+		if (a != adj_begin && *(a-1) == f)
+			continue;
+		for (int j = 0; j < 3; j++) {
+			if (faces[f][j] != v)
+				continue;
+			int n1 = faces[f][NEXT_MOD3(j)];
+			int n2 = faces[f][PREV_MOD3(j)];
+			if (find(me, me + n, n1) == me + n)
+				me[n++] = n1;
+			if (find(me, me + n, n2) == me + n)
+				me[n++] = n2;
+		}
+	}
+	return n;
+}
+
+
 // Find the direct neighbors of each vertex
 void TriMesh::need_neighbors()
 {
-	if (!neighbors.empty())
+	if (!compact_connectivity) {
+		if (!neighbors.empty())
+			return;
+		if (!neighbor_offsets.empty()) {
+			unpack_lists(neighbor_offsets, neighbor_list, neighbors);
+			return;
+		}
+	} else if (!neighbor_offsets.empty()) {
 		return;
+	}
 
 	need_faces();
 	if (faces.empty())
@@ -26,27 +153,80 @@ void TriMesh::need_neighbors()
 	dprintf("Finding vertex neighbors... ");
 	int nv = vertices.size(), nf = faces.size();
 
-	vector<int> numneighbors(nv);
-	for (int i = 0; i < nf; i++) {
-		numneighbors[faces[i][0]]++;
-		numneighbors[faces[i][1]]++;
-		numneighbors[faces[i][2]]++;
+	if (!compact_connectivity) {
+		// Build the lists directly, one face at a time
+		vector<int> numneighbors(nv);
+		for (int i = 0; i < nf; i++) {
+			numneighbors[faces[i][0]]++;
+			numneighbors[faces[i][1]]++;
+			numneighbors[faces[i][2]]++;
+		}
+
+		neighbors.resize(nv);
+		for (int i = 0; i < nv; i++)
+			neighbors[i].reserve(numneighbors[i]);
+
+		for (int i = 0; i < nf; i++) {
+			for (int j = 0; j < 3; j++) {
+				vector<int> &me = neighbors[faces[i][j]];
+				int n1 = faces[i][NEXT_MOD3(j)];
+				int n2 = faces[i][PREV_MOD3(j)];
+				if (find(me.begin(), me.end(), n1) == me.end())
+					me.push_back(n1);
+				if (find(me.begin(), me.end(), n2) == me.end())
+					me.push_back(n2);
+			}
+		}
+
+		dprintf("Done.\n");
+		return;
 	}
 
-	neighbors.resize(nv);
-	for (int i = 0; i < nv; i++)
-		neighbors[i].reserve(numneighbors[i]);
+	if (adjacentface_offsets.empty())
+		build_adjacentfaces(faces, nv,
+			adjacentface_offsets, adjacentface_list);
 
-	for (int i = 0; i < nf; i++) {
-		for (int j = 0; j < 3; j++) {
-			vector<int> &me = neighbors[faces[i][j]];
-			int n1 = faces[i][NEXT_MOD3(j)];
-			int n2 = faces[i][PREV_MOD3(j)];
-			if (find(me.begin(), me.end(), n1) == me.end())
-				me.push_back(n1);
-			if (find(me.begin(), me.end(), n2) == me.end())
-				me.push_back(n2);
+	// Each vertex gathers its neighbors from the faces touching it, in
+	// the same order as above.  Blocks of vertices are gathered into
+	// separate lists, which are then copied into place.  A vertex has
+	// at most twice as many neighbors as adjacent faces, which bounds
+	// the space needed by each block.
+	const int *aoffsets = &adjacentface_offsets[0];
+	const int *alist = &adjacentface_list[0];
+	const int block_size = 16384;
+	int nblocks = (nv + block_size - 1) / block_size;
+	vector< vector<int> > blocks(nblocks);
+	neighbor_offsets.resize(nv + 1);
+	neighbor_offsets[0] = 0;
+#pragma omp parallel for schedule(dynamic)
+	for (int b = 0; b < nblocks; b++) {
+		int v0 = b * block_size, v1 = min(v0 + block_size, nv);
+		vector<int> &block = blocks[b];
+		block.resize(2 * (aoffsets[v1] - aoffsets[v0]));
+		if (block.empty()) {
+			fill(neighbor_offsets.begin() + v0 + 1,
+			     neighbor_offsets.begin() + v1 + 1, 0);
+			continue;
+		}
+		int n = 0;
+		for (int v = v0; v < v1; v++) {
+			int nn = gather_neighbors(faces,
+				alist + aoffsets[v], alist + aoffsets[v+1],
+				v, &block[0] + n);
+			neighbor_offsets[v+1] = nn;
+			n += nn;
 		}
+		block.resize(n);
+	}
+	for (int i = 0; i < nv; i++)
+		neighbor_offsets[i+1] += neighbor_offsets[i];
+
+	neighbor_list.resize(neighbor_offsets[nv]);
+#pragma omp parallel for
+	for (int b = 0; b < nblocks; b++) {
+		copy(blocks[b].begin(), blocks[b].end(),
+		     neighbor_list.begin() + neighbor_offsets[b * block_size]);
+		clear_and_release(blocks[b]);
 	}
 
 	dprintf("Done.\n");
@@ -56,8 +236,17 @@ void TriMesh::need_neighbors()
 // Find the faces touching each vertex
 void TriMesh::need_adjacentfaces()
 {
-	if (!adjacentfaces.empty())
+	if (!compact_connectivity) {
+		if (!adjacentfaces.empty())
+			return;
+		if (!adjacentface_offsets.empty()) {
+			unpack_lists(adjacentface_offsets, adjacentface_list,
+				adjacentfaces);
+			return;
+		}
+	} else if (!adjacentface_offsets.empty()) {
 		return;
+	}
 
 	need_faces();
 	if (faces.empty())
@@ -66,20 +255,277 @@ void TriMesh::need_adjacentfaces()
 	dprintf("Finding vertex to triangle maps... ");
 	int nv = vertices.size(), nf = faces.size();
 
-	vector<int> numadjacentfaces(nv);
-	for (int i = 0; i < nf; i++) {
-		numadjacentfaces[faces[i][0]]++;
-		numadjacentfaces[faces[i][1]]++;
-		numadjacentfaces[faces[i][2]]++;
+	if (!compact_connectivity) {
+		// Build the lists directly, one face at a time
+		vector<int> numadjacentfaces(nv);
+		for (int i = 0; i < nf; i++) {
+			numadjacentfaces[faces[i][0]]++;
+			numadjacentfaces[faces[i][1]]++;
+			numadjacentfaces[faces[i][2]]++;
+		}
+
+		adjacentfaces.resize(nv);
+		for (int i = 0; i < nv; i++)
+			adjacentfaces[i].reserve(numadjacentfaces[i]);
+
+		for (int i = 0; i < nf; i++) {
+			for (int j = 0; j < 3; j++)
+				adjacentfaces[faces[i][j]].push_back(i);
+		}
+	} else {
+		build_adjacentfaces(faces, nv,
+			adjacentface_offsets, adjacentface_list);
+	}
+
+	dprintf("Done.\n");
+}
+
+
+// Add per-corner values into per-vertex values.  With one thread, this
+// is a plain pass over the faces.  Otherwise, each vertex gathers from
+// the faces touching it, which are listed in increasing order, so both
+// ways add the same values in the same order.
+template <class T>
+static void sum_corners_helper(TriMesh *mesh, const T *corner_vals,
+	T *vert_vals)
+{
+	const vector<TriMesh::Face> &faces = mesh->faces;
+	int nf = faces.size(), nv = mesh->vertices.size();
+	if (!nf)
+		return;
+
+	if (num_threads() == 1) {
+		for (int i = 0; i < nf; i++) {
+			for (int j = 0; j < 3; j++)
+				vert_vals[faces[i][j]] += corner_vals[3 * i + j];
+		}
+		return;
 	}
 
-	adjacentfaces.resize(vertices.size());
+	// Lists that do not fit the faces were left behind by code that
+	// changed the faces without calling changed_faces()
+	if (mesh->adjacentface_offsets.empty() ?
+	    int(mesh->adjacentfaces.size()) != nv :
+	    (int(mesh->adjacentface_offsets.size()) != nv + 1 ||
+	     mesh->adjacentface_offsets[nv] != 3 * nf))
+		mesh->clear_adjacentfaces();
+	if (mesh->adjacentfaces.empty() && mesh->adjacentface_offsets.empty())
+		build_adjacentfaces(faces, nv,
+			mesh->adjacentface_offsets, mesh->adjacentface_list);
+	const TriMesh *cmesh = mesh;
+#pragma omp parallel for schedule(dynamic,4096)
+	for (int v = 0; v < nv; v++) {
+		T sum = vert_vals[v];
+		TriMesh::IndexList a = cmesh->adjacentfaces_of(v);
+		for (size_t k = 0; k < a.size(); k++) {
+			int f = a[k];
+			// Faces with repeated vertices appear more than once,
+			// but are handled all at once
+			if (k && a[k-1] == f)
+				continue;
+			for (int j = 0; j < 3; j++) {
+				if (faces[f][j] == v)
+					sum += corner_vals[3 * f + j];
+			}
+		}
+		vert_vals[v] = sum;
+	}
+}
+
+void TriMesh::sum_corners(const float *corner_vals, float *vert_vals)
+{
+	sum_corners_helper(this, corner_vals, vert_vals);
+}
+
+void TriMesh::sum_corners(const vec *corner_vals, vec *vert_vals)
+{
+	sum_corners_helper(this, corner_vals, vert_vals);
+}
+
+void TriMesh::sum_corners(const Vec<4,float> *corner_vals,
+	Vec<4,float> *vert_vals)
+{
+	sum_corners_helper(this, corner_vals, vert_vals);
+}
+
+
+// Build the compressed list of corners facing edges whose lower-numbered
+// vertex is v, for each v.  Corners facing degenerate edges are left out.
+// This is a counting sort on the lower vertex, done the same way as in
+// build_adjacentfaces(), except that the order within each list does
+// not matter.
+static void bucket_corners(const vector<TriMesh::Face> &faces, int nv,
+	vector<int> &offsets, vector<int> &list)
+{
+	int nf = faces.size();
+	offsets.clear();
+	offsets.resize(nv + 1);
+	int *count = &offsets[1];
+	bool parallel = num_threads() > 1;
+
+#pragma omp parallel for if (parallel)
+	for (int i = 0; i < nf; i++) {
+		for (int j = 0; j < 3; j++) {
+			int v1 = faces[i][NEXT_MOD3(j)], v2 = faces[i][PREV_MOD3(j)];
+			if (v1 == v2)
+				continue;
+			int v = min(v1, v2);
+			if (parallel) {
+#pragma omp atomic
+				count[v]++;
+			} else {
+				count[v]++;
+			}
+		}
+	}
 	for (int i = 0; i < nv; i++)
-		adjacentfaces[i].reserve(numadjacentfaces[i]);
+		offsets[i+1] += offsets[i];
 
+	list.resize(offsets[nv]);
+	vector<int> pos(offsets.begin(), offsets.end() - 1);
+#pragma omp parallel for if (parallel)
 	for (int i = 0; i < nf; i++) {
-		for (int j = 0; j < 3; j++)
-			adjacentfaces[faces[i][j]].push_back(i);
+		for (int j = 0; j < 3; j++) {
+			int v1 = faces[i][NEXT_MOD3(j)], v2 = faces[i][PREV_MOD3(j)];
+			if (v1 == v2)
+				continue;
+			int v = min(v1, v2), k;
+			if (parallel) {
+#pragma omp atomic capture
+				k = pos[v]++;
+			} else {
+				k = pos[v]++;
+			}
+			list[k] = 3 * i + j;
+		}
+	}
+}
+
+
+// Orders corners in the bucket of vertex v by the other vertex of the
+// edge they face
+struct OtherVertexLess {
+	const vector<TriMesh::Face> &faces;
+	int v;
+	OtherVertexLess(const vector<TriMesh::Face> &faces_, int v_) :
+		faces(faces_), v(v_)
+		{}
+	int other(int c) const
+	{
+		const TriMesh::Face &f = faces[c / 3];
+		int j = c % 3;
+		return f[NEXT_MOD3(j)] + f[PREV_MOD3(j)] - v;
+	}
+	bool operator () (int c1, int c2) const
+	{
+		return other(c1) < other(c2);
+	}
+};
+
+
+// Find the corner opposite each corner, across the edge it faces.
+// Corners are bucketed by the lower-numbered vertex of the edge they face,
+// so matching corners end up in the same (small) bucket.
+void TriMesh::need_opposite_corners()
+{
+	if (!vertex_corners.empty())
+		return;
+
+	need_faces();
+	int nv = vertices.size(), nf = faces.size();
+	if (!nf) {
+		// Nothing is on the boundary
+		vertex_corners.resize(nv, -1);
+		return;
+	}
+
+	dprintf("Finding opposite corners... ");
+	vector<int> offsets, list;
+	bucket_corners(faces, nv, offsets, list);
+
+	// Within each bucket, match each corner to the first corner in a
+	// different face that faces the same edge in the opposite direction.
+	// This picks the same faces as the search through adjacentfaces that
+	// this replaces.  Edges shared only with inconsistently oriented
+	// faces, and degenerate edges, are UNMATCHED_CORNER rather than
+	// boundary.  Most buckets are small, so this just compares all
+	// pairs.  Big ones (around high-valence vertices) are first sorted by
+	// the other vertex, so that only runs facing the same edge are
+	// compared.
+	const int small_bucket = 32;
+	opposite_corners.clear();
+	opposite_corners.resize(3 * nf, -1);
+#pragma omp parallel for
+	for (int i = 0; i < nf; i++) {
+		for (int j = 0; j < 3; j++) {
+			if (faces[i][NEXT_MOD3(j)] == faces[i][PREV_MOD3(j)])
+				opposite_corners[3 * i + j] = UNMATCHED_CORNER;
+		}
+	}
+#pragma omp parallel
+	{
+		vector<int> other, from_v;
+#pragma omp for schedule(dynamic,4096)
+		for (int v = 0; v < nv; v++) {
+			int n = offsets[v+1] - offsets[v];
+			if (n < 2)
+				continue;
+			int *b = &list[offsets[v]];
+			if (n > small_bucket)
+				sort(b, b + n, OtherVertexLess(faces, v));
+			if (int(other.size()) < n) {
+				other.resize(n);
+				from_v.resize(n);
+			}
+			for (int k = 0; k < n; k++) {
+				int c = b[k];
+				const Face &f = faces[c / 3];
+				int j = c - 3 * (c / 3);
+				int v1 = f[NEXT_MOD3(j)], v2 = f[PREV_MOD3(j)];
+				from_v[k] = (v1 == v);
+				other[k] = v1 + v2 - v;
+			}
+			for (int r0 = 0, r1 = n; r0 < n; r0 = r1) {
+				if (n > small_bucket) {
+					r1 = r0 + 1;
+					while (r1 < n && other[r1] == other[r0])
+						r1++;
+				}
+				for (int k = r0; k < r1; k++) {
+					int c = b[k], best = -1;
+					bool shared = false;
+					for (int l = r0; l < r1; l++) {
+						int o = b[l];
+						if (other[l] != other[k] ||
+						    o / 3 == c / 3)
+							continue;
+						shared = true;
+						if (from_v[l] == from_v[k])
+							continue;
+						if (best < 0 || o < best)
+							best = o;
+					}
+					if (best < 0 && shared)
+						best = UNMATCHED_CORNER;
+					opposite_corners[c] = best;
+				}
+			}
+		}
+	}
+	// Pick a corner for each vertex.  Prefer one with a boundary edge
+	// coming in, then going out, so that is_bdy() need only look at this
+	// corner, and otherwise one that starts a fan.
+	vertex_corners.resize(nv, -1);
+	vector<unsigned char> rank(nv);
+	for (int c = 0; c < 3 * nf; c++) {
+		int v = faces[c/3][c%3];
+		int in = opposite_corners[CornerTable::next(c)];
+		int out = opposite_corners[CornerTable::prev(c)];
+		int r = (in == -1) ? 4 : (out == -1) ? 3 : (in < 0) ? 2 : 1;
+		if (r > rank[v]) {
+			rank[v] = r;
+			vertex_corners[v] = c;
+		}
 	}
 
 	dprintf("Done.\n");
@@ -93,37 +539,49 @@ void TriMesh::need_across_edge()
 	if (!across_edge.empty())
 		return;
 
-	need_adjacentfaces();
-	if (adjacentfaces.empty())
+	need_opposite_corners();
+	if (opposite_corners.empty())
 		return;
 
-	dprintf("Finding across-edge maps... ");
-
 	int nf = faces.size();
-	across_edge.resize(nf, Face(-1,-1,-1));
-
+	across_edge.resize(nf);
 #pragma omp parallel for
 	for (int i = 0; i < nf; i++) {
 		for (int j = 0; j < 3; j++) {
-			int v1 = faces[i][NEXT_MOD3(j)];
-			int v2 = faces[i][PREV_MOD3(j)];
-			const vector<int> &a1 = adjacentfaces[v1];
-			for (size_t k1 = 0; k1 < a1.size(); k1++) {
-				int other = a1[k1];
-				if (other == i)
-					continue;
-				int v2_in_other = faces[other].indexof(v2);
-				if (v2_in_other < 0)
-					continue;
-				if (faces[other][NEXT_MOD3(v2_in_other)] != v1)
-					continue;
-				across_edge[i][j] = other;
-				break;
-			}
+			int o = opposite_corners[3 * i + j];
+			across_edge[i][j] = (o < 0) ? -1 : o / 3;
 		}
 	}
+}
 
-	dprintf("Done.\n");
+// Find the boundary loops, starting each one at the smallest edge not
+// yet visited
+void CornerTable::boundary_loops(vector< vector<int> > &loops) const
+{
+	loops.clear();
+	int nc = num_corners();
+	vector< pair< pair<int,int>, int > > bdy;
+	for (int c = 0; c < nc; c++) {
+		int v1 = vertex(next(c)), v2 = vertex(prev(c));
+		if (is_bdy_edge(c) && v1 != v2)
+			bdy.push_back(make_pair(make_pair(v1, v2), c));
+	}
+	sort(bdy.begin(), bdy.end());
+
+	vector<bool> visited(nc);
+	for (size_t i = 0; i < bdy.size(); i++) {
+		int first = bdy[i].second;
+		if (visited[first])
+			continue;
+		loops.push_back(vector<int>());
+		vector<int> &loop = loops.back();
+		int c = first;
+		do {
+			visited[c] = true;
+			loop.push_back(vertex(next(c)));
+			c = next_bdy(c);
+		} while (c != first && is_bdy_edge(c) && !visited[c]);
+	}
 }
 
 } // namespace trimesh
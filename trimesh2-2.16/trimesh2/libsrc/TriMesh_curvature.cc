@@ -142,7 +142,7 @@ void diagonalize_curv(const vec &old_u, const vec &old_v,
 // Compute principal curvatures and directions.
 void TriMesh::need_curvatures()
 {
-	if (curv1.size() == vertices.size())
+	if (curv1.size() == vertices.size() && current(curvatures_gen))
 		return;
 	need_faces();
 	need_normals();
@@ -156,6 +156,10 @@ void TriMesh::need_curvatures()
 	pdir1.clear(); pdir1.resize(nv); pdir2.clear(); pdir2.resize(nv);
 	vector<float> curv12(nv);
 
+	// Contributions of each corner to curv1, curv12, and curv2 of its
+	// vertex, summed once all faces are done
+	vector<vec> corner_curv(3 * nf);
+
 	// Set up an initial coordinate system per vertex
 	for (int i = 0; i < nf; i++) {
 		pdir1[faces[i][0]] = vertices[faces[i][1]] -
@@ -226,12 +230,18 @@ void TriMesh::need_curvatures()
 			proj_curv(t, b, m[0], m[1], m[2],
 			          pdir1[vj], pdir2[vj], c1, c12, c2);
 			float wt = cornerareas[i][j] / pointareas[vj];
-#pragma omp atomic
-			curv1[vj]  += wt * c1;
-#pragma omp atomic
-			curv12[vj] += wt * c12;
-#pragma omp atomic
-			curv2[vj]  += wt * c2;
+			corner_curv[3 * i + j] = vec(wt * c1, wt * c12, wt * c2);
+		}
+	}
+	if (nf) {
+		vector<vec> vert_curv(nv);
+		sum_corners(&corner_curv[0], &vert_curv[0]);
+		clear_and_release(corner_curv);
+#pragma omp parallel for
+		for (int i = 0; i < nv; i++) {
+			curv1[i]  = vert_curv[i][0];
+			curv12[i] = vert_curv[i][1];
+			curv2[i]  = vert_curv[i][2];
 		}
 	}
 
@@ -243,6 +253,7 @@ void TriMesh::need_curvatures()
 		                 normals[i], pdir1[i], pdir2[i],
 		                 curv1[i], curv2[i]);
 	}
+	curvatures_gen = geometry_gen;
 	dprintf("Done.\n");
 }
 
@@ -250,7 +261,7 @@ void TriMesh::need_curvatures()
 // Compute derivatives of curvature.
 void TriMesh::need_dcurv()
 {
-	if (dcurv.size() == vertices.size())
+	if (dcurv.size() == vertices.size() && current(dcurv_gen))
 		return;
 	need_curvatures();
 
@@ -259,6 +270,7 @@ void TriMesh::need_dcurv()
 	// Resize the arrays we'll be using
 	int nv = vertices.size(), nf = faces.size();
 	dcurv.clear(); dcurv.resize(nv);
+	vector< Vec<4,float> > corner_dcurv(3 * nf);
 
 	// Compute dcurv per-face
 #pragma omp parallel for
@@ -328,9 +340,12 @@ void TriMesh::need_dcurv()
 			proj_dcurv(t, b, face_dcurv,
 			           pdir1[vj], pdir2[vj], this_vert_dcurv);
 			float wt = cornerareas[i][j] / pointareas[vj];
-			dcurv[vj] += wt * this_vert_dcurv;
+			corner_dcurv[3 * i + j] = wt * this_vert_dcurv;
 		}
 	}
+	if (nf)
+		sum_corners(&corner_dcurv[0], &dcurv[0]);
+	dcurv_gen = geometry_gen;
 
 	dprintf("Done.\n");
 }
@@ -8,102 +8,281 @@ Code for dealing with range grids
 
 #include "TriMesh.h"
 #include "TriMesh_algo.h"
+#include <algorithm>
+using namespace std;
 
 
 namespace trimesh {
 
-// Helper function - make a face with the 3 given vertices from the grid
-static inline void mkface(TriMesh *mesh, int v1, int v2, int v3)
+// The faces that a grid quad may be split into.  With all four corners
+// valid the quad becomes either QUAD_A0 and QUAD_A1 or QUAD_B0 and QUAD_B1;
+// with three valid corners it becomes the one of these that avoids the
+// invalid corner.
+enum {
+	QUAD_A0 = 1, // ll, lr, ur
+	QUAD_A1 = 2, // ll, ur, ul
+	QUAD_B0 = 4, // ll, lr, ul
+	QUAD_B1 = 8  // lr, ur, ul
+};
+
+
+// Number of faces in a mask of QUAD_* values
+static inline int num_quad_faces(int mask)
+{
+	return ((mask & QUAD_A0) != 0) + ((mask & QUAD_A1) != 0) +
+	       ((mask & QUAD_B0) != 0) + ((mask & QUAD_B1) != 0);
+}
+
+
+// Is the face long and skinny?  Same test as remove_sliver_faces().
+static inline bool is_sliver(const point &v0, const point &v1,
+	const point &v2, float l2thresh)
+{
+	const float cos2thresh = 0.85f;
+	float d01 = dist2(v0, v1);
+	float d12 = dist2(v1, v2);
+	float d20 = dist2(v2, v0);
+	if (d01 < l2thresh && d12 < l2thresh && d20 < l2thresh)
+		return false;
+	// c2 is square of cosine of smallest angle
+	float m = min(min(d01,d12),d20);
+	float c2 = sqr(d01+d12+d20-2.0f*m) * m/(4.0f*d01*d12*d20);
+	return c2 >= cos2thresh;
+}
+
+
+// Decide which faces to make for the grid quad with lower-left corner ll.
+// Returns a mask of QUAD_* values.
+static inline int quad_faces(const TriMesh *mesh, int ll)
+{
+	const vector<int> &grid = mesh->grid;
+	int lr = ll + 1;
+	int ul = ll + mesh->grid_width;
+	int ur = ul + 1;
+	bool ll_ok = mesh->grid_valid(ll), lr_ok = mesh->grid_valid(lr);
+	bool ul_ok = mesh->grid_valid(ul), ur_ok = mesh->grid_valid(ur);
+	int nvalid = ll_ok + lr_ok + ul_ok + ur_ok;
+	if (nvalid < 3)
+		return 0;
+
+	if (nvalid == 4) {
+		// Triangulate in the direction that
+		// gives the shorter diagonal
+		float ll_ur = dist2(mesh->vertices[grid[ll]],
+		                    mesh->vertices[grid[ur]]);
+		float lr_ul = dist2(mesh->vertices[grid[lr]],
+		                    mesh->vertices[grid[ul]]);
+		if (ll_ur < lr_ul)
+			return QUAD_A0 | QUAD_A1;
+		else
+			return QUAD_B0 | QUAD_B1;
+	} else if (!ll_ok) {
+		return QUAD_B1;
+	} else if (!lr_ok) {
+		return QUAD_A1;
+	} else if (!ul_ok) {
+		return QUAD_A0;
+	} else {
+		return QUAD_B0;
+	}
+}
+
+
+// The k-th face (in the order of the QUAD_* values) of the grid quad with
+// lower-left corner ll, given its mask
+static inline TriMesh::Face quad_face(const TriMesh *mesh, int ll,
+	int mask, int k)
+{
+	const vector<int> &grid = mesh->grid;
+	int ll_v = grid[ll], lr_v = grid[ll + 1];
+	int ul_v = grid[ll + mesh->grid_width];
+	int ur_v = grid[ll + mesh->grid_width + 1];
+	if ((mask & QUAD_A0) && !k--)
+		return TriMesh::Face(ll_v, lr_v, ur_v);
+	if ((mask & QUAD_A1) && !k--)
+		return TriMesh::Face(ll_v, ur_v, ul_v);
+	if ((mask & QUAD_B0) && !k--)
+		return TriMesh::Face(ll_v, lr_v, ul_v);
+	return TriMesh::Face(lr_v, ur_v, ul_v);
+}
+
+
+// Drop the long, skinny faces from the mask of the quad at ll
+static inline int remove_quad_slivers(const TriMesh *mesh, int ll,
+	int mask, float l2thresh)
+{
+	int keep = mask;
+	for (int k = 0, bit = QUAD_A0; bit <= QUAD_B1; bit <<= 1) {
+		if (!(mask & bit))
+			continue;
+		TriMesh::Face f = quad_face(mesh, ll, mask, k++);
+		if (is_sliver(mesh->vertices[f[0]], mesh->vertices[f[1]],
+		              mesh->vertices[f[2]], l2thresh))
+			keep &= ~bit;
+	}
+	return keep;
+}
+
+
+// Sliver threshold used by remove_sliver_faces(), computed for the
+// untrimmed triangulation without building it.  This samples the faces
+// exactly as feature_size() would if the new faces (described by masks,
+// with row j starting at face rowstart[j]) had been appended to the mesh.
+static float sliver_threshold(const TriMesh *mesh,
+	const vector<unsigned char> &masks, const vector<int> &rowstart)
 {
-	mesh->faces.push_back(TriMesh::Face(
-		mesh->grid[v1], mesh->grid[v2], mesh->grid[v3]));
+	const int nsamples = 999;
+	int ncols = mesh->grid_width - 1;
+	int nrows = int(rowstart.size()) - 1;
+	int old_nfaces = rowstart[0], nf = rowstart[nrows];
+	vector<float> samples;
+	samples.reserve(nsamples);
+
+	xorshift_rnd(0);
+	bool sample = (nf > nsamples / 3);
+	int ind = 0;
+	while (sample ? int(samples.size()) < nsamples : ind < nf) {
+		if (sample)
+			ind = uniform_rnd(nf);
+		TriMesh::Face f;
+		if (ind < old_nfaces) {
+			f = mesh->faces[ind];
+		} else {
+			// Find the row, then the quad within the row
+			int j = int(upper_bound(rowstart.begin(),
+				rowstart.end(), ind) - rowstart.begin()) - 1;
+			int k = ind - rowstart[j];
+			const unsigned char *rowmasks = &masks[j * ncols];
+			int i = 0;
+			while (k >= num_quad_faces(rowmasks[i]))
+				k -= num_quad_faces(rowmasks[i++]);
+			f = quad_face(mesh, i + j * mesh->grid_width,
+				rowmasks[i], k);
+		}
+		const point &p0 = mesh->vertices[f[0]];
+		const point &p1 = mesh->vertices[f[1]];
+		const point &p2 = mesh->vertices[f[2]];
+		samples.push_back(dist2(p0,p1));
+		samples.push_back(dist2(p1,p2));
+		samples.push_back(dist2(p2,p0));
+		ind++;
+	}
+
+	nth_element(samples.begin(),
+	            samples.begin() + samples.size()/2,
+	            samples.end());
+	return sqr(4.0f * sqrt(samples[samples.size()/2]));
 }
 
 
-// Triangulate a range grid
+// Decide on the faces for each quad of the grid (masks, row-major), and
+// where each row's faces would start if appended to the mesh (rowstart,
+// with one more entry than there are rows).  Only cells that pass
+// grid_valid() are used.
+static void plan_quads(const TriMesh *mesh, vector<unsigned char> &masks,
+	vector<int> &rowstart)
+{
+	int nrows = max(mesh->grid_height - 1, 0);
+	int ncols = max(mesh->grid_width - 1, 0);
+	masks.assign(nrows * ncols, 0);
+	rowstart.assign(nrows + 1, 0);
+#pragma omp parallel for
+	for (int j = 0; j < nrows; j++) {
+		int n = 0;
+		for (int i = 0; i < ncols; i++) {
+			int mask = quad_faces(mesh, i + j * mesh->grid_width);
+			n += num_quad_faces(mask);
+			masks[i + j * ncols] = mask;
+		}
+		rowstart[j+1] = n;
+	}
+
+	rowstart[0] = mesh->faces.size();
+	for (int j = 0; j < nrows; j++)
+		rowstart[j+1] += rowstart[j];
+}
+
+
+// The squared edge length past which triangulate_grid() looks for slivers
+float TriMesh::grid_sliver_threshold() const
+{
+	if (grid.empty())
+		return 0.0f;
+	vector<unsigned char> masks;
+	vector<int> rowstart;
+	plan_quads(this, masks, rowstart);
+	if (rowstart.back() == rowstart[0])
+		return 0.0f;
+	return sliver_threshold(this, masks, rowstart);
+}
+
+
+// Triangulate a range grid.  Rows are triangulated in parallel: each
+// row's faces are counted, then written directly into place.  Long,
+// skinny faces are dropped along the way if remove_slivers is true,
+// using the same threshold as remove_sliver_faces() would on the full
+// triangulation.
 void TriMesh::triangulate_grid(bool remove_slivers /* = true */)
 {
 	dprintf("Triangulating... ");
 
-	int nv = vertices.size();
 	int ngrid = grid_width * grid_height;
 
 	// Work around broken files that have a vertex position of (0,0,0)
 	// but mark the vertex as valid, or random broken grid indices
+#pragma omp parallel for
 	for (int i = 0; i < ngrid; i++) {
-		if (grid[i] >= 0) {
-			if (grid[i] >= nv)
-				grid[i] = GRID_INVALID;
-			else if (!vertices[grid[i]])
-				grid[i] = GRID_INVALID;
-		} else { // Handle negative or NaN
+		if (!grid_valid(i))
 			grid[i] = GRID_INVALID;
-		}
 	}
 
-	// Count valid faces
-	int ntris = 0;
-	for (int j = 0; j < grid_height - 1; j++) {
-		for (int i = 0; i < grid_width - 1; i++) {
-			int ll = i + j * grid_width;
-			int lr = ll + 1;
-			int ul = ll + grid_width;
-			int ur = ul + 1;
-			int nvalid = (grid[ll] >= 0) + (grid[lr] >= 0) +
-			             (grid[ul] >= 0) + (grid[ur] >= 0);
-			if (nvalid == 4)
-				ntris += 2;
-			else if (nvalid == 3)
-				ntris += 1;
+	// Decide on the faces for each quad, and count them by row
+	int nrows = max(grid_height - 1, 0), ncols = max(grid_width - 1, 0);
+	vector<unsigned char> masks;
+	vector<int> rowstart;
+	plan_quads(this, masks, rowstart);
+	int old_nfaces = faces.size();
+	int ntris = rowstart[nrows] - old_nfaces;
+
+	// Drop slivers, and count the remaining faces again
+	int nslivers = 0;
+	if (remove_slivers && ntris) {
+		float l2thresh = sliver_threshold(this, masks, rowstart);
+#pragma omp parallel for
+		for (int j = 0; j < nrows; j++) {
+			int n = 0;
+			for (int i = 0; i < ncols; i++) {
+				unsigned char &mask = masks[i + j * ncols];
+				if (!mask)
+					continue;
+				mask = remove_quad_slivers(this,
+					i + j * grid_width, mask, l2thresh);
+				n += num_quad_faces(mask);
+			}
+			rowstart[j+1] = n;
 		}
+		for (int j = 0; j < nrows; j++)
+			rowstart[j+1] += rowstart[j];
+		nslivers = old_nfaces + ntris - rowstart[nrows];
 	}
 
-	// Actually make the faces
-	int old_nfaces = faces.size();
-	int new_nfaces = old_nfaces + ntris;
-	faces.reserve(new_nfaces);
-
-	for (int j = 0; j < grid_height - 1; j++) {
-		for (int i = 0; i < grid_width - 1; i++) {
-			int ll = i + j * grid_width;
-			int lr = ll + 1;
-			int ul = ll + grid_width;
-			int ur = ul + 1;
-			int nvalid = (grid[ll] >= 0) + (grid[lr] >= 0) +
-			             (grid[ul] >= 0) + (grid[ur] >= 0);
-			if (nvalid < 3)
-				continue;
-			if (nvalid == 4) {
-				// Triangulate in the direction that
-				// gives the shorter diagonal
-				float ll_ur = dist2(vertices[grid[ll]],
-				                    vertices[grid[ur]]);
-				float lr_ul = dist2(vertices[grid[lr]],
-				                    vertices[grid[ul]]);
-				if (ll_ur < lr_ul) {
-					mkface(this, ll, lr, ur);
-					mkface(this, ll, ur, ul);
-				} else {
-					mkface(this, ll, lr, ul);
-					mkface(this, lr, ur, ul);
-				}
-				continue;
-			}
-			// nvalid == 3
-			if (grid[ll] < 0)
-				mkface(this, lr, ur, ul);
-			else if (grid[lr] < 0)
-				mkface(this, ll, ur, ul);
-			else if (grid[ul] < 0)
-				mkface(this, ll, lr, ur);
-			else
-				mkface(this, ll, lr, ul);
+	// Actually make the faces, each row starting at its own offset
+	faces.resize(rowstart[nrows]);
+#pragma omp parallel for
+	for (int j = 0; j < nrows; j++) {
+		int f = rowstart[j];
+		for (int i = 0; i < ncols; i++) {
+			int mask = masks[i + j * ncols];
+			int n = num_quad_faces(mask);
+			for (int k = 0; k < n; k++)
+				faces[f++] = quad_face(this,
+					i + j * grid_width, mask, k);
 		}
 	}
 
-	dprintf("%lu faces.\n", ntris);
-	if (!faces.empty() && remove_slivers)
-		remove_sliver_faces(this);
+	dprintf("%d faces.\n", ntris);
+	if (nslivers)
+		dprintf("  %d sliver faces removed.\n", nslivers);
 	dprintf("  ");
 }
 
@@ -4,17 +4,43 @@ Princeton University
 
 TriMesh_io.cc
 Input and output of triangle meshes
-Can read: PLY (triangle mesh, range grid), OFF, OBJ, RAY, SM, 3DS, VVD, STL, PTS
-Can write: PLY (triangle mesh, range grid), OFF, OBJ, RAY, SM, STL, PTS, C++, DAE
+Can read: PLY (triangle mesh, range grid), OFF, OBJ, RAY, SM, 3DS, VVD, STL, PTS, RGRID
+Can write: PLY (triangle mesh, range grid), OFF, OBJ, RAY, SM, STL, PTS, C++, DAE, RGRID
 */
 
 #include "TriMesh.h"
+#include "TriMesh_algo.h"
+#include "DepthMap.h"
+#include "GridCodec.h"
 #include "endianutil.h"
 
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <cerrno>
 #include <cctype>
+#include <climits>
 #include <cstdarg>
+#include <algorithm>
+#ifndef _WIN32
+# include <sys/mman.h>
+# include <sys/stat.h>
+# define HAVE_MMAP
+#endif
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+#if __cplusplus >= 201703L && defined(__has_include)
+# if __has_include(<charconv>)
+#  include <charconv>
+#  ifdef __cpp_lib_to_chars
+#   define HAVE_FROM_CHARS
+#  endif
+# endif
+#endif
 using namespace std;
 
 #define dprintf TriMesh::dprintf
@@ -34,7 +60,14 @@ using namespace std;
 namespace trimesh {
 
 // Forward declarations
-static bool read_ply(FILE *f, TriMesh *mesh);
+// The part of a range grid to read: x0 <= x < x1, y0 <= y < y1
+struct GridWindow {
+	int x0, y0, x1, y1;
+};
+
+static bool read_file(const char *filename, TriMesh *mesh,
+	const GridWindow *window);
+static bool read_ply(FILE *f, TriMesh *mesh, const GridWindow *window = NULL);
 static bool read_3ds(FILE *f, TriMesh *mesh);
 static bool read_vvd(FILE *f, TriMesh *mesh);
 static bool read_ray(FILE *f, TriMesh *mesh);
@@ -61,6 +94,40 @@ static bool read_strips_asc(FILE *f, TriMesh *mesh);
 static bool read_grid_bin(FILE *f, TriMesh *mesh, bool need_swap);
 static bool read_grid_asc(FILE *f, TriMesh *mesh);
 
+// A read-only mapping of a whole file into memory, if it is a regular file
+// and the system supports it.  data is NULL otherwise.
+struct MappedFile {
+	const unsigned char *data;
+	size_t len;
+	explicit MappedFile(FILE *f);
+	~MappedFile();
+private:
+	MappedFile(const MappedFile &);
+	MappedFile &operator = (const MappedFile &);
+};
+static bool map_verts_bin(const MappedFile &m, FILE *f, TriMesh *mesh,
+	bool &need_swap, int nverts, int vert_len, int vert_pos,
+	int vert_norm, int vert_color, bool float_color, int vert_conf);
+static bool map_faces_bin(const MappedFile &m, FILE *f, TriMesh *mesh,
+	bool need_swap, int nfaces, int face_len, int face_count,
+	int face_idx);
+static bool map_grid_bin(const MappedFile &m, FILE *f, TriMesh *mesh,
+	bool need_swap);
+static bool map_window_bin(const MappedFile &m, FILE *f, TriMesh *mesh,
+	bool &need_swap, int nverts, int vert_len, int vert_pos,
+	int vert_norm, int vert_color, bool float_color, int vert_conf,
+	int skip2, const GridWindow &window);
+static bool crop_grid(TriMesh *mesh, const GridWindow &window);
+static bool map_verts_asc(const MappedFile &m, FILE *f, TriMesh *mesh,
+	int nverts, int vert_len, int vert_pos, int vert_norm,
+	int vert_color, bool float_color, int vert_conf);
+static bool map_faces_asc(const MappedFile &m, FILE *f, TriMesh *mesh,
+	int nfaces, int face_len, int face_count, int face_idx,
+	bool read_to_eol = false);
+static bool map_obj(const MappedFile &m, FILE *f, TriMesh *mesh, bool &ok);
+static bool map_pts(const MappedFile &m, FILE *f, TriMesh *mesh);
+static bool read_rgrid(FILE *f, TriMesh *mesh);
+
 static int ply_type_len(const char *buf, bool binary);
 static bool ply_property(const char *buf, int &len, bool binary);
 static void check_need_swap(const point &p, bool &need_swap);
@@ -79,6 +146,9 @@ static bool write_off(TriMesh *mesh, FILE *f);
 static bool write_sm(TriMesh *mesh, FILE *f);
 static bool write_stl(TriMesh *mesh, FILE *f);
 static bool write_pts(TriMesh *mesh, FILE *f);
+static bool write_rgrid(TriMesh *mesh, FILE *f, bool pack);
+static bool write_depth(TriMesh *mesh, FILE *f, const char *filename,
+	bool write_norm);
 static bool write_cc(TriMesh *mesh, FILE *f, const char *filename,
 	bool write_norm, bool float_color);
 static bool write_dae(TriMesh *mesh, FILE *f);
@@ -120,6 +190,12 @@ TriMesh *TriMesh::read(const ::std::string &filename)
 	return read(filename.c_str());
 }
 
+TriMesh *TriMesh::read_window(const ::std::string &filename,
+	int x0, int y0, int x1, int y1)
+{
+	return read_window(filename.c_str(), x0, y0, x1, y1);
+}
+
 bool TriMesh::write(const ::std::string &filename)
 {
 	return write(filename.c_str());
@@ -140,17 +216,40 @@ TriMesh *TriMesh::read(const char *filename)
 }
 
 
-// Actually read a mesh.  Tries to figure out type of file from first
-// few bytes.  Filename can be "-" for stdin.
-// STL and PTS don't have magic numbers, so we recognize file.stl and stl:-
-// (and same for pts) constructions.
+// Read part of a range grid from a file
+TriMesh *TriMesh::read_window(const char *filename,
+	int x0, int y0, int x1, int y1)
+{
+	TriMesh *mesh = new TriMesh();
+	GridWindow window = { x0, y0, x1, y1 };
+
+	if (read_file(filename, mesh, &window))
+		return mesh;
+
+	delete mesh;
+	return NULL;
+}
+
+
+// Actually read a mesh.
 bool TriMesh::read_helper(const char *filename, TriMesh *mesh)
+{
+	return read_file(filename, mesh, NULL);
+}
+
+
+// Tries to figure out type of file from first few bytes.  Filename can
+// be "-" for stdin.  STL and PTS don't have magic numbers, so we recognize
+// file.stl and stl:- (and same for pts) constructions.  If window is
+// given, keeps only that part of the range grid.
+static bool read_file(const char *filename, TriMesh *mesh,
+	const GridWindow *window)
 {
 	if (!filename || *filename == '\0')
 		return false;
 
 	FILE *f = NULL;
-	bool ok = false;
+	bool ok = false, cropped = false;
 	int c;
 
 	if (strcmp(filename, "-") == 0) {
@@ -195,8 +294,10 @@ bool TriMesh::read_helper(const char *filename, TriMesh *mesh)
 			eprintf("Can't read header.\n");
 			goto out;
 		}
-		if (strncmp(buf, "ly", 2) == 0)
-			ok = read_ply(f, mesh);
+		if (strncmp(buf, "ly", 2) == 0) {
+			ok = read_ply(f, mesh, window);
+			cropped = true;
+		}
 	} else if (c == 0x4d) {
 		int c2 = fgetc(f);
 		ungetc(c2, f);
@@ -238,6 +339,10 @@ bool TriMesh::read_helper(const char *filename, TriMesh *mesh)
 		}
 		if (strncmp(buf, "FF", 2) == 0)
 			ok = read_off(f, mesh);
+	} else if (c == 'R') {
+		// Assume an rgrid file
+		ungetc(c, f);
+		ok = read_rgrid(f, mesh);
 	} else if (isdigit(c)) {
 		// Assume an old-style sm file
 		ungetc(c, f);
@@ -249,6 +354,8 @@ bool TriMesh::read_helper(const char *filename, TriMesh *mesh)
 out:
 	if (f)
 		fclose(f);
+	if (ok && window && !cropped)
+		ok = crop_grid(mesh, *window);
 	if (!ok) {
 		eprintf("Error reading file [%s].\n", filename);
 		return false;
@@ -260,8 +367,241 @@ out:
 }
 
 
-// Read a ply file
-static bool read_ply(FILE *f, TriMesh *mesh)
+// Map f into memory
+MappedFile::MappedFile(FILE *f) : data(NULL), len(0)
+{
+#ifdef HAVE_MMAP
+	struct stat st;
+	int fd = f ? fileno(f) : -1;
+	if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+	    st.st_size <= 0)
+		return;
+	void *p = mmap(NULL, size_t(st.st_size), PROT_READ, MAP_PRIVATE,
+		fd, 0);
+	if (p == MAP_FAILED)
+		return;
+#ifdef MADV_SEQUENTIAL
+	madvise(p, size_t(st.st_size), MADV_SEQUENTIAL);
+#endif
+	data = (const unsigned char *) p;
+	len = size_t(st.st_size);
+#else
+	(void) f;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef HAVE_MMAP
+	if (data)
+		munmap((void *) data, len);
+#endif
+}
+
+
+// The current position of f within the mapping, and the end of the
+// mapping.  Returns false if f's position is unknown.
+static bool mapped_range(const MappedFile &m, FILE *f,
+	const unsigned char *&p, const unsigned char *&end)
+{
+	long pos = ftell(f);
+	if (pos < 0 || size_t(pos) > m.len)
+		return false;
+	p = m.data + pos;
+	end = m.data + m.len;
+	return true;
+}
+
+static bool mapped_range(const MappedFile &m, FILE *f,
+	const char *&p, const char *&end)
+{
+	return mapped_range(m, f, (const unsigned char *&) p,
+		(const unsigned char *&) end);
+}
+
+// Leave f positioned at p, after reading from the mapping
+static bool mapped_seek(const MappedFile &m, FILE *f, const void *p)
+{
+	return fseek(f, long((const unsigned char *) p - m.data), SEEK_SET) == 0;
+}
+
+
+// Number of threads available to parallel loops
+static inline int num_threads()
+{
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+// Whitespace, as understood by scanf
+static inline bool is_space(char c)
+{
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// The start of the line after the one containing p, or end
+static inline const char *next_line(const char *p, const char *end)
+{
+	const char *nl = (const char *) memchr(p, '\n', size_t(end - p));
+	return nl ? nl + 1 : end;
+}
+
+
+// Reads words and numbers from text in memory, the way fscanf would read
+// them from a file
+class AscScanner {
+	const char *p, *end;
+
+	// Copy the word at p into buf, for strtof and strtol
+	size_t copy_word(char *buf, size_t size) const
+	{
+		size_t n = 0;
+		while (p + n != end && n < size - 1 && !is_space(p[n])) {
+			buf[n] = p[n];
+			n++;
+		}
+		buf[n] = '\0';
+		return n;
+	}
+
+public:
+	AscScanner(const char *p_, const char *end_) : p(p_), end(end_)
+		{}
+	const char *pos() const { return p; }
+
+	void skip_space()
+	{
+		while (p != end && is_space(*p))
+			p++;
+	}
+	bool at_end()
+	{
+		skip_space();
+		return p == end;
+	}
+	void skip_line()
+	{
+		p = next_line(p, end);
+	}
+
+	// Skip a word, as fscanf(" %s")
+	bool word()
+	{
+		skip_space();
+		if (p == end)
+			return false;
+		while (p != end && !is_space(*p))
+			p++;
+		return true;
+	}
+
+	// Read a number, as fscanf(" %f") or fscanf(" %d").  from_chars
+	// handles the common cases, and anything it does not accept (a
+	// leading '+', hex, inf and nan, or out-of-range values) goes
+	// through the C library.
+	bool get(float &x)
+	{
+		skip_space();
+#ifdef HAVE_FROM_CHARS
+		const char *q = (p != end && *p == '+') ? p + 1 : p;
+		const char *d = (q == p && q != end && *q == '-') ? q + 1 : q;
+		if (d != end && (isdigit((unsigned char) *d) || *d == '.') &&
+		    !(*d == '0' && d + 1 != end && (d[1] == 'x' || d[1] == 'X'))) {
+			std::from_chars_result r = std::from_chars(q, end, x);
+			if (r.ec == std::errc()) {
+				p = r.ptr;
+				return true;
+			}
+		}
+#endif
+		char buf[128], *e;
+		if (!copy_word(buf, sizeof(buf)))
+			return false;
+		x = strtof(buf, &e);
+		if (e == buf)
+			return false;
+		p += e - buf;
+		return true;
+	}
+	bool get(int &x)
+	{
+		skip_space();
+#ifdef HAVE_FROM_CHARS
+		const char *q = (p != end && *p == '+') ? p + 1 : p;
+		if (q != end && (isdigit((unsigned char) *q) ||
+		                 (q == p && *q == '-'))) {
+			std::from_chars_result r = std::from_chars(q, end, x);
+			if (r.ec == std::errc()) {
+				p = r.ptr;
+				return true;
+			}
+		}
+#endif
+		char buf[128], *e;
+		if (!copy_word(buf, sizeof(buf)))
+			return false;
+		x = int(strtol(buf, &e, 10));
+		if (e == buf)
+			return false;
+		p += e - buf;
+		return true;
+	}
+};
+
+
+// Number of pieces into which to split n records (or bytes), so that
+// each thread gets at least min_chunk of them.  Returns 1 if the data is
+// not worth splitting.
+static inline int num_chunks(size_t n, size_t min_chunk)
+{
+	return int(max(size_t(1), min(size_t(num_threads()), n / min_chunk)));
+}
+
+// Split the first nlines lines starting at p into nchunks runs of lines.
+// bounds gets the start of each run, followed by the end of the last one.
+// Returns false if there are fewer than nlines lines before end.
+static bool split_lines(const char *p, const char *end, int nlines,
+	int nchunks, vector<const char *> &bounds)
+{
+	bounds.resize(nchunks + 1);
+	bounds[0] = p;
+	int line = 0;
+	for (int k = 1; k <= nchunks; k++) {
+		int target = int((long long) nlines * k / nchunks);
+		for ( ; line < target; line++) {
+			if (p == end)
+				return false;
+			p = next_line(p, end);
+		}
+		bounds[k] = p;
+	}
+	return true;
+}
+
+// Split [p, end) into nchunks pieces of about the same size, starting at
+// the beginnings of lines.
+static void split_bytes(const char *p, const char *end, int nchunks,
+	vector<const char *> &bounds)
+{
+	bounds.resize(nchunks + 1);
+	bounds[0] = p;
+	for (int k = 1; k < nchunks; k++) {
+		const char *q = p + (end - p) * (long long) k / nchunks;
+		if (q < bounds[k-1])
+			q = bounds[k-1];
+		else if (q != p && q[-1] != '\n')
+			q = next_line(q, end);
+		bounds[k] = q;
+	}
+	bounds[nchunks] = end;
+}
+
+
+// Read a ply file, or the given window of its range grid
+static bool read_ply(FILE *f, TriMesh *mesh, const GridWindow *window)
 {
 	char buf[1024];
 	bool binary = false, need_swap = false, float_color = false;
@@ -421,7 +761,9 @@ static bool read_ply(FILE *f, TriMesh *mesh)
 		eprintf("Warning: possibly corrupt file. (Transferred as ASCII instead of BINARY?)\n");
 	}
 
-	// Actually read everything in
+	// Actually read everything in, straight from a memory mapping of
+	// the file if possible.
+	MappedFile m(f);
 	if (skip1) {
 		if (binary)
 			fseek(f, skip1, SEEK_CUR);
@@ -429,11 +771,25 @@ static bool read_ply(FILE *f, TriMesh *mesh)
 			for (int i = 0; i < skip1; i++)
 				GET_WORD();
 	}
-	if (binary) {
+	if (window && binary && ngrid && m.data)
+		return map_window_bin(m, f, mesh, need_swap, nverts, vert_len,
+		                      vert_pos, vert_norm, vert_color,
+		                      float_color, vert_conf, skip2, *window);
+	if (binary && m.data) {
+		if (!map_verts_bin(m, f, mesh, need_swap, nverts, vert_len,
+		                   vert_pos, vert_norm, vert_color,
+		                   float_color, vert_conf))
+			return false;
+	} else if (binary) {
 		if (!read_verts_bin(f, mesh, need_swap, nverts, vert_len,
 		                    vert_pos, vert_norm, vert_color,
 		                    float_color, vert_conf))
 			return false;
+	} else if (m.data) {
+		if (!map_verts_asc(m, f, mesh, nverts, vert_len,
+		                   vert_pos, vert_norm, vert_color,
+		                   float_color, vert_conf))
+			return false;
 	} else {
 		if (!read_verts_asc(f, mesh, nverts, vert_len,
 		                    vert_pos, vert_norm, vert_color,
@@ -450,7 +806,10 @@ static bool read_ply(FILE *f, TriMesh *mesh)
 	}
 
 	if (ngrid) {
-		if (binary) {
+		if (binary && m.data) {
+			if (!map_grid_bin(m, f, mesh, need_swap))
+				return false;
+		} else if (binary) {
 			if (!read_grid_bin(f, mesh, need_swap))
 				return false;
 		} else {
@@ -467,10 +826,18 @@ static bool read_ply(FILE *f, TriMesh *mesh)
 		}
 		mesh->convert_strips(TriMesh::TSTRIP_LENGTH);
 	} else if (nfaces) {
-		if (binary) {
+		if (binary && m.data) {
+			if (!map_faces_bin(m, f, mesh, need_swap, nfaces,
+			                   face_len, face_count, face_idx))
+				return false;
+		} else if (binary) {
 			if (!read_faces_bin(f, mesh, need_swap, nfaces,
 			                    face_len, face_count, face_idx))
 				return false;
+		} else if (m.data) {
+			if (!map_faces_asc(m, f, mesh, nfaces,
+			                   face_len, face_count, face_idx))
+				return false;
 		} else {
 			if (!read_faces_asc(f, mesh, nfaces,
 			                    face_len, face_count, face_idx))
@@ -478,6 +845,8 @@ static bool read_ply(FILE *f, TriMesh *mesh)
 		}
 	}
 
+	if (window)
+		return crop_grid(mesh, *window);
 	return true;
 }
 
@@ -657,6 +1026,11 @@ static bool read_ray(FILE *f, TriMesh *mesh)
 // Read an obj file
 static bool read_obj(FILE *f, TriMesh *mesh)
 {
+	MappedFile m(f);
+	bool ok = false;
+	if (m.data && map_obj(m, f, mesh, ok))
+		return ok;
+
 	vector<int> thisface;
 	while (1) {
 		skip_comments(f);
@@ -710,6 +1084,151 @@ static bool read_obj(FILE *f, TriMesh *mesh)
 }
 
 
+// Does the line [line, end) begin with text?
+static inline bool line_is(const char *line, const char *end,
+	const char *text)
+{
+	size_t n = strlen(text);
+	return size_t(end - line) >= n && !strncmp(line, text, n);
+}
+
+// A piece of an obj file, read by one thread
+struct ObjChunk {
+	vector<point> verts;
+	vector<vec> norms;
+	// For each face: the number of vertices before it in this piece,
+	// the number of indices, and the indices as written in the file
+	vector<int> faces;
+	vector<TriMesh::Face> tris;
+	bool ok, long_line;
+};
+
+// Parse the lines in [p, end) as in read_obj
+static void parse_obj_chunk(const char *p, const char *end, ObjChunk &c)
+{
+	c.ok = true;
+	c.long_line = false;
+	while (1) {
+		// Skip white space and comments, as skip_comments
+		while (p != end && (*p == '#' || is_space(*p)))
+			p = (*p == '#') ? next_line(p, end) : p + 1;
+		if (p == end)
+			break;
+		const char *line = p;
+		p = next_line(p, end);
+		if (p - line > 1023) {
+			// read_obj would split this line - let it
+			c.long_line = true;
+			return;
+		}
+		if (line_is(line, p, "v ") || line_is(line, p, "v\t")) {
+			AscScanner s(line + 1, p);
+			float x, y, z;
+			if (!s.get(x) || !s.get(y) || !s.get(z)) {
+				c.ok = false;
+				return;
+			}
+			c.verts.push_back(point(x,y,z));
+		} else if (line_is(line, p, "vn ") || line_is(line, p, "vn\t")) {
+			AscScanner s(line + 2, p);
+			float x, y, z;
+			if (!s.get(x) || !s.get(y) || !s.get(z)) {
+				c.ok = false;
+				return;
+			}
+			c.norms.push_back(vec(x,y,z));
+		} else if (line_is(line, p, "f ") || line_is(line, p, "f\t") ||
+		           line_is(line, p, "t ") || line_is(line, p, "t\t")) {
+			size_t start = c.faces.size();
+			c.faces.push_back(c.verts.size());
+			c.faces.push_back(0);
+			const char *w = line;
+			while (1) {
+				while (w != p && !is_space(*w))
+					w++;
+				while (w != p && is_space(*w))
+					w++;
+				AscScanner s(w, p);
+				int thisf;
+				if (!s.get(thisf))
+					break;
+				c.faces.push_back(thisf);
+			}
+			c.faces[start+1] = int(c.faces.size() - start - 2);
+		}
+	}
+}
+
+
+// Read an obj file from a mapping, with pieces of the file parsed by
+// separate threads.  Returns false (having changed nothing) if the file
+// has lines too long for read_obj to treat as single lines.  Otherwise,
+// ok says whether the file was read.
+static bool map_obj(const MappedFile &m, FILE *f, TriMesh *mesh, bool &ok)
+{
+	const char *p, *end;
+	if (!mapped_range(m, f, p, end))
+		return false;
+
+	int nchunks = num_chunks(size_t(end - p), 1 << 18);
+	vector<const char *> bounds;
+	split_bytes(p, end, nchunks, bounds);
+	vector<ObjChunk> chunks(nchunks);
+#pragma omp parallel for
+	for (int k = 0; k < nchunks; k++)
+		parse_obj_chunk(bounds[k], bounds[k+1], chunks[k]);
+
+	ok = true;
+	for (int k = 0; k < nchunks; k++) {
+		if (chunks[k].long_line)
+			return false;
+		ok = ok && chunks[k].ok;
+	}
+	if (!ok)
+		return true;
+
+	// Vertices and normals go in in order.  Then faces can be
+	// tessellated (which looks at vertex positions) in parallel.
+	vector<int> first_vert(nchunks);
+	for (int k = 0; k < nchunks; k++) {
+		first_vert[k] = mesh->vertices.size();
+		mesh->vertices.insert(mesh->vertices.end(),
+			chunks[k].verts.begin(), chunks[k].verts.end());
+		mesh->normals.insert(mesh->normals.end(),
+			chunks[k].norms.begin(), chunks[k].norms.end());
+	}
+
+#pragma omp parallel for
+	for (int k = 0; k < nchunks; k++) {
+		const vector<int> &faces = chunks[k].faces;
+		vector<int> thisface;
+		for (size_t i = 0; i < faces.size(); i += 2 + faces[i+1]) {
+			int nv = first_vert[k] + faces[i];
+			thisface.resize(faces[i+1]);
+			for (int j = 0; j < faces[i+1]; j++) {
+				int thisf = faces[i+2+j];
+				thisface[j] = (thisf < 0) ? thisf + nv : thisf - 1;
+			}
+			tess(mesh->vertices, thisface, chunks[k].tris);
+		}
+	}
+
+	size_t ntris = mesh->faces.size();
+	for (int k = 0; k < nchunks; k++)
+		ntris += chunks[k].tris.size();
+	mesh->faces.reserve(ntris);
+	for (int k = 0; k < nchunks; k++)
+		mesh->faces.insert(mesh->faces.end(),
+			chunks[k].tris.begin(), chunks[k].tris.end());
+
+	// As in read_obj
+	if (mesh->vertices.size() != mesh->normals.size())
+		mesh->normals.clear();
+
+	return true;
+}
+
+
 // Read an off file
 static bool read_off(FILE *f, TriMesh *mesh)
 {
@@ -719,10 +1238,18 @@ static bool read_off(FILE *f, TriMesh *mesh)
 	int nverts, nfaces, unused;
 	if (sscanf(buf, "%d %d %d", &nverts, &nfaces, &unused) < 2)
 		return false;
-	if (!read_verts_asc(f, mesh, nverts, 3, 0, -1, -1, false, -1))
-		return false;
-	if (!read_faces_asc(f, mesh, nfaces, 1, 0, 1, true))
-		return false;
+	MappedFile m(f);
+	if (m.data) {
+		if (!map_verts_asc(m, f, mesh, nverts, 3, 0, -1, -1, false, -1))
+			return false;
+		if (!map_faces_asc(m, f, mesh, nfaces, 1, 0, 1, true))
+			return false;
+	} else {
+		if (!read_verts_asc(f, mesh, nverts, 3, 0, -1, -1, false, -1))
+			return false;
+		if (!read_faces_asc(f, mesh, nfaces, 1, 0, 1, true))
+			return false;
+	}
 
 	return true;
 }
@@ -736,14 +1263,25 @@ static bool read_sm(FILE *f, TriMesh *mesh)
 	if (fscanf(f, "%d", &nverts) != 1)
 		return false;
 
-	if (!read_verts_asc(f, mesh, nverts, 3, 0, -1, -1, false, -1))
-		return false;
+	MappedFile m(f);
+	if (m.data) {
+		if (!map_verts_asc(m, f, mesh, nverts, 3, 0, -1, -1, false, -1))
+			return false;
+	} else {
+		if (!read_verts_asc(f, mesh, nverts, 3, 0, -1, -1, false, -1))
+			return false;
+	}
 
 	skip_comments(f);
 	if (fscanf(f, "%d", &nfaces) != 1)
 		return true;
-	if (!read_faces_asc(f, mesh, nfaces, 0, -1, 0))
-		return false;
+	if (m.data) {
+		if (!map_faces_asc(m, f, mesh, nfaces, 0, -1, 0))
+			return false;
+	} else {
+		if (!read_faces_asc(f, mesh, nfaces, 0, -1, 0))
+			return false;
+	}
 
 	return true;
 }
@@ -786,6 +1324,10 @@ static bool read_stl(FILE *f, TriMesh *mesh)
 // Read an ASCII file of points
 static bool read_pts(FILE *f, TriMesh *mesh)
 {
+	MappedFile m(f);
+	if (m.data && map_pts(m, f, mesh))
+		return true;
+
 	while (!feof(f)) {
 		char buf[1024];
 		if (!fgets(buf, 1024, f))
@@ -804,6 +1346,370 @@ static bool read_pts(FILE *f, TriMesh *mesh)
 }
 
 
+// A piece of a pts file, read by one thread
+struct PtsChunk {
+	vector<point> verts;
+	vector<vec> norms;
+	bool long_line;
+};
+
+// Parse the lines in [p, end) as in read_pts
+static void parse_pts_chunk(const char *p, const char *end, PtsChunk &c)
+{
+	c.long_line = false;
+	while (p != end) {
+		const char *line = p;
+		p = next_line(p, end);
+		if (p - line > 1023) {
+			c.long_line = true;
+			return;
+		}
+		AscScanner s(line, p);
+		float x[6];
+		int nparsed = 0;
+		while (nparsed < 6 && s.get(x[nparsed]))
+			nparsed++;
+		if (nparsed >= 3)
+			c.verts.push_back(point(x[0], x[1], x[2]));
+		if (nparsed == 6)
+			c.norms.push_back(vec(x[3], x[4], x[5]));
+	}
+}
+
+
+// Read a pts file from a mapping, with pieces of the file parsed by
+// separate threads.  Returns false (having changed nothing) if the file
+// has lines too long for read_pts to treat as single lines.
+static bool map_pts(const MappedFile &m, FILE *f, TriMesh *mesh)
+{
+	const char *p, *end;
+	if (!mapped_range(m, f, p, end))
+		return false;
+
+	int nchunks = num_chunks(size_t(end - p), 1 << 18);
+	vector<const char *> bounds;
+	split_bytes(p, end, nchunks, bounds);
+	vector<PtsChunk> chunks(nchunks);
+#pragma omp parallel for
+	for (int k = 0; k < nchunks; k++)
+		parse_pts_chunk(bounds[k], bounds[k+1], chunks[k]);
+
+	for (int k = 0; k < nchunks; k++)
+		if (chunks[k].long_line)
+			return false;
+	for (int k = 0; k < nchunks; k++) {
+		mesh->vertices.insert(mesh->vertices.end(),
+			chunks[k].verts.begin(), chunks[k].verts.end());
+		mesh->normals.insert(mesh->normals.end(),
+			chunks[k].norms.begin(), chunks[k].norms.end());
+	}
+	if (mesh->normals.size() != mesh->vertices.size())
+		mesh->normals.clear();
+	return true;
+}
+
+
+// The .rgrid range grid container.  Everything is little-endian, and each
+// section starts on a 64-byte boundary so that it can be used in place.
+//   Header (RGRID_HEADER bytes):
+//      0  char[8]  "RGRID01\n"
+//      8  uint32   flags (RGRID_NORMALS | RGRID_CONF | RGRID_COLORS |
+//                  RGRID_PACKED)
+//     12  int32    width
+//     16  int32    height
+//     20  uint32   tile_rows: the grid is cut into tiles of this many rows
+//     24  uint64   nverts
+//     32  uint64   offset of the validity mask: bit (i & 7) of byte i/8
+//                  is set if cell i (row-major) holds a vertex
+//     40  uint64   offset of the tile table: ntiles+1 uint64s giving the
+//                  index of the first vertex in each tile
+//     48  uint64   offset of positions: nverts x 3 float32
+//     56  uint64   offset of normals: nverts x 2 uint16, octahedral
+//     64  uint64   offset of confidences: nverts float32
+//     72  uint64   offset of colors: nverts x 3 uint8
+//     80  uint64   offset of the chunk table, if RGRID_PACKED
+//     88  reserved, zero
+// Vertices are in row-major order of the valid cells, so the tile table
+// gives the offset of each tile's chunk of every section.  If RGRID_PACKED
+// is set, each of those chunks is compressed separately by grid_encode,
+// and the chunk table holds, for each section present (in the order
+// above), ntiles+1 uint64 offsets of the chunks within the section.
+#define RGRID_MAGIC "RGRID01\n"
+#define RGRID_HEADER 128
+#define RGRID_ALIGN 64
+#define RGRID_TILE_ROWS 64
+enum { RGRID_NORMALS = 1, RGRID_CONF = 2, RGRID_COLORS = 4, RGRID_PACKED = 8 };
+enum { RGRID_SEC_POS, RGRID_SEC_NORM, RGRID_SEC_CONF, RGRID_SEC_COLOR,
+       RGRID_NSECTIONS };
+
+// Round up to the start of the next section
+static inline unsigned long long rgrid_align(unsigned long long x)
+{
+	return (x + RGRID_ALIGN - 1) & ~(unsigned long long) (RGRID_ALIGN - 1);
+}
+
+static inline unsigned get_le32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (unsigned(p[3]) << 24);
+}
+
+static inline unsigned long long get_le64(const unsigned char *p)
+{
+	return get_le32(p) | ((unsigned long long) get_le32(p + 4) << 32);
+}
+
+static inline void put_le32(unsigned char *p, unsigned x)
+{
+	p[0] = x & 0xff;  p[1] = (x >> 8) & 0xff;
+	p[2] = (x >> 16) & 0xff;  p[3] = x >> 24;
+}
+
+static inline void put_le64(unsigned char *p, unsigned long long x)
+{
+	put_le32(p, unsigned(x & 0xffffffffu));
+	put_le32(p + 4, unsigned(x >> 32));
+}
+
+
+// Octahedral encoding of a normal into 2 16-bit values
+static inline void oct_encode(const vec &n, unsigned short *q)
+{
+	float s = fabs(n[0]) + fabs(n[1]) + fabs(n[2]);
+	float u = 0.0f, v = 0.0f;
+	if (s > 0.0f) {
+		u = n[0] / s;
+		v = n[1] / s;
+		if (n[2] < 0.0f) {
+			float fu = (1.0f - fabs(v)) * (u < 0.0f ? -1.0f : 1.0f);
+			v = (1.0f - fabs(u)) * (v < 0.0f ? -1.0f : 1.0f);
+			u = fu;
+		}
+	}
+	q[0] = (unsigned short) (clamp(u, -1.0f, 1.0f) * 32767.5f + 32768.0f);
+	q[1] = (unsigned short) (clamp(v, -1.0f, 1.0f) * 32767.5f + 32768.0f);
+}
+
+static inline vec oct_decode(unsigned qu, unsigned qv)
+{
+	float u = qu * (2.0f / 65535.0f) - 1.0f;
+	float v = qv * (2.0f / 65535.0f) - 1.0f;
+	float w = 1.0f - fabs(u) - fabs(v);
+	if (w < 0.0f) {
+		float fu = (1.0f - fabs(v)) * (u < 0.0f ? -1.0f : 1.0f);
+		v = (1.0f - fabs(u)) * (v < 0.0f ? -1.0f : 1.0f);
+		u = fu;
+	}
+	return normalized(vec(u, v, w));
+}
+
+
+// Copy or decompress tile t's chunk of a section, holding n records of
+// ncomp components of csize bytes, starting at record first.  chunks is
+// the section's chunk table if it is compressed, or NULL.
+static bool rgrid_chunk(const unsigned char *section,
+	const unsigned long long *chunks, int t, size_t first, size_t n,
+	int ncomp, int csize, const int *cells, int width, int rows,
+	unsigned char *dst)
+{
+	if (!chunks) {
+		memcpy(dst, section + first * ncomp * csize, n * ncomp * csize);
+		return true;
+	}
+	return grid_decode(section + chunks[t], size_t(chunks[t+1] - chunks[t]),
+		n, ncomp, csize, cells, width, rows, int(first), dst);
+}
+
+
+// Read a .rgrid file, straight from a mapping if possible.  Each tile is
+// done by one thread: the grid is filled in from the mask, starting at
+// the tile's first vertex, and the tile's chunks of the other sections
+// are copied or decoded.
+static bool read_rgrid(FILE *f, TriMesh *mesh)
+{
+	MappedFile m(f);
+	const unsigned char *data = m.data;
+	size_t len = m.len;
+	vector<unsigned char> buf;
+	if (!data) {
+		// Not mappable: read it all
+		unsigned char tmp[1 << 16];
+		size_t n;
+		while ((n = fread(tmp, 1, sizeof(tmp), f)) > 0)
+			buf.insert(buf.end(), tmp, tmp + n);
+		data = buf.empty() ? NULL : &buf[0];
+		len = buf.size();
+	}
+	if (len < RGRID_HEADER || memcmp(data, RGRID_MAGIC, 8) != 0) {
+		eprintf("Not an rgrid file.\n");
+		return false;
+	}
+
+	unsigned flags = get_le32(data + 8);
+	int w = int(get_le32(data + 12)), h = int(get_le32(data + 16));
+	int tile_rows = int(get_le32(data + 20));
+	unsigned long long nverts = get_le64(data + 24);
+	unsigned long long mask_off = get_le64(data + 32);
+	unsigned long long tiles_off = get_le64(data + 40);
+	unsigned long long chunks_off = get_le64(data + 80);
+	if (w <= 0 || h <= 0 || tile_rows <= 0 ||
+	    (unsigned long long) w * h > (unsigned long long) INT_MAX ||
+	    nverts > (unsigned long long) w * h) {
+		eprintf("Bad rgrid header.\n");
+		return false;
+	}
+	size_t ngrid = size_t(w) * h;
+	int ntiles = (h - 1) / tile_rows + 1;
+	bool packed = (flags & RGRID_PACKED) != 0;
+
+	// The per-vertex sections: positions, normals, confidences, colors
+	static const int ncomp[RGRID_NSECTIONS] = { 3, 2, 1, 3 };
+	static const int csize[RGRID_NSECTIONS] = { 4, 2, 4, 1 };
+	bool used[RGRID_NSECTIONS] = { true, (flags & RGRID_NORMALS) != 0,
+		(flags & RGRID_CONF) != 0, (flags & RGRID_COLORS) != 0 };
+	unsigned long long sec_off[RGRID_NSECTIONS];
+	vector<unsigned long long> chunks[RGRID_NSECTIONS];
+	int nused = 0;
+	for (int s = 0; s < RGRID_NSECTIONS; s++) {
+		sec_off[s] = get_le64(data + 48 + 8 * s);
+		if (!used[s])
+			continue;
+		unsigned long long size = nverts * ncomp[s] * csize[s];
+		if (packed) {
+			// The size comes from the section's chunk table
+			unsigned long long table = chunks_off +
+				8ull * (ntiles + 1) * nused;
+			if (table > len || 8ull * (ntiles + 1) > len - table) {
+				eprintf("Truncated rgrid file.\n");
+				return false;
+			}
+			chunks[s].resize(ntiles + 1);
+			for (int t = 0; t <= ntiles; t++) {
+				chunks[s][t] = get_le64(data + table + 8 * t);
+				if ((t == 0 && chunks[s][t] != 0) ||
+				    (t > 0 && chunks[s][t] < chunks[s][t-1])) {
+					eprintf("Bad rgrid chunk table.\n");
+					return false;
+				}
+			}
+			size = chunks[s][ntiles];
+		}
+		nused++;
+		if (sec_off[s] > len || size > len - sec_off[s]) {
+			eprintf("Truncated rgrid file.\n");
+			return false;
+		}
+	}
+	if (mask_off > len || (ngrid + 7) / 8 > len - mask_off ||
+	    tiles_off > len || 8ull * (ntiles + 1) > len - tiles_off) {
+		eprintf("Truncated rgrid file.\n");
+		return false;
+	}
+
+	vector<size_t> tile_start(ntiles + 1);
+	for (int t = 0; t <= ntiles; t++) {
+		tile_start[t] = size_t(get_le64(data + tiles_off + 8 * t));
+		if ((t == 0 && tile_start[t] != 0) ||
+		    (t > 0 && tile_start[t] < tile_start[t-1]) ||
+		    (t == ntiles && tile_start[t] != nverts)) {
+			eprintf("Bad rgrid tile table.\n");
+			return false;
+		}
+	}
+
+	dprintf("\n  Reading %d x %d range grid, %lu vertices%s... ",
+		w, h, (unsigned long) nverts, packed ? " (compressed)" : "");
+	int nv = int(nverts);
+	mesh->grid_width = w;
+	mesh->grid_height = h;
+	mesh->grid.resize(ngrid);
+	mesh->vertices.resize(nv);
+	if (used[RGRID_SEC_NORM])
+		mesh->normals.resize(nv);
+	if (used[RGRID_SEC_CONF])
+		mesh->confidences.resize(nv);
+	if (used[RGRID_SEC_COLOR])
+		mesh->colors.resize(nv);
+
+	const unsigned char *mask = data + mask_off;
+	const bool swap = we_are_big_endian();
+	bool ok = true;
+#pragma omp parallel for schedule(dynamic) reduction(&& : ok)
+	for (int t = 0; t < ntiles; t++) {
+		size_t first = tile_start[t], last = tile_start[t+1];
+		size_t cell = size_t(t) * tile_rows * w;
+		size_t end_cell = min(cell + size_t(tile_rows) * w, ngrid);
+		const int *cells = &mesh->grid[cell];
+		int rows = int((end_cell - cell) / w);
+		size_t ind = first;
+		for ( ; cell < end_cell; cell++) {
+			if (!((mask[cell >> 3] >> (cell & 7)) & 1))
+				mesh->grid[cell] = TriMesh::GRID_INVALID;
+			else if (ind < last)
+				mesh->grid[cell] = int(ind++);
+			else
+				break;
+		}
+		if (cell != end_cell || ind != last) {
+			ok = false;
+			continue;
+		}
+
+		size_t n = last - first;
+		if (!n)
+			continue;
+		unsigned char *dst[RGRID_NSECTIONS] = {
+			(unsigned char *) &mesh->vertices[first][0], NULL,
+			used[RGRID_SEC_CONF] ?
+				(unsigned char *) &mesh->confidences[first] : NULL,
+			NULL };
+		// Normals and colors are converted from a copy
+		vector<unsigned char> norm_buf, color_buf;
+		if (used[RGRID_SEC_NORM]) {
+			norm_buf.resize(4 * n);
+			dst[RGRID_SEC_NORM] = &norm_buf[0];
+		}
+		if (used[RGRID_SEC_COLOR]) {
+			color_buf.resize(3 * n);
+			dst[RGRID_SEC_COLOR] = &color_buf[0];
+		}
+		for (int s = 0; s < RGRID_NSECTIONS; s++) {
+			if (used[s] && !rgrid_chunk(data + sec_off[s],
+			    packed ? &chunks[s][0] : NULL, t, first, n,
+			    ncomp[s], csize[s], cells, w, rows, dst[s]))
+				ok = false;
+		}
+		if (!ok)
+			continue;
+
+		if (swap) {
+			for (size_t i = first; i < last; i++) {
+				swap_float(mesh->vertices[i][0]);
+				swap_float(mesh->vertices[i][1]);
+				swap_float(mesh->vertices[i][2]);
+				if (used[RGRID_SEC_CONF])
+					swap_float(mesh->confidences[i]);
+			}
+		}
+		if (used[RGRID_SEC_NORM]) {
+			const unsigned char *q = &norm_buf[0];
+			for (size_t i = first; i < last; i++, q += 4)
+				mesh->normals[i] = oct_decode(q[0] | (q[1] << 8),
+					q[2] | (q[3] << 8));
+		}
+		if (used[RGRID_SEC_COLOR]) {
+			const unsigned char *c = &color_buf[0];
+			for (size_t i = first; i < last; i++, c += 3)
+				mesh->colors[i] = Color(c);
+		}
+	}
+	if (!ok) {
+		eprintf("Corrupt rgrid file.\n");
+		return false;
+	}
+	return true;
+}
+
+
 // Read nverts vertices from a binary file.
 // vert_len = total length of a vertex record in bytes
 // vert_pos, vert_norm, vert_color, vert_conf =
@@ -925,6 +1831,124 @@ static bool slurp_verts_bin(FILE *f, TriMesh *mesh, bool need_swap, int nverts)
 }
 
 
+// Copy n 3-vectors of floats, starting at src and spaced by stride bytes,
+// into consecutive elements of dst
+static void deinterleave3(const unsigned char *src, size_t stride,
+	float *dst, size_t n)
+{
+	if (stride == 12) {
+		memcpy(dst, src, n * 12);
+		return;
+	}
+
+	size_t i = 0;
+#ifdef __SSE2__
+	// Move 16 bytes at a time.  The extra 4 bytes come from the same or
+	// next record, and land where the next vector will go, so the last
+	// vector is left for the scalar loop.
+	for ( ; i + 1 < n; i++)
+		_mm_storeu_si128((__m128i *) (dst + 3 * i),
+			_mm_loadu_si128((const __m128i *) (src + i * stride)));
+#endif
+	for ( ; i < n; i++)
+		memcpy(dst + 3 * i, src + i * stride, 12);
+}
+
+
+// Copy n binary vertex records starting at data into mesh, starting at
+// vertex first, without byte swapping.  The per-vertex arrays must already
+// be big enough.  Offsets are as for read_verts_bin.
+static void copy_verts_bin(const unsigned char *data, int n, TriMesh *mesh,
+	int first, int vert_len, int vert_pos, int vert_norm,
+	int vert_color, bool float_color, int vert_conf)
+{
+	deinterleave3(data + vert_pos, vert_len,
+		&mesh->vertices[first][0], n);
+	if (vert_norm >= 0)
+		deinterleave3(data + vert_norm, vert_len,
+			&mesh->normals[first][0], n);
+	if (vert_color >= 0 && float_color)
+		deinterleave3(data + vert_color, vert_len,
+			&mesh->colors[first][0], n);
+	if (vert_color >= 0 && !float_color) {
+		const unsigned char *c = data + vert_color;
+		for (int i = first; i < first + n; i++, c += vert_len)
+			mesh->colors[i] = Color(c);
+	}
+	if (vert_conf >= 0) {
+		const unsigned char *c = data + vert_conf;
+		for (int i = first; i < first + n; i++, c += vert_len)
+			memcpy(&mesh->confidences[i], c, 4);
+	}
+}
+
+
+// Byte-swap the properties of vertices [first, last) read by
+// copy_verts_bin
+static void swap_verts_bin(TriMesh *mesh, int first, int last,
+	bool have_norm, bool have_float_color, bool have_conf)
+{
+	for (int i = first; i < last; i++) {
+		swap_float(mesh->vertices[i][0]);
+		swap_float(mesh->vertices[i][1]);
+		swap_float(mesh->vertices[i][2]);
+		if (have_norm) {
+			swap_float(mesh->normals[i][0]);
+			swap_float(mesh->normals[i][1]);
+			swap_float(mesh->normals[i][2]);
+		}
+		if (have_float_color) {
+			swap_float(mesh->colors[i][0]);
+			swap_float(mesh->colors[i][1]);
+			swap_float(mesh->colors[i][2]);
+		}
+		if (have_conf)
+			swap_float(mesh->confidences[i]);
+	}
+}
+
+
+// Read binary vertices from a mapped file, copying each attribute out of
+// the interleaved records in one pass.  Parameters are as for
+// read_verts_bin.
+static bool map_verts_bin(const MappedFile &m, FILE *f, TriMesh *mesh,
+	bool &need_swap, int nverts, int vert_len, int vert_pos,
+	int vert_norm, int vert_color, bool float_color, int vert_conf)
+{
+	if (nverts < 0 || vert_len < 12 || vert_pos < 0 ||
+	    sizeof(point) != 12)
+		return false;
+	if (nverts == 0)
+		return true;
+
+	const unsigned char *data, *end;
+	if (!mapped_range(m, f, data, end))
+		return false;
+	if (size_t(end - data) / size_t(vert_len) < size_t(nverts))
+		return false;
+
+	int old_nverts = mesh->vertices.size();
+	int new_nverts = old_nverts + nverts;
+	mesh->vertices.resize(new_nverts);
+	if (vert_norm >= 0)
+		mesh->normals.resize(new_nverts);
+	if (vert_color >= 0)
+		mesh->colors.resize(new_nverts);
+	if (vert_conf >= 0)
+		mesh->confidences.resize(new_nverts);
+
+	dprintf("\n  Reading %d vertices... ", nverts);
+	copy_verts_bin(data, nverts, mesh, old_nverts, vert_len, vert_pos,
+		vert_norm, vert_color, float_color, vert_conf);
+	check_need_swap(mesh->vertices[old_nverts], need_swap);
+	if (need_swap)
+		swap_verts_bin(mesh, old_nverts, new_nverts, vert_norm >= 0,
+			vert_color >= 0 && float_color, vert_conf >= 0);
+
+	return mapped_seek(m, f, data + size_t(nverts) * size_t(vert_len));
+}
+
+
 // Read a bunch of vertices from an ASCII file.
 // Parameters are as in read_verts_bin, but offsets are in
 // (white-space-separated) words, rather than in bytes
@@ -991,6 +2015,111 @@ static bool read_verts_asc(FILE *f, TriMesh *mesh,
 }
 
 
+// Read one vertex record from memory, as in read_verts_asc
+static bool read_vert_asc(AscScanner &s, TriMesh *mesh, int i,
+	int vert_len, int vert_pos, int vert_norm,
+	int vert_color, bool float_color, int vert_conf)
+{
+	for (int j = 0; j < vert_len; j++) {
+		if (j == vert_pos) {
+			if (!s.get(mesh->vertices[i][0]) ||
+			    !s.get(mesh->vertices[i][1]) ||
+			    !s.get(mesh->vertices[i][2]))
+				return false;
+			j += 2;
+		} else if (j == vert_norm) {
+			if (!s.get(mesh->normals[i][0]) ||
+			    !s.get(mesh->normals[i][1]) ||
+			    !s.get(mesh->normals[i][2]))
+				return false;
+			j += 2;
+		} else if (j == vert_color && float_color) {
+			float r, g, b;
+			if (!s.get(r) || !s.get(g) || !s.get(b))
+				return false;
+			mesh->colors[i] = Color(r,g,b);
+			j += 2;
+		} else if (j == vert_color && !float_color) {
+			int r, g, b;
+			if (!s.get(r) || !s.get(g) || !s.get(b))
+				return false;
+			mesh->colors[i] = Color(r,g,b);
+			j += 2;
+		} else if (j == vert_conf) {
+			if (!s.get(mesh->confidences[i]))
+				return false;
+		} else if (!s.word()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+// Read ASCII vertices from a mapped file.  Parameters are as for
+// read_verts_asc.  Files with one vertex per line are split into runs of
+// lines parsed by separate threads.  Each run must hold exactly its share
+// of the vertices (the result is then the same as reading the words in
+// order); if not, the words are read in order by a single thread.
+static bool map_verts_asc(const MappedFile &m, FILE *f, TriMesh *mesh,
+	int nverts, int vert_len, int vert_pos, int vert_norm,
+	int vert_color, bool float_color, int vert_conf)
+{
+	if (nverts < 0 || vert_len < 3 || vert_pos < 0)
+		return false;
+	if (nverts == 0)
+		return true;
+
+	skip_comments(f);
+	const char *p, *end;
+	if (!mapped_range(m, f, p, end))
+		return false;
+
+	int old_nverts = mesh->vertices.size();
+	int new_nverts = old_nverts + nverts;
+	mesh->vertices.resize(new_nverts);
+	if (vert_norm >= 0)
+		mesh->normals.resize(new_nverts);
+	if (vert_color >= 0)
+		mesh->colors.resize(new_nverts);
+	if (vert_conf >= 0)
+		mesh->confidences.resize(new_nverts);
+
+	dprintf("\n  Reading %d vertices... ", nverts);
+	int nchunks = num_chunks(nverts, 4096);
+	vector<const char *> bounds;
+	if (nchunks > 1 && split_lines(p, end, nverts, nchunks, bounds)) {
+		int nbad = 0;
+#pragma omp parallel for reduction(+ : nbad)
+		for (int k = 0; k < nchunks; k++) {
+			AscScanner s(bounds[k], bounds[k+1]);
+			int first = old_nverts + int((long long) nverts * k / nchunks);
+			int last = old_nverts + int((long long) nverts * (k+1) / nchunks);
+			for (int i = first; i < last; i++) {
+				if (!read_vert_asc(s, mesh, i, vert_len, vert_pos,
+				                   vert_norm, vert_color, float_color,
+				                   vert_conf)) {
+					nbad++;
+					break;
+				}
+			}
+			if (!s.at_end())
+				nbad++;
+		}
+		if (!nbad)
+			return mapped_seek(m, f, bounds[nchunks]);
+	}
+
+	AscScanner s(p, end);
+	for (int i = old_nverts; i < new_nverts; i++) {
+		if (!read_vert_asc(s, mesh, i, vert_len, vert_pos,
+		                   vert_norm, vert_color, float_color, vert_conf))
+			return false;
+	}
+	return mapped_seek(m, f, s.pos());
+}
+
+
 // Read nfaces faces from a binary file.
 // face_len = total length of face record, *not counting the indices*
 //  (Yes, this is bizarre, but there is potentially a variable # of indices...)
@@ -1029,20 +2158,116 @@ static bool read_faces_bin(FILE *f, TriMesh *mesh, bool need_swap,
 				if (need_swap)
 					swap_unsigned(this_ninds);
 			} else {
-				this_ninds = buf[face_count];
+				this_ninds = buf[face_count];
+			}
+		}
+		thisface.resize(this_ninds);
+		COND_READ(true, thisface[0], 4*this_ninds);
+		if (need_swap) {
+			for (size_t j = 0; j < thisface.size(); j++)
+				swap_int(thisface[j]);
+		}
+		tess(mesh->vertices, thisface, mesh->faces);
+		COND_READ(face_skip > 0, buf[0], face_skip);
+	}
+
+	return true;
+}
+
+
+// Read binary faces from a mapped file.  Parameters are as for
+// read_faces_bin.  Files holding only triangles have fixed-length records,
+// which are copied out directly (in parallel); anything else is scanned
+// record by record.
+static bool map_faces_bin(const MappedFile &m, FILE *f, TriMesh *mesh,
+	bool need_swap, int nfaces, int face_len, int face_count,
+	int face_idx)
+{
+	if (nfaces < 0 || face_idx < 0)
+		return false;
+
+	if (nfaces == 0)
+		return true;
+
+	const unsigned char *p, *end;
+	if (!mapped_range(m, f, p, end))
+		return false;
+
+	dprintf("\n  Reading %d faces... ", nfaces);
+
+	int old_nfaces = mesh->faces.size();
+	int face_skip = face_len - face_idx;
+	bool count4 = (face_idx - face_count == 4);
+
+	// Try fixed-length triangle records first
+	size_t stride = size_t(face_idx) + 12 + size_t(face_skip);
+	if (face_skip >= 0 && sizeof(TriMesh::Face) == 12 &&
+	    size_t(end - p) / stride >= size_t(nfaces)) {
+		mesh->faces.resize(old_nfaces + nfaces);
+		TriMesh::Face *faces = &mesh->faces[old_nfaces];
+		int nbad = 0;
+#pragma omp parallel for reduction(+ : nbad)
+		for (int i = 0; i < nfaces; i++) {
+			const unsigned char *rec = p + i * stride;
+			if (face_count >= 0) {
+				unsigned n = rec[face_count];
+				if (count4) {
+					memcpy(&n, rec + face_count, 4);
+					if (need_swap)
+						swap_unsigned(n);
+				}
+				nbad += (n != 3);
+			}
+			memcpy(&faces[i][0], rec + face_idx, 12);
+		}
+		if (nbad == 0) {
+			if (need_swap) {
+				for (int i = 0; i < nfaces; i++) {
+					swap_int(faces[i][0]);
+					swap_int(faces[i][1]);
+					swap_int(faces[i][2]);
+				}
+			}
+			return mapped_seek(m, f, p + nfaces * stride);
+		}
+		mesh->faces.resize(old_nfaces);
+	}
+
+	// Variable-length records
+	vector<int> thisface;
+	for (int i = 0; i < nfaces; i++) {
+		if (end - p < face_idx)
+			return false;
+		unsigned this_ninds = 3;
+		if (face_count >= 0) {
+			if (count4) {
+				memcpy(&this_ninds, p + face_count, 4);
+				if (need_swap)
+					swap_unsigned(this_ninds);
+			} else {
+				this_ninds = p[face_count];
 			}
 		}
+		p += face_idx;
+		if (size_t(end - p) / 4 < this_ninds)
+			return false;
 		thisface.resize(this_ninds);
-		COND_READ(true, thisface[0], 4*this_ninds);
+		if (this_ninds)
+			memcpy(&thisface[0], p, 4 * this_ninds);
+		p += 4 * this_ninds;
 		if (need_swap) {
 			for (size_t j = 0; j < thisface.size(); j++)
 				swap_int(thisface[j]);
 		}
 		tess(mesh->vertices, thisface, mesh->faces);
-		COND_READ(face_skip > 0, buf[0], face_skip);
+		if (face_skip > 0) {
+			if (end - p < face_skip)
+				return false;
+			p += face_skip;
+		}
 	}
 
-	return true;
+	return mapped_seek(m, f, p);
 }
 
 
@@ -1098,6 +2323,104 @@ static bool read_faces_asc(FILE *f, TriMesh *mesh, int nfaces,
 }
 
 
+// Read one face record from memory, as in read_faces_asc, and tessellate
+// it into tris.  If the data ends in the middle of the record, missing
+// indices are 0 and a missing count is 3, as with fscanf at the end of a
+// file, unless eof_ok is false.
+static bool read_face_asc(AscScanner &s, const vector<point> &verts,
+	vector<int> &thisface, vector<TriMesh::Face> &tris,
+	int face_len, int face_count, int face_idx, bool read_to_eol,
+	bool eof_ok)
+{
+	thisface.clear();
+	int this_face_count = 3;
+	for (int j = 0; j < face_len + this_face_count; j++) {
+		if (j >= face_idx && j < face_idx + this_face_count) {
+			thisface.push_back(0);
+			if (!s.get(thisface.back()) && !(eof_ok && s.at_end()))
+				return false;
+		} else if (j == face_count) {
+			if (!s.get(this_face_count) && !(eof_ok && s.at_end()))
+				return false;
+		} else if (!s.word()) {
+			return false;
+		}
+	}
+	tess(verts, thisface, tris);
+	if (read_to_eol)
+		s.skip_line();
+	return true;
+}
+
+
+// Read ASCII faces from a mapped file.  Parameters are as for
+// read_faces_asc.  As with vertices, files with one face per line are
+// split into runs of lines parsed by separate threads.
+static bool map_faces_asc(const MappedFile &m, FILE *f, TriMesh *mesh,
+	int nfaces, int face_len, int face_count, int face_idx,
+	bool read_to_eol /* = false */)
+{
+	if (nfaces < 0 || face_idx < 0)
+		return false;
+
+	if (nfaces == 0)
+		return true;
+
+	skip_comments(f);
+	const char *p, *end;
+	if (!mapped_range(m, f, p, end))
+		return false;
+
+	dprintf("\n  Reading %d faces... ", nfaces);
+	vector<int> thisface;
+	int nchunks = num_chunks(nfaces, 4096);
+	vector<const char *> bounds;
+	if (nchunks > 1 && split_lines(p, end, nfaces, nchunks, bounds)) {
+		vector< vector<TriMesh::Face> > tris(nchunks);
+		int nbad = 0;
+#pragma omp parallel for private(thisface) reduction(+ : nbad)
+		for (int k = 0; k < nchunks; k++) {
+			AscScanner s(bounds[k], bounds[k+1]);
+			int n = int((long long) nfaces * (k+1) / nchunks) -
+			        int((long long) nfaces * k / nchunks);
+			tris[k].reserve(n);
+			for (int i = 0; i < n; i++) {
+				if (!read_face_asc(s, mesh->vertices, thisface,
+				                   tris[k], face_len, face_count,
+				                   face_idx, read_to_eol, false)) {
+					nbad++;
+					break;
+				}
+			}
+			if (!s.at_end())
+				nbad++;
+		}
+		if (!nbad) {
+			size_t ntris = mesh->faces.size();
+			for (int k = 0; k < nchunks; k++)
+				ntris += tris[k].size();
+			mesh->faces.reserve(ntris);
+			for (int k = 0; k < nchunks; k++) {
+				mesh->faces.insert(mesh->faces.end(),
+					tris[k].begin(), tris[k].end());
+				vector<TriMesh::Face>().swap(tris[k]);
+			}
+			return mapped_seek(m, f, bounds[nchunks]);
+		}
+	}
+
+	mesh->faces.reserve(mesh->faces.size() + nfaces);
+	AscScanner s(p, end);
+	for (int i = 0; i < nfaces; i++) {
+		if (!read_face_asc(s, mesh->vertices, thisface, mesh->faces,
+		                   face_len, face_count, face_idx, read_to_eol,
+		                   true))
+			return false;
+	}
+	return mapped_seek(m, f, s.pos());
+}
+
+
 // Read triangle strips from a binary file
 static bool read_strips_bin(FILE *f, TriMesh *mesh, bool need_swap)
 {
@@ -1165,6 +2488,225 @@ static bool read_grid_bin(FILE *f, TriMesh *mesh, bool need_swap)
 }
 
 
+// Read range grid data from a mapped file.  Each cell holds a count byte,
+// which is almost always 0 or 1, followed by that many indices.
+static bool map_grid_bin(const MappedFile &m, FILE *f, TriMesh *mesh,
+	bool need_swap)
+{
+	const unsigned char *p, *end;
+	if (!mapped_range(m, f, p, end))
+		return false;
+
+	dprintf("\n  Reading range grid... ");
+	int ngrid = mesh->grid_width * mesh->grid_height;
+	mesh->grid.resize(ngrid, TriMesh::GRID_INVALID);
+	int *grid = ngrid ? &mesh->grid[0] : NULL;
+	int i = 0;
+
+	// While a full 0/1 cell is known to fit, skip the bounds checks
+	while (i < ngrid && end - p >= 5) {
+		unsigned n = *p;
+		if (n > 1)
+			break;
+		if (n)
+			memcpy(&grid[i], p + 1, 4);
+		p += 1 + 4 * n;
+		i++;
+	}
+
+	// Everything else, including cells with several indices (of which
+	// the last one wins)
+	for ( ; i < ngrid; i++) {
+		if (p == end)
+			return false;
+		unsigned n = *p++;
+		if (size_t(end - p) / 4 < n)
+			return false;
+		if (n)
+			memcpy(&grid[i], p + 4 * (n - 1), 4);
+		p += 4 * n;
+	}
+
+	if (need_swap) {
+		for (i = 0; i < ngrid; i++)
+			if (grid[i] != TriMesh::GRID_INVALID)
+				swap_int(grid[i]);
+	}
+
+	return mapped_seek(m, f, p);
+}
+
+// Clip a window to a grid of the given size
+static void clip_window(GridWindow &w, int width, int height)
+{
+	w.x0 = clamp(w.x0, 0, width);   w.x1 = clamp(w.x1, w.x0, width);
+	w.y0 = clamp(w.y0, 0, height);  w.y1 = clamp(w.y1, w.y0, height);
+}
+
+
+// Read a window of a binary range grid and just the vertices it uses from
+// a mapped file, which is positioned at the start of the vertices.  The
+// grid has to be scanned up to the last row of the window (its cells are
+// variable-length), but only the pages holding the referenced vertex
+// records are touched.  Other parameters are as for read_verts_bin.
+static bool map_window_bin(const MappedFile &m, FILE *f, TriMesh *mesh,
+	bool &need_swap, int nverts, int vert_len, int vert_pos,
+	int vert_norm, int vert_color, bool float_color, int vert_conf,
+	int skip2, const GridWindow &window)
+{
+	if (nverts < 0 || vert_len < 12 || vert_pos < 0 || skip2 < 0 ||
+	    sizeof(point) != 12)
+		return false;
+
+	const unsigned char *verts, *end;
+	if (!mapped_range(m, f, verts, end))
+		return false;
+	size_t verts_len = size_t(nverts) * size_t(vert_len);
+	if (size_t(end - verts) < verts_len ||
+	    size_t(end - verts) - verts_len < size_t(skip2))
+		return false;
+
+	// Decide on byte order based on the first vertex, as for a full read
+	if (nverts) {
+		point p;
+		memcpy(&p[0], verts + vert_pos, 12);
+		check_need_swap(p, need_swap);
+	}
+
+	GridWindow w = window;
+	int width = mesh->grid_width, height = mesh->grid_height;
+	clip_window(w, width, height);
+	int ww = w.x1 - w.x0, wh = w.y1 - w.y0;
+
+	dprintf("\n  Reading range grid window %dx%d at (%d, %d)... ",
+		ww, wh, w.x0, w.y0);
+	mesh->grid.assign(size_t(ww) * size_t(wh), TriMesh::GRID_INVALID);
+	const unsigned char *p = verts + verts_len + skip2;
+	for (int y = 0; y < w.y1; y++) {
+		int *row = (y >= w.y0) ? &mesh->grid[size_t(y - w.y0) * ww] : NULL;
+		for (int x = 0; x < width; x++) {
+			if (p == end)
+				return false;
+			unsigned n = *p++;
+			if (size_t(end - p) / 4 < n)
+				return false;
+			if (n && row && x >= w.x0 && x < w.x1) {
+				int ind;
+				memcpy(&ind, p + 4 * (n - 1), 4);
+				if (need_swap)
+					swap_int(ind);
+				if (ind >= 0 && ind < nverts)
+					row[x - w.x0] = ind;
+			}
+			p += 4 * n;
+		}
+	}
+	mesh->grid_width = ww;
+	mesh->grid_height = wh;
+
+	// Number the vertices used in file order, in a table covering the
+	// range of indices they span
+	int lo = nverts, hi = -1;
+	for (size_t i = 0; i < mesh->grid.size(); i++) {
+		int ind = mesh->grid[i];
+		if (ind == TriMesh::GRID_INVALID)
+			continue;
+		lo = min(lo, ind);
+		hi = max(hi, ind);
+	}
+	int span = max(hi - lo + 1, 0);
+	vector<int> remap(span, -1);
+	for (size_t i = 0; i < mesh->grid.size(); i++)
+		if (mesh->grid[i] != TriMesh::GRID_INVALID)
+			remap[mesh->grid[i] - lo] = 0;
+	int nused = 0;
+	for (int i = 0; i < span; i++)
+		if (remap[i] == 0)
+			remap[i] = nused++;
+
+	dprintf("\n  Reading %d of %d vertices... ", nused, nverts);
+	mesh->vertices.resize(nused);
+	if (vert_norm >= 0)
+		mesh->normals.resize(nused);
+	if (vert_color >= 0)
+		mesh->colors.resize(nused);
+	if (vert_conf >= 0)
+		mesh->confidences.resize(nused);
+
+	// Copy runs of consecutive vertices
+	for (int i = 0; i < span; ) {
+		if (remap[i] < 0) {
+			i++;
+			continue;
+		}
+		int j = i + 1;
+		while (j < span && remap[j] >= 0)
+			j++;
+		copy_verts_bin(verts + size_t(lo + i) * size_t(vert_len),
+			j - i, mesh, remap[i], vert_len, vert_pos, vert_norm,
+			vert_color, float_color, vert_conf);
+		i = j;
+	}
+	if (need_swap)
+		swap_verts_bin(mesh, 0, nused, vert_norm >= 0,
+			vert_color >= 0 && float_color, vert_conf >= 0);
+
+	// Renumber the grid
+	for (size_t i = 0; i < mesh->grid.size(); i++) {
+		int &ind = mesh->grid[i];
+		if (ind != TriMesh::GRID_INVALID)
+			ind = remap[ind - lo];
+	}
+
+	return true;
+}
+
+
+// Keep only a window of the range grid of a mesh that has been read in
+// full, and the vertices it uses
+static bool crop_grid(TriMesh *mesh, const GridWindow &window)
+{
+	if (mesh->grid.empty()) {
+		eprintf("No range grid to read a window of.\n");
+		return false;
+	}
+
+	GridWindow w = window;
+	int width = mesh->grid_width;
+	clip_window(w, width, mesh->grid_height);
+	int ww = w.x1 - w.x0, wh = w.y1 - w.y0;
+
+	int nv = mesh->vertices.size();
+	vector<int> grid(size_t(ww) * size_t(wh), TriMesh::GRID_INVALID);
+	vector<int> remap(nv, -1);
+	for (int y = w.y0; y < w.y1; y++) {
+		for (int x = w.x0; x < w.x1; x++) {
+			int ind = mesh->grid[x + y * width];
+			if (ind < 0 || ind >= nv)
+				continue;
+			grid[(x - w.x0) + (y - w.y0) * ww] = ind;
+			remap[ind] = 0;
+		}
+	}
+
+	// Keep the used vertices in their original order
+	int next = 0;
+	for (int i = 0; i < nv; i++)
+		if (remap[i] == 0)
+			remap[i] = next++;
+
+	if (!next)
+		mesh->clear();
+	mesh->grid.swap(grid);
+	mesh->grid_width = ww;
+	mesh->grid_height = wh;
+	if (next)
+		remap_verts(mesh, remap);
+	return true;
+}
+
+
+
 // Read range grid data from an ASCII file
 static bool read_grid_asc(FILE *f, TriMesh *mesh)
 {
@@ -1368,7 +2910,7 @@ bool TriMesh::write(const char *filename)
 	}
 
 	enum { PLY_ASCII, PLY_BINARY_BE, PLY_BINARY_LE,
-	       RAY, OBJ, OFF, SM, STL, PTS, CC, DAE } filetype;
+	       RAY, OBJ, OFF, SM, STL, PTS, CC, DAE, DEPTH, RGRID, RGRIDZ } filetype;
 	// Set default file type to be native-endian binary ply
 	filetype = we_are_little_endian() ? PLY_BINARY_LE : PLY_BINARY_BE;
 
@@ -1402,6 +2944,12 @@ bool TriMesh::write(const char *filename)
 		filetype = CC;
 	else if (ends_with(filename, ".dae"))
 		filetype = DAE;
+	else if (ends_with(filename, ".pfm") || ends_with(filename, ".npy"))
+		filetype = DEPTH;
+	else if (ends_with(filename, ".rgrid"))
+		filetype = RGRID;
+	else if (ends_with(filename, ".rgridz"))
+		filetype = RGRIDZ;
 
 	// Handle filetype:filename.foo constructs
 	while (1) {
@@ -1472,12 +3020,28 @@ bool TriMesh::write(const char *filename)
 		} else if (begins_with(filename, "dae:")) {
 			filename += 4;
 			filetype = DAE;
+		} else if (begins_with(filename, "depth:")) {
+			filename += 6;
+			filetype = DEPTH;
+		} else if (begins_with(filename, "rgrid:")) {
+			filename += 6;
+			filetype = RGRID;
+		} else if (begins_with(filename, "rgridz:")) {
+			filename += 7;
+			filetype = RGRIDZ;
 		} else {
 			break;
 		}
 	}
 
 
+	// The normal map of a depth map goes to a second file, named after
+	// the first, so there is nowhere to put it when writing to stdout
+	if (filetype == DEPTH && write_norm && strcmp(filename, "-") == 0) {
+		eprintf("Can't write a normal map to standard output.\n");
+		return false;
+	}
+
 	FILE *f = NULL;
 
 	if (strcmp(filename, "-") == 0) {
@@ -1531,6 +3095,15 @@ bool TriMesh::write(const char *filename)
 		case DAE:
 			ok = write_dae(this, f);
 			break;
+		case RGRID:
+			ok = write_rgrid(this, f, false);
+			break;
+		case RGRIDZ:
+			ok = write_rgrid(this, f, true);
+			break;
+		case DEPTH:
+			ok = write_depth(this, f, filename, write_norm);
+			break;
 	}
 
 	fclose(f);
@@ -1997,66 +3570,77 @@ static bool write_verts_asc(TriMesh *mesh, FILE *f,
 }
 
 
-// Byte-swap vertex properties
-static void swap_vert_props(TriMesh *mesh, bool swap_color)
+// Binary records are assembled in blocks of about this many bytes, each
+// written with one call to fwrite (which, for a block this large, goes
+// straight to the file rather than through stdio's buffer)
+static const size_t WRITE_BLOCK = 1 << 22;
+
+// Write n records of len bytes each.  fill(i, dst) puts record i at dst.
+template <class Fill>
+static bool write_records(FILE *f, size_t n, size_t len, const Fill &fill)
 {
-	for (size_t i = 0; i < mesh->vertices.size(); i++) {
-		swap_float(mesh->vertices[i][0]);
-		swap_float(mesh->vertices[i][1]);
-		swap_float(mesh->vertices[i][2]);
-	}
-	if (!mesh->normals.empty()) {
-		for (size_t i = 0; i < mesh->normals.size(); i++) {
-			swap_float(mesh->normals[i][0]);
-			swap_float(mesh->normals[i][1]);
-			swap_float(mesh->normals[i][2]);
-		}
-	}
-	if (!mesh->colors.empty() && swap_color) {
-		for (size_t i = 0; i < mesh->normals.size(); i++) {
-			swap_float(mesh->colors[i][0]);
-			swap_float(mesh->colors[i][1]);
-			swap_float(mesh->colors[i][2]);
-		}
+	if (!n || !len)
+		return true;
+	size_t block = max(WRITE_BLOCK / len, size_t(1));
+	vector<unsigned char> buf(min(n, block) * len);
+	for (size_t first = 0; first < n; first += block) {
+		int count = int(min(block, n - first));
+#pragma omp parallel for if (count >= 16384)
+		for (int i = 0; i < count; i++)
+			fill(first + i, &buf[i * len]);
+		FWRITE(&buf[0], len, size_t(count), f);
 	}
-	if (!mesh->confidences.empty()) {
-		for (size_t i = 0; i < mesh->confidences.size(); i++)
-			swap_float(mesh->confidences[i]);
+	return true;
+}
+
+// Copy 4-byte values to dst, byte-swapping if necessary
+static inline unsigned char *put4(unsigned char *dst, const void *src,
+	int n, bool need_swap)
+{
+	memcpy(dst, src, 4 * n);
+	if (need_swap) {
+		for (int i = 0; i < n; i++)
+			swap_unsigned(((unsigned *) dst)[i]);
 	}
+	return dst + 4 * n;
 }
 
 
-// Helper for write_verts_bin: actually does the writing.
-static bool write_verts_bin_helper(TriMesh *mesh, FILE *f,
-                                   bool write_norm, bool write_color,
-                                   bool float_color, bool write_conf)
-{
-	if ((mesh->normals.empty() || !write_norm) &&
-	    (mesh->colors.empty() || !write_color) &&
-	    (mesh->confidences.empty() || !write_conf)) {
-		// Optimized vertex-only code
-		FWRITE(&(mesh->vertices[0][0]), 12*mesh->vertices.size(), 1, f);
-	} else {
-		// Generic code
-		for (size_t i = 0; i < mesh->vertices.size(); i++) {
-			FWRITE(&(mesh->vertices[i][0]), 12, 1, f);
-			if (!mesh->normals.empty() && write_norm)
-				FWRITE(&(mesh->normals[i][0]), 12, 1, f);
-			if (!mesh->colors.empty() && write_color && float_color)
-				FWRITE(&(mesh->colors[i][0]), 12, 1, f);
-			if (!mesh->colors.empty() && write_color && !float_color) {
-				unsigned char c[3] = {
-					color2uchar(mesh->colors[i][0]),
-					color2uchar(mesh->colors[i][1]),
-					color2uchar(mesh->colors[i][2]) };
-				FWRITE(&c, 3, 1, f);
-			}
-			if (!mesh->confidences.empty() && write_conf)
-				FWRITE(&(mesh->confidences[i]), 4, 1, f);
+// Fills in binary vertex records
+struct VertRecord {
+	const TriMesh *mesh;
+	bool norm, color, float_color, conf, need_swap;
+	size_t len;
+
+	VertRecord(const TriMesh *mesh_, bool write_norm, bool write_color,
+	           bool float_color_, bool write_conf, bool need_swap_) :
+		mesh(mesh_),
+		norm(write_norm && !mesh->normals.empty()),
+		color(write_color && !mesh->colors.empty()),
+		float_color(float_color_),
+		conf(write_conf && !mesh->confidences.empty()),
+		need_swap(need_swap_)
+	{
+		len = 12 + (norm ? 12 : 0) + (color ? (float_color ? 12 : 3) : 0) +
+			(conf ? 4 : 0);
+	}
+
+	void operator () (size_t i, unsigned char *dst) const
+	{
+		dst = put4(dst, &mesh->vertices[i][0], 3, need_swap);
+		if (norm)
+			dst = put4(dst, &mesh->normals[i][0], 3, need_swap);
+		if (color && float_color) {
+			dst = put4(dst, &mesh->colors[i][0], 3, need_swap);
+		} else if (color) {
+			*dst++ = color2uchar(mesh->colors[i][0]);
+			*dst++ = color2uchar(mesh->colors[i][1]);
+			*dst++ = color2uchar(mesh->colors[i][2]);
 		}
+		if (conf)
+			put4(dst, &mesh->confidences[i], 1, need_swap);
 	}
-	return true;
-}
+};
 
 
 // Write a bunch of vertices to a binary file
@@ -2064,13 +3648,16 @@ static bool write_verts_bin(TriMesh *mesh, FILE *f, bool need_swap,
                             bool write_norm, bool write_color,
                             bool float_color, bool write_conf)
 {
-	if (need_swap)
-		swap_vert_props(mesh, float_color);
-	bool ok = write_verts_bin_helper(mesh, f, write_norm, write_color,
-		float_color, write_conf);
-	if (need_swap)
-		swap_vert_props(mesh, float_color);
-	return ok;
+	if (mesh->vertices.empty())
+		return true;
+	VertRecord rec(mesh, write_norm, write_color, float_color,
+		write_conf, need_swap);
+	if (rec.len == 12 && !need_swap) {
+		// Optimized vertex-only code
+		FWRITE(&(mesh->vertices[0][0]), 12*mesh->vertices.size(), 1, f);
+		return true;
+	}
+	return write_records(f, mesh->vertices.size(), rec.len, rec);
 }
 
 
@@ -2087,47 +3674,34 @@ static bool write_faces_asc(TriMesh *mesh, FILE *f,
 }
 
 
+// Fills in binary face records
+struct FaceRecord {
+	const TriMesh *mesh;
+	int before_len, after_len;
+	const char *before, *after;
+	bool need_swap;
+
+	void operator () (size_t i, unsigned char *dst) const
+	{
+		if (before_len)
+			memcpy(dst, before, before_len);
+		dst = put4(dst + before_len, &mesh->faces[i][0], 3, need_swap);
+		if (after_len)
+			memcpy(dst, after, after_len);
+	}
+};
+
+
 // Write a bunch of faces to a binary file
 static bool write_faces_bin(TriMesh *mesh, FILE *f, bool need_swap,
                             int before_face_len, const char *before_face,
                             int after_face_len, const char *after_face)
 {
 	mesh->need_faces();
-	if (need_swap) {
-		for (size_t i = 0; i < mesh->faces.size(); i++) {
-			swap_int(mesh->faces[i][0]);
-			swap_int(mesh->faces[i][1]);
-			swap_int(mesh->faces[i][2]);
-		}
-	}
-	bool ok = true;
-	for (size_t i = 0; i < mesh->faces.size(); i++) {
-		if (before_face_len) {
-			if (fwrite(before_face, before_face_len, 1, f) != 1) {
-				ok = false;
-				goto out;
-			}
-		}
-		if (fwrite(&(mesh->faces[i][0]), 12, 1, f) != 1) {
-			ok = false;
-			goto out;
-		}
-		if (after_face_len) {
-			if (fwrite(after_face, after_face_len, 1, f) != 1) {
-				ok = false;
-				goto out;
-			}
-		}
-	}
-out:
-	if (need_swap) {
-		for (size_t i = 0; i < mesh->faces.size(); i++) {
-			swap_int(mesh->faces[i][0]);
-			swap_int(mesh->faces[i][1]);
-			swap_int(mesh->faces[i][2]);
-		}
-	}
-	return ok;
+	FaceRecord rec = { mesh, before_face_len, after_face_len,
+		before_face, after_face, need_swap };
+	return write_records(f, mesh->faces.size(),
+		before_face_len + 12 + after_face_len, rec);
 }
 
 
@@ -2172,26 +3746,354 @@ static bool write_grid_asc(TriMesh *mesh, FILE *f)
 }
 
 
-// Write range grid to a binary file
+// Write range grid to a binary file.  Each cell is a count of 0 or 1,
+// followed by the index if there is one.  Blocks of cells are encoded by
+// several threads at once: each counts the valid cells in its share of
+// the block, to find where its output goes, and then writes it.
 static bool write_grid_bin(TriMesh *mesh, FILE *f, bool need_swap)
 {
-	unsigned char zero = 0;
-	unsigned char one = 1;
-	for (size_t i = 0; i < mesh->grid.size(); i++) {
-		if (mesh->grid[i] < 0) {
-			FWRITE(&zero, 1, 1, f);
-		} else {
-			FWRITE(&one, 1, 1, f);
-			int g = mesh->grid[i];
-			if (need_swap)
-				swap_int(g);
-			FWRITE(&g, 4, 1, f);
+	const size_t block = WRITE_BLOCK / 5;
+	size_t ngrid = mesh->grid.size();
+	vector<unsigned char> buf(5 * min(ngrid, block));
+	int nthreads = num_threads();
+	vector<size_t> offsets(nthreads + 1);
+	for (size_t first = 0; first < ngrid; first += block) {
+		size_t count = min(block, ngrid - first);
+		const int *grid = &mesh->grid[first];
+		int nchunks = num_chunks(count, 16384);
+
+#pragma omp parallel for
+		for (int k = 0; k < nchunks; k++) {
+			size_t start = count * k / nchunks;
+			size_t stop = count * (k+1) / nchunks;
+			size_t nvalid = 0;
+			for (size_t i = start; i < stop; i++)
+				nvalid += (grid[i] >= 0);
+			offsets[k+1] = (stop - start) + 4 * nvalid;
+		}
+		offsets[0] = 0;
+		for (int k = 0; k < nchunks; k++)
+			offsets[k+1] += offsets[k];
+
+#pragma omp parallel for
+		for (int k = 0; k < nchunks; k++) {
+			unsigned char *dst = &buf[offsets[k]];
+			size_t start = count * k / nchunks;
+			size_t stop = count * (k+1) / nchunks;
+			for (size_t i = start; i < stop; i++) {
+				if (grid[i] < 0) {
+					*dst++ = 0;
+				} else {
+					*dst++ = 1;
+					dst = put4(dst, &grid[i], 1, need_swap);
+				}
+			}
 		}
+
+		FWRITE(&buf[0], 1, offsets[nchunks], f);
+	}
+	return true;
+}
+
+
+// Fills in the per-vertex sections of a .rgrid file, for the vertex order
+// given by order[]
+struct RgridPosRecord {
+	const TriMesh *mesh;
+	const int *order;
+	bool need_swap;
+	void operator () (size_t i, unsigned char *dst) const
+		{ put4(dst, &mesh->vertices[order[i]][0], 3, need_swap); }
+};
+
+struct RgridNormRecord {
+	const TriMesh *mesh;
+	const int *order;
+	void operator () (size_t i, unsigned char *dst) const
+	{
+		unsigned short q[2];
+		oct_encode(mesh->normals[order[i]], q);
+		dst[0] = q[0] & 0xff;  dst[1] = q[0] >> 8;
+		dst[2] = q[1] & 0xff;  dst[3] = q[1] >> 8;
+	}
+};
+
+struct RgridConfRecord {
+	const TriMesh *mesh;
+	const int *order;
+	bool need_swap;
+	void operator () (size_t i, unsigned char *dst) const
+		{ put4(dst, &mesh->confidences[order[i]], 1, need_swap); }
+};
+
+struct RgridColorRecord {
+	const TriMesh *mesh;
+	const int *order;
+	void operator () (size_t i, unsigned char *dst) const
+	{
+		const Color &c = mesh->colors[order[i]];
+		dst[0] = color2uchar(c[0]);
+		dst[1] = color2uchar(c[1]);
+		dst[2] = color2uchar(c[2]);
+	}
+};
+
+
+// Pad a file to a multiple of RGRID_ALIGN bytes, given the current size
+static bool rgrid_pad(FILE *f, unsigned long long &size)
+{
+	static const unsigned char zeros[RGRID_ALIGN] = { 0 };
+	size_t pad = size_t(rgrid_align(size) - size);
+	if (pad)
+		FWRITE(zeros, 1, pad, f);
+	size += pad;
+	return true;
+}
+
+
+// Compress each tile's chunk of a section, made of records of ncomp
+// components of csize bytes filled in by fill
+template <class Fill>
+static void rgrid_pack(const TriMesh *mesh,
+	const vector<unsigned long long> &tile_start, int tile_rows,
+	int ncomp, int csize, const Fill &fill,
+	vector< vector<unsigned char> > &chunks)
+{
+	int w = mesh->grid_width, h = mesh->grid_height;
+	int nv = mesh->vertices.size();
+	int ntiles = int(tile_start.size()) - 1;
+	size_t len = ncomp * csize;
+	chunks.resize(ntiles);
+#pragma omp parallel for schedule(dynamic)
+	for (int t = 0; t < ntiles; t++) {
+		size_t first = size_t(tile_start[t]);
+		size_t n = size_t(tile_start[t+1]) - first;
+		if (!n)
+			continue;
+		int rows = min(tile_rows, h - t * tile_rows);
+		const int *grid = &mesh->grid[size_t(t) * tile_rows * w];
+		vector<int> cells(size_t(rows) * w);
+		int ind = 0;
+		for (size_t i = 0; i < cells.size(); i++)
+			cells[i] = (grid[i] >= 0 && grid[i] < nv) ? ind++ : -1;
+		vector<unsigned char> recs(n * len);
+		for (size_t i = 0; i < n; i++)
+			fill(first + i, &recs[i * len]);
+		grid_encode(&recs[0], n, ncomp, csize, &cells[0], w, rows, 0,
+			chunks[t]);
+	}
+}
+
+
+// Write a section of nverts records of len bytes, or its packed chunks
+// if there are any
+template <class Fill>
+static bool rgrid_section(FILE *f, size_t nverts, size_t len,
+	const Fill &fill, const vector< vector<unsigned char> > &chunks,
+	unsigned long long &size)
+{
+	if (chunks.empty()) {
+		if (!write_records(f, nverts, len, fill))
+			return false;
+		size += nverts * len;
+	}
+	for (size_t t = 0; t < chunks.size(); t++) {
+		if (chunks[t].empty())
+			continue;
+		FWRITE(&chunks[t][0], 1, chunks[t].size(), f);
+		size += chunks[t].size();
+	}
+	return rgrid_pad(f, size);
+}
+
+
+// Write a .rgrid file, compressed if pack is set.  Vertices not in the
+// grid are dropped, and the rest are written in the row-major order of
+// their cells.
+static bool write_rgrid(TriMesh *mesh, FILE *f, bool pack)
+{
+	int w = mesh->grid_width, h = mesh->grid_height;
+	size_t ngrid = mesh->grid.size();
+	if (w <= 0 || h <= 0 || ngrid != size_t(w) * h) {
+		eprintf("No range grid to write.\n");
+		return false;
+	}
+	int nv = mesh->vertices.size();
+	const int *grid = &mesh->grid[0];
+
+	// Count the valid cells in each tile, then list them in order
+	int tile_rows = RGRID_TILE_ROWS;
+	int ntiles = (h - 1) / tile_rows + 1;
+	vector<unsigned long long> tile_start(ntiles + 1);
+#pragma omp parallel for
+	for (int t = 0; t < ntiles; t++) {
+		size_t start = size_t(t) * tile_rows * w;
+		size_t stop = min(start + size_t(tile_rows) * w, ngrid);
+		size_t nvalid = 0;
+		for (size_t i = start; i < stop; i++)
+			nvalid += (grid[i] >= 0 && grid[i] < nv);
+		tile_start[t+1] = nvalid;
 	}
+	tile_start[0] = 0;
+	for (int t = 0; t < ntiles; t++)
+		tile_start[t+1] += tile_start[t];
+	size_t nverts = size_t(tile_start[ntiles]);
+
+	vector<int> order(nverts);
+#pragma omp parallel for
+	for (int t = 0; t < ntiles; t++) {
+		size_t start = size_t(t) * tile_rows * w;
+		size_t stop = min(start + size_t(tile_rows) * w, ngrid);
+		size_t ind = size_t(tile_start[t]);
+		for (size_t i = start; i < stop; i++)
+			if (grid[i] >= 0 && grid[i] < nv)
+				order[ind++] = grid[i];
+	}
+
+	vector<unsigned char> mask((ngrid + 7) / 8);
+	int nmask = int(mask.size());
+#pragma omp parallel for if (nmask >= 16384)
+	for (int j = 0; j < nmask; j++) {
+		unsigned char bits = 0;
+		size_t stop = min(8 * size_t(j) + 8, ngrid);
+		for (size_t i = 8 * size_t(j); i < stop; i++)
+			if (grid[i] >= 0 && grid[i] < nv)
+				bits |= (unsigned char) (1 << (i & 7));
+		mask[j] = bits;
+	}
+
+	bool use[RGRID_NSECTIONS] = { true, !mesh->normals.empty(),
+		!mesh->confidences.empty(), !mesh->colors.empty() };
+	static const size_t rec_len[RGRID_NSECTIONS] = { 12, 4, 4, 3 };
+	unsigned flags = (use[RGRID_SEC_NORM] ? RGRID_NORMALS : 0) |
+		(use[RGRID_SEC_CONF] ? RGRID_CONF : 0) |
+		(use[RGRID_SEC_COLOR] ? RGRID_COLORS : 0) |
+		(pack ? RGRID_PACKED : 0);
+
+	bool need_swap = we_are_big_endian();
+	const int *ord = nverts ? &order[0] : NULL;
+	RgridPosRecord pos = { mesh, ord, need_swap };
+	RgridNormRecord norm = { mesh, ord };
+	RgridConfRecord conf = { mesh, ord, need_swap };
+	RgridColorRecord color = { mesh, ord };
+
+	// Compress the sections first if asked, since that decides where
+	// everything goes
+	vector< vector<unsigned char> > chunks[RGRID_NSECTIONS];
+	if (pack) {
+		rgrid_pack(mesh, tile_start, tile_rows, 3, 4, pos,
+			chunks[RGRID_SEC_POS]);
+		if (use[RGRID_SEC_NORM])
+			rgrid_pack(mesh, tile_start, tile_rows, 2, 2, norm,
+				chunks[RGRID_SEC_NORM]);
+		if (use[RGRID_SEC_CONF])
+			rgrid_pack(mesh, tile_start, tile_rows, 1, 4, conf,
+				chunks[RGRID_SEC_CONF]);
+		if (use[RGRID_SEC_COLOR])
+			rgrid_pack(mesh, tile_start, tile_rows, 3, 1, color,
+				chunks[RGRID_SEC_COLOR]);
+	}
+	unsigned long long sec_size[RGRID_NSECTIONS];
+	vector<unsigned char> chunk_table;
+	for (int s = 0; s < RGRID_NSECTIONS; s++) {
+		sec_size[s] = use[s] ? nverts * rec_len[s] : 0;
+		if (!pack || !use[s])
+			continue;
+		size_t table = chunk_table.size();
+		chunk_table.resize(table + 8 * (ntiles + 1));
+		sec_size[s] = 0;
+		for (int t = 0; t <= ntiles; t++) {
+			put_le64(&chunk_table[table + 8 * t], sec_size[s]);
+			if (t < ntiles)
+				sec_size[s] += chunks[s][t].size();
+		}
+	}
+
+	// Lay out the sections
+	unsigned long long mask_off = RGRID_HEADER;
+	unsigned long long tiles_off = rgrid_align(mask_off + mask.size());
+	unsigned long long chunks_off =
+		rgrid_align(tiles_off + 8 * (ntiles + 1));
+	unsigned long long off = rgrid_align(chunks_off + chunk_table.size());
+	unsigned long long sec_off[RGRID_NSECTIONS] = { 0 };
+	for (int s = 0; s < RGRID_NSECTIONS; s++) {
+		if (!use[s])
+			continue;
+		sec_off[s] = off;
+		off = rgrid_align(off + sec_size[s]);
+	}
+
+	unsigned char header[RGRID_HEADER] = { 0 };
+	memcpy(header, RGRID_MAGIC, 8);
+	put_le32(header + 8, flags);
+	put_le32(header + 12, unsigned(w));
+	put_le32(header + 16, unsigned(h));
+	put_le32(header + 20, unsigned(tile_rows));
+	put_le64(header + 24, nverts);
+	put_le64(header + 32, mask_off);
+	put_le64(header + 40, tiles_off);
+	for (int s = 0; s < RGRID_NSECTIONS; s++)
+		put_le64(header + 48 + 8 * s, sec_off[s]);
+	put_le64(header + 80, pack ? chunks_off : 0);
+	FWRITE(header, RGRID_HEADER, 1, f);
+
+	unsigned long long size = RGRID_HEADER;
+	if (!mask.empty())
+		FWRITE(&mask[0], 1, mask.size(), f);
+	size += mask.size();
+	if (!rgrid_pad(f, size))
+		return false;
+
+	vector<unsigned char> tiles(8 * (ntiles + 1));
+	for (int t = 0; t <= ntiles; t++)
+		put_le64(&tiles[8 * t], tile_start[t]);
+	FWRITE(&tiles[0], 1, tiles.size(), f);
+	size += tiles.size();
+	if (!rgrid_pad(f, size))
+		return false;
+
+	if (!chunk_table.empty()) {
+		FWRITE(&chunk_table[0], 1, chunk_table.size(), f);
+		size += chunk_table.size();
+		if (!rgrid_pad(f, size))
+			return false;
+	}
+
+	if (!rgrid_section(f, nverts, 12, pos, chunks[RGRID_SEC_POS], size))
+		return false;
+	if (use[RGRID_SEC_NORM] && !rgrid_section(f, nverts, 4, norm,
+	    chunks[RGRID_SEC_NORM], size))
+		return false;
+	if (use[RGRID_SEC_CONF] && !rgrid_section(f, nverts, 4, conf,
+	    chunks[RGRID_SEC_CONF], size))
+		return false;
+	if (use[RGRID_SEC_COLOR] && !rgrid_section(f, nverts, 3, color,
+	    chunks[RGRID_SEC_COLOR], size))
+		return false;
 	return true;
 }
 
 
+// Write the depth map of a range grid, as PFM or NPY if the name says
+// so and as raw float32 otherwise.  With write_norm, the normal map goes
+// to a second file named by normal_map_name().
+static bool write_depth(TriMesh *mesh, FILE *f, const char *filename,
+	bool write_norm)
+{
+	if (write_norm)
+		mesh->need_normals();
+	FloatImage depth, normals;
+	if (!grid_to_depth(mesh, depth, write_norm ? &normals : NULL))
+		return false;
+	if (!depth.write(f, filename))
+		return false;
+	if (!write_norm)
+		return true;
+	dprintf("\n  ");
+	return normals.write(normal_map_name(filename).c_str());
+}
+
+
 // Debugging printout, controllable by a "verbose"ness parameter, and
 // hookable for GUIs
 #undef dprintf
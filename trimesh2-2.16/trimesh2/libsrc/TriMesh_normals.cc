@@ -11,6 +11,9 @@ For meshes, uses average of per-face normals, weighted according to:
   Journal of Graphics Tools, Vol. 4, No. 2, 1999.
 unless need_normals(true) is called.
 
+For range grids that have not been triangulated, uses finite differences
+directly on the grid.
+
 For raw point clouds, fits plane to k nearest neighbors.
 */
 
@@ -120,11 +123,14 @@ static void normals_from_tstrips_area(vector<int> &tstrips,
 }
 
 
-// Compute from faces, Max-weighted
-static void normals_from_faces_Max(vector<TriMesh::Face> &faces,
-	vector<point> &vertices, vector<vec> &normals)
+// Compute from faces, Max-weighted.  Each corner's share of the face
+// normal is computed in parallel, then summed at the vertices.
+static void normals_from_faces_Max(TriMesh *mesh)
 {
+	const vector<TriMesh::Face> &faces = mesh->faces;
+	const vector<point> &vertices = mesh->vertices;
 	int nf = faces.size();
+	vector<vec> cornernormals(3 * nf);
 #pragma omp parallel for
 	for (int i = 0; i < nf; i++) {
 		const point &p0 = vertices[faces[i][0]];
@@ -135,18 +141,21 @@ static void normals_from_faces_Max(vector<TriMesh::Face> &faces,
 		if (!l2a || !l2b || !l2c)
 			continue;
 		vec facenormal = a CROSS b;
-		normals[faces[i][0]] += facenormal * (1.0f / (l2a * l2c));
-		normals[faces[i][1]] += facenormal * (1.0f / (l2b * l2a));
-		normals[faces[i][2]] += facenormal * (1.0f / (l2c * l2b));
+		cornernormals[3*i  ] = facenormal * (1.0f / (l2a * l2c));
+		cornernormals[3*i+1] = facenormal * (1.0f / (l2b * l2a));
+		cornernormals[3*i+2] = facenormal * (1.0f / (l2c * l2b));
 	}
+	mesh->sum_corners(&cornernormals[0], &mesh->normals[0]);
 }
 
 
 // Compute from faces, area-weighted
-static void normals_from_faces_area(vector<TriMesh::Face> &faces,
-	vector<point> &vertices, vector<vec> &normals)
+static void normals_from_faces_area(TriMesh *mesh)
 {
+	const vector<TriMesh::Face> &faces = mesh->faces;
+	const vector<point> &vertices = mesh->vertices;
 	int nf = faces.size();
+	vector<vec> cornernormals(3 * nf);
 #pragma omp parallel for
 	for (int i = 0; i < nf; i++) {
 		const point &p0 = vertices[faces[i][0]];
@@ -154,9 +163,146 @@ static void normals_from_faces_area(vector<TriMesh::Face> &faces,
 		const point &p2 = vertices[faces[i][2]];
 		vec a = p0 - p1, b = p1 - p2;
 		vec facenormal = a CROSS b;
-		normals[faces[i][0]] += facenormal;
-		normals[faces[i][1]] += facenormal;
-		normals[faces[i][2]] += facenormal;
+		cornernormals[3*i] = cornernormals[3*i+1] =
+			cornernormals[3*i+2] = facenormal;
+	}
+	mesh->sum_corners(&cornernormals[0], &mesh->normals[0]);
+}
+
+
+// Derivative stencils possible at a range grid vertex.  These are the
+// same as those used by the range grid formulation in mesh_opt, except
+// that a vertex with no neighbors along one direction falls back to
+// differencing along the row (or column) next to it, as its faces would.
+enum GridStencil {
+	STENCIL_NONE, // No derivative possible
+	STENCIL_LO,   // Left one-sided
+	STENCIL_HI,   // Right one-sided
+	STENCIL_TWO,  // Two-sided
+	STENCIL_ALL   // Two-sided, also using the rows (or columns) on each side
+};
+
+
+// Finite-difference derivative at grid cell i, given which of the
+// 3x3 neighborhood are neighbors (n[(dy+1)*3+(dx+1)]), the index step to
+// the next sample along the derivative direction, and the step across.
+// The stencil classification matches mesh_opt's dxdy().
+static inline vec grid_deriv(const vector<int> &grid,
+	const vector<point> &vertices, const bool *n, bool horiz,
+	int i, int along, int across)
+{
+	GridStencil s;
+	if (horiz) {
+		if (n[0] && n[2] && n[3] && n[5] && n[6] && n[8])
+			s = STENCIL_ALL;
+		else if (n[3] && n[5])
+			s = STENCIL_TWO;
+		else if (n[3])
+			s = STENCIL_LO;
+		else if (n[5])
+			s = STENCIL_HI;
+		else
+			s = STENCIL_NONE;
+	} else {
+		if (n[0] && n[6] && n[1] && n[7] && n[2] && n[8])
+			s = STENCIL_ALL;
+		else if (n[1] && n[7])
+			s = STENCIL_TWO;
+		else if (n[1])
+			s = STENCIL_LO;
+		else if (n[7])
+			s = STENCIL_HI;
+		else
+			s = STENCIL_NONE;
+	}
+
+#define G(k) vertices[grid[k]]
+	switch (s) {
+		case STENCIL_ALL:
+			return (1.0f / 12.0f) *
+				(4.0f * (G(i+along) - G(i-along)) +
+				 (G(i+along-across) - G(i-along-across)) +
+				 (G(i+along+across) - G(i-along+across)));
+		case STENCIL_TWO:
+			return 0.5f * (G(i+along) - G(i-along));
+		case STENCIL_LO:
+			return G(i) - G(i-along);
+		case STENCIL_HI:
+			return G(i+along) - G(i);
+		default:
+			break;
+	}
+
+	// n[] at offset a along and c across
+#define N(a,c) (horiz ? n[((c)+1)*3+(a)+1] : n[((a)+1)*3+(c)+1])
+	for (int c = 1; c >= -1; c -= 2) {
+		int j = i + c * across;
+		if (N(-1,c) && N(1,c))
+			return 0.5f * (G(j+along) - G(j-along));
+		else if (N(0,c) && N(1,c))
+			return G(j+along) - G(j);
+		else if (N(-1,c) && N(0,c))
+			return G(j) - G(j-along);
+	}
+	return vec();
+#undef N
+#undef G
+}
+
+
+// Compute from range grid, using finite differences.  No triangulation
+// is needed: each row only looks at the rows immediately above and below.
+// As in mesh_opt, which only differences between mesh neighbors, grid
+// neighbors that triangulate_grid() could cut apart as slivers (i.e.,
+// across a depth discontinuity) are not used.
+static void normals_from_grid(TriMesh *mesh)
+{
+	const vector<int> &grid = mesh->grid;
+	const vector<point> &vertices = mesh->vertices;
+	vector<vec> &normals = mesh->normals;
+	int w = mesh->grid_width, h = mesh->grid_height;
+	float l2thresh = mesh->grid_sliver_threshold();
+
+	// Validity mask, padded by one cell on each side so that the
+	// neighborhood lookups below need no bounds checks
+	int pw = w + 2;
+	vector<unsigned char> valid(pw * (h + 2));
+#pragma omp parallel for
+	for (int y = 0; y < h; y++) {
+		unsigned char *row = &valid[(y + 1) * pw + 1];
+		for (int x = 0; x < w; x++)
+			row[x] = mesh->grid_valid(x + y * w);
+	}
+
+#pragma omp parallel for
+	for (int y = 0; y < h; y++) {
+		const unsigned char *above = &valid[y * pw];
+		const unsigned char *here = above + pw;
+		const unsigned char *below = here + pw;
+		for (int x = 0; x < w; x++) {
+			if (!here[x+1])
+				continue;
+
+			// Which of the 3x3 neighborhood is present, and close
+			// enough to count as a neighbor?
+			int i = x + y * w;
+			bool n[9] = { !!above[x], !!above[x+1], !!above[x+2],
+			              !!here[x],  true,         !!here[x+2],
+			              !!below[x], !!below[x+1], !!below[x+2] };
+			const point &p = vertices[grid[i]];
+			for (int k = 0; k < 9; k++) {
+				if (!n[k] || k == 4)
+					continue;
+				int j = i + (k / 3 - 1) * w + (k % 3 - 1);
+				n[k] = (dist2(p, vertices[grid[j]]) < l2thresh);
+			}
+
+			vec du = grid_deriv(grid, vertices, n, true, i, 1, w);
+			vec dv = grid_deriv(grid, vertices, n, false, i, w, 1);
+
+			// Same orientation as the faces from triangulate_grid()
+			normals[grid[i]] = du CROSS dv;
+		}
 	}
 }
 
@@ -203,24 +349,25 @@ void TriMesh::need_normals(bool simple_area_weighted /* = false */)
 {
 	// Nothing to do if we already have normals
 	int nv = vertices.size();
-	if (!nv || int(normals.size()) == nv)
+	if (!nv || (int(normals.size()) == nv && current(normals_gen)))
 		return;
 
 	dprintf("Computing normals... ");
 	normals.clear();
 	normals.resize(nv);
 
-	// TODO: direct handling of grids
 	if (!tstrips.empty()) {
 		if (simple_area_weighted)
 			normals_from_tstrips_area(tstrips, vertices, normals);
 		else
 			normals_from_tstrips_Max(tstrips, vertices, normals);
+	} else if (faces.empty() && !grid.empty()) {
+		normals_from_grid(this);
 	} else if (need_faces(), !faces.empty()) {
 		if (simple_area_weighted)
-			normals_from_faces_area(faces, vertices, normals);
+			normals_from_faces_area(this);
 		else
-			normals_from_faces_Max(faces, vertices, normals);
+			normals_from_faces_Max(this);
 	} else {
 		normals_from_points(vertices, normals);
 	}
@@ -230,6 +377,7 @@ void TriMesh::need_normals(bool simple_area_weighted /* = false */)
 	for (int i = 0; i < nv; i++)
 		normalize(normals[i]);
 
+	normals_gen = geometry_gen;
 	dprintf("Done.\n");
 }
 
@@ -16,7 +16,7 @@ namespace trimesh {
 // Compute per-vertex point areas
 void TriMesh::need_pointareas()
 {
-	if (pointareas.size() == vertices.size())
+	if (pointareas.size() == vertices.size() && current(pointareas_gen))
 		return;
 	need_faces();
 
@@ -70,14 +70,13 @@ void TriMesh::need_pointareas()
 				cornerareas[i][j] = scale * (bcw[NEXT_MOD3(j)] +
 				                             bcw[PREV_MOD3(j)]);
 		}
-#pragma omp atomic
-		pointareas[faces[i][0]] += cornerareas[i][0];
-#pragma omp atomic
-		pointareas[faces[i][1]] += cornerareas[i][1];
-#pragma omp atomic
-		pointareas[faces[i][2]] += cornerareas[i][2];
 	}
 
+	// Each vertex sums the areas of its corners
+	if (nf)
+		sum_corners(&cornerareas[0][0], &pointareas[0]);
+	pointareas_gen = geometry_gen;
+
 	dprintf("Done.\n");
 }
 
@@ -25,7 +25,7 @@ float TriMesh::stat(StatOp op, StatVal val)
 			need_neighbors();
 			int nv = vertices.size();
 			for (int i = 0; i < nv; i++)
-				vals.push_back((float) neighbors[i].size());
+				vals.push_back((float) neighbors_of(i).size());
 			break;
 		}
 		case STAT_FACEAREA: {
@@ -167,16 +167,62 @@ float TriMesh::stat(StatOp op, StatVal val)
 }
 
 
+// Collect squared edge lengths from every step-th quad of a range grid
+// in each direction, mirroring the edges that triangulate_grid() would
+// create
+static void grid_edge_samples(const TriMesh *mesh, int step,
+	vector<float> &samples)
+{
+	const vector<int> &grid = mesh->grid;
+	const vector<point> &vertices = mesh->vertices;
+	int w = mesh->grid_width, h = mesh->grid_height;
+	if (w < 2 || h < 2)
+		return;
+
+	for (int j = step / 2; j < h - 1; j += step) {
+		for (int i = step / 2; i < w - 1; i += step) {
+			int ll = i + j * w, lr = ll + 1;
+			int ul = ll + w, ur = ul + 1;
+			bool vll = mesh->grid_valid(ll);
+			bool vlr = mesh->grid_valid(lr);
+			bool vul = mesh->grid_valid(ul);
+			bool vur = mesh->grid_valid(ur);
+			if (vll && vlr)
+				samples.push_back(dist2(vertices[grid[ll]],
+				                        vertices[grid[lr]]));
+			if (vll && vul)
+				samples.push_back(dist2(vertices[grid[ll]],
+				                        vertices[grid[ul]]));
+			// Diagonal: the shorter one, as in triangulate_grid()
+			float d = -1.0f;
+			if (vll && vur)
+				d = dist2(vertices[grid[ll]], vertices[grid[ur]]);
+			if (vlr && vul) {
+				float d2 = dist2(vertices[grid[lr]],
+				                 vertices[grid[ul]]);
+				if (d < 0.0f || d2 < d)
+					d = d2;
+			}
+			if (d >= 0.0f)
+				samples.push_back(d);
+		}
+	}
+}
+
+
 // Fast computation of a characteristic "feature size" for the mesh.
 // Computed as an approximation to the median edge length, or,
 // in a point cloud, the median distance from a point to its nearest neighbor.
+// Range grids that have not been triangulated yet are sampled directly.
+// The result is cached in cached_feature_size.
 float TriMesh::feature_size()
 {
+	if (cached_feature_size > 0.0f)
+		return cached_feature_size;
+
 	const int nsamples = 999;
 	const float approx_eps = 0.05f;
 	int nv = vertices.size();
-	need_faces();
-	int nf = faces.size();
 
 	vector<float> samples;
 	samples.reserve(nsamples);
@@ -186,7 +232,24 @@ float TriMesh::feature_size()
 	xorshift_rnd(0);
 
 	// Accumulate samples
-	if (nf > nsamples / 3) {
+	if (!grid.empty() && faces.empty() && tstrips.empty()) {
+		// Visit a regular lattice of about nsamples quads, each
+		// of which gives up to 3 samples.  If that misses all the
+		// valid quads of a sparse grid, visit all of them.  This path
+		// never triangulates.
+		int step = max(1, int(sqrt(float(grid_width - 1) *
+			float(grid_height - 1) / nsamples)));
+		grid_edge_samples(this, step, samples);
+		if (samples.empty() && step > 1)
+			grid_edge_samples(this, 1, samples);
+	} else {
+		need_faces();
+	}
+	int nf = faces.size();
+
+	if (!samples.empty()) {
+		// Range grid - already done
+	} else if (nf > nsamples / 3) {
 		// Big mesh - do sampling
 		while (int(samples.size()) < nsamples) {
 			int ind = uniform_rnd(nf);
@@ -225,12 +288,104 @@ float TriMesh::feature_size()
 			samples.push_back(dist2(p, point(q)));
 		}
 	}
+	if (samples.empty())
+		return 0.0f;
 
 	// Find median
 	nth_element(samples.begin(),
 	            samples.begin() + samples.size()/2,
 	            samples.end());
-	return sqrt(samples[samples.size()/2]);
+	cached_feature_size = sqrt(samples[samples.size()/2]);
+	return cached_feature_size;
+}
+
+
+// Add the memory used by a vector to an entry of a MemoryUsage
+typedef TriMesh::MemoryUsage::Entry MemoryEntry;
+
+template <class T>
+static inline void add_usage(MemoryEntry &e, const vector<T> &v)
+{
+	e.bytes += v.size() * sizeof(T);
+	e.capacity += v.capacity() * sizeof(T);
+}
+
+template <class T>
+static inline void add_usage(MemoryEntry &e, const vector< vector<T> > &v)
+{
+	e.bytes += v.size() * sizeof(vector<T>);
+	e.capacity += v.capacity() * sizeof(vector<T>);
+	for (size_t i = 0; i < v.size(); i++)
+		add_usage(e, v[i]);
+}
+
+template <class T>
+static inline MemoryEntry usage_of(const char *name, const vector<T> &v)
+{
+	MemoryEntry e = { name, 0, 0 };
+	add_usage(e, v);
+	return e;
+}
+
+
+// Per-attribute breakdown of memory use
+TriMesh::MemoryUsage TriMesh::memory_usage() const
+{
+	MemoryUsage mu;
+	vector<MemoryEntry> &m = mu.entries;
+	m.push_back(usage_of("vertices", vertices));
+	m.push_back(usage_of("faces", faces));
+	m.push_back(usage_of("tstrips", tstrips));
+	m.push_back(usage_of("grid", grid));
+	m.push_back(usage_of("colors", colors));
+	m.push_back(usage_of("confidences", confidences));
+	m.push_back(usage_of("flags", flags));
+	m.push_back(usage_of("normals", normals));
+	m.push_back(usage_of("curvatures", pdir1));
+	add_usage(m.back(), pdir2);
+	add_usage(m.back(), curv1);
+	add_usage(m.back(), curv2);
+	m.push_back(usage_of("dcurv", dcurv));
+	m.push_back(usage_of("pointareas", pointareas));
+	add_usage(m.back(), cornerareas);
+	m.push_back(usage_of("neighbors", neighbors));
+	m.push_back(usage_of("neighbors (compact)", neighbor_offsets));
+	add_usage(m.back(), neighbor_list);
+	m.push_back(usage_of("adjacentfaces", adjacentfaces));
+	m.push_back(usage_of("adjacentfaces (compact)",
+		adjacentface_offsets));
+	add_usage(m.back(), adjacentface_list);
+	m.push_back(usage_of("across_edge", across_edge));
+	m.push_back(usage_of("opposite_corners", opposite_corners));
+	add_usage(m.back(), vertex_corners);
+
+	mu.total_bytes = mu.total_capacity = sizeof(*this);
+	for (size_t i = 0; i < m.size(); i++) {
+		mu.total_bytes += m[i].bytes;
+		mu.total_capacity += m[i].capacity;
+	}
+	return mu;
+}
+
+
+// Print the attributes that use any memory, and the total
+void TriMesh::print_memory_usage(FILE *f, const char *stage) const
+{
+	MemoryUsage mu = memory_usage();
+	const double MB = 1.0 / 1048576.0;
+	if (stage)
+		fprintf(f, "Memory usage (%s):\n", stage);
+	else
+		fprintf(f, "Memory usage:\n");
+	for (size_t i = 0; i < mu.entries.size(); i++) {
+		const MemoryEntry &e = mu.entries[i];
+		if (!e.capacity)
+			continue;
+		fprintf(f, "  %-24s %9.2f MB used, %9.2f MB allocated\n",
+			e.name, e.bytes * MB, e.capacity * MB);
+	}
+	fprintf(f, "  %-24s %9.2f MB used, %9.2f MB allocated\n",
+		"total", mu.total_bytes * MB, mu.total_capacity * MB);
 }
 
 } // namespace trimesh
@@ -15,9 +15,9 @@ using namespace std;
 
 #define NO_COMP -1
 #define FOR_EACH_ADJACENT_FACE(mesh,v,f) \
-	for (size_t f_ind = 0, f = mesh->adjacentfaces[v][0]; \
-	     (f_ind < mesh->adjacentfaces[v].size()) && \
-	     ((f = mesh->adjacentfaces[v][f_ind]) || 1); \
+	for (size_t f_ind = 0, f = mesh->adjacentfaces_of(v)[0]; \
+	     (f_ind < mesh->adjacentfaces_of(v).size()) && \
+	     ((f = mesh->adjacentfaces_of(v)[f_ind]) || 1); \
 	     f_ind++)
 
 
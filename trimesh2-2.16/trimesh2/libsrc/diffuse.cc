@@ -8,6 +8,7 @@ Smoothing of meshes and per-vertex fields
 
 #include "TriMesh.h"
 #include "TriMesh_algo.h"
+#include "Arena.h"
 #include "timestamp.h"
 using namespace std;
 #define dprintf TriMesh::dprintf
@@ -31,10 +32,10 @@ static inline float wt(const TriMesh *themesh, int v1, int v2, float invsigma2)
 
 
 // Functor classes for adding scalar, vector, or tensor fields on the surface
-template <class T>
+template <class T, class A = allocator<T> >
 struct AccumVec {
-	const vector<T> &field;
-	AccumVec(const vector<T> &field_) : field(field_)
+	const vector<T,A> &field;
+	AccumVec(const vector<T,A> &field_) : field(field_)
 		{}
 	inline void operator() (const TriMesh *, int /* v0 */, T &f,
 				float w, int v) const
@@ -71,14 +72,17 @@ struct AccumDCurv {
 
 
 // Diffuse a vector field at 1 vertex, weighted by
-// a Gaussian of width 1/sqrt(invsigma2)
+// a Gaussian of width 1/sqrt(invsigma2).  flags and boundary are
+// per-thread scratch space, reused from one vertex to the next.
 template <class ACCUM, class T>
 static void diffuse_vert_field(TriMesh *themesh,
                                vector<unsigned> &flags, unsigned &flag_curr,
+                               vector<int> &boundary,
                                const ACCUM &accum, int v, float invsigma2,
                                T &flt)
 {
-	if (themesh->neighbors[v].empty()) {
+	TriMesh::IndexList nbrs = themesh->neighbors_of(v);
+	if (nbrs.empty()) {
 		flt = T();
 		accum(themesh, v, flt, 1.0f, v);
 		return;
@@ -91,7 +95,7 @@ static void diffuse_vert_field(TriMesh *themesh,
 
 	flag_curr++;
 	flags[v] = flag_curr;
-	vector<int> boundary = themesh->neighbors[v];
+	boundary.assign(nbrs.begin(), nbrs.end());
 	while (!boundary.empty()) {
 		int n = boundary.back();
 		boundary.pop_back();
@@ -111,8 +115,9 @@ static void diffuse_vert_field(TriMesh *themesh,
 		// Accumulate weight times field at neighbor
 		accum(themesh, v, flt, w, n);
 		sum_w += w;
-		for (size_t i = 0; i < themesh->neighbors[n].size(); i++) {
-			int nn = themesh->neighbors[n][i];
+		TriMesh::IndexList nn_list = themesh->neighbors_of(n);
+		for (size_t i = 0; i < nn_list.size(); i++) {
+			int nn = nn_list[i];
 			if (flags[nn] == flag_curr)
 				continue;
 			boundary.push_back(nn);
@@ -142,25 +147,30 @@ void smooth_mesh(TriMesh *themesh, float sigma)
 
 	float invsigma2 = 1.0f / sqr(sigma);
 
-	vector<point> dflt(nv), dflt2(nv);
+	vector< point, ArenaAllocator<point> > dflt(nv), dflt2(nv);
 #pragma omp parallel
 	{
 		// Thread-local flags
 		vector<unsigned> flags(nv);
 		unsigned flag_curr = 0;
+		vector<int> boundary;
 
 		// Main filtering step
 #pragma omp for
 		for (int i = 0; i < nv; i++) {
-			diffuse_vert_field(themesh, flags, flag_curr,
+			diffuse_vert_field(themesh, flags, flag_curr, boundary,
 				AccumVec<vec>(themesh->vertices),
 				i, invsigma2, dflt[i]);
 			// Just keep the displacement
 			dflt[i] -= themesh->vertices[i];
 		}
+	} // #pragma omp parallel
 
-		// Slightly better small-neighborhood approximation
-#pragma omp for
+	// Slightly better small-neighborhood approximation.  Each corner's
+	// share is computed in parallel, then summed into its vertex.
+	{
+		vector< vec, ArenaAllocator<vec> > dcorner(3 * nf);
+#pragma omp parallel for
 		for (int i = 0; i < nf; i++) {
 			point c = (themesh->vertices[themesh->faces[i][0]] +
 			           themesh->vertices[themesh->faces[i][1]] +
@@ -169,17 +179,28 @@ void smooth_mesh(TriMesh *themesh, float sigma)
 			for (int j = 0; j < 3; j++) {
 				int v = themesh->faces[i][j];
 				vec d = 0.5f * (c - themesh->vertices[v]);
-				dflt[v] += themesh->cornerareas[i][j] /
-				           themesh->pointareas[themesh->faces[i][j]] *
-				           exp(-0.5f * invsigma2 * len2(d)) * d;
+				float w = themesh->cornerareas[i][j] /
+				          themesh->pointareas[v] *
+				          exp(-0.5f * invsigma2 * len2(d));
+				dcorner[3 * i + j] = w * d;
 			}
 		}
+		if (nf)
+			themesh->sum_corners(&dcorner[0], &dflt[0]);
+	}
+
+#pragma omp parallel
+	{
+		// Thread-local flags, again
+		vector<unsigned> flags(nv);
+		unsigned flag_curr = 0;
+		vector<int> boundary;
 
 		// Filter displacement field
 #pragma omp for
 		for (int i = 0; i < nv; i++) {
-			diffuse_vert_field(themesh, flags, flag_curr,
-				AccumVec<point>(dflt),
+			diffuse_vert_field(themesh, flags, flag_curr, boundary,
+				AccumVec< point, ArenaAllocator<point> >(dflt),
 				i, invsigma2, dflt2[i]);
 		}
 
@@ -188,6 +209,7 @@ void smooth_mesh(TriMesh *themesh, float sigma)
 		for (int i = 0; i < nv; i++)
 			themesh->vertices[i] += dflt[i] - dflt2[i]; // second Laplacian
 	} // #pragma omp parallel
+	themesh->changed_geometry();
 
 	dprintf("Done.  Filtering took %f sec.\n", now() - t);
 }
@@ -196,9 +218,10 @@ void smooth_mesh(TriMesh *themesh, float sigma)
 // Filter a vertex using the method of [Jones et al. 2003]
 static void jones_filter(TriMesh *themesh,
                          vector<unsigned> &flags, unsigned &flag_curr,
+                         vector<int> &boundary,
                          int v,
                          float invsigma2_1, float invsigma2_2,
-                         vector<point> &oldverts)
+                         const point *oldverts)
 {
 	const point p = oldverts[v];
 	const vec norm = themesh->normals[v];
@@ -208,7 +231,7 @@ static void jones_filter(TriMesh *themesh,
 	float sum_w = 0.0f;
 
 	flag_curr++;
-	vector<int> boundary;
+	boundary.clear();
 	boundary.push_back(v);
 	while (!boundary.empty()) {
 		int n = boundary.back();
@@ -230,8 +253,9 @@ static void jones_filter(TriMesh *themesh,
 		flt += w * prediction;
 		sum_w += w;
 
-		for (size_t i = 0; i < themesh->neighbors[n].size(); i++) {
-			int nn = themesh->neighbors[n][i];
+		TriMesh::IndexList nn_list = themesh->neighbors_of(n);
+		for (size_t i = 0; i < nn_list.size(); i++) {
+			int nn = nn_list[i];
 			if (flags[nn] == flag_curr)
 				continue;
 			boundary.push_back(nn);
@@ -258,20 +282,23 @@ void bilateral_smooth_mesh(TriMesh *themesh, float sigma1, float sigma2)
 	float invsigma2_1 = 1.0f / sqr(sigma1);
 	float invsigma2_2 = 1.0f / sqr(sigma2);
 
-	vector<point> oldverts(themesh->vertices);
+	vector< point, ArenaAllocator<point> > oldverts(
+		themesh->vertices.begin(), themesh->vertices.end());
 #pragma omp parallel
 	{
 		// Thread-local flags
 		vector<unsigned> flags(nv);
 		unsigned flag_curr = 0;
+		vector<int> boundary;
 
 #pragma omp for
 		for (int i = 0; i < nv; i++)
-			jones_filter(themesh, flags, flag_curr,
-				i, invsigma2_1, invsigma2_2, oldverts);
+			jones_filter(themesh, flags, flag_curr, boundary,
+				i, invsigma2_1, invsigma2_2, &oldverts[0]);
 	}
 
 	dprintf("Done.  Filtering took %f sec.\n", now() - t);
+	themesh->changed_geometry();
 	themesh->normals.clear();
 	if (had_normals)
 		themesh->need_normals();
@@ -292,21 +319,22 @@ void diffuse_vector(TriMesh *themesh, std::vector<T> &field, float sigma)
 
 	float invsigma2 = 1.0f / sqr(sigma);
 
-	vector<T> flt(nv);
+	vector< T, ArenaAllocator<T> > flt(nv);
 	AccumVec<T> a(field);
 #pragma omp parallel
 	{
 		// Thread-local flags
 		vector<unsigned> flags(nv);
 		unsigned flag_curr = 0;
+		vector<int> boundary;
 
 #pragma omp for
 		for (int i = 0; i < nv; i++)
-			diffuse_vert_field(themesh, flags, flag_curr,
+			diffuse_vert_field(themesh, flags, flag_curr, boundary,
 				a, i, invsigma2, flt[i]);
 	} // #pragma omp parallel
 
-	field = flt;
+	field.assign(flt.begin(), flt.end());
 
 	dprintf("Done.  Filtering took %f sec.\n", now() - t);
 }
@@ -325,23 +353,25 @@ void diffuse_normals(TriMesh *themesh, float sigma)
 
 	float invsigma2 = 1.0f / sqr(sigma);
 
-	vector<vec> nflt(nv);
+	vector< vec, ArenaAllocator<vec> > nflt(nv);
 	AccumVec<vec> a(themesh->normals);
 #pragma omp parallel
 	{
 		// Thread-local flags
 		vector<unsigned> flags(nv);
 		unsigned flag_curr = 0;
+		vector<int> boundary;
 
 #pragma omp for
 		for (int i = 0; i < nv; i++) {
-			diffuse_vert_field(themesh, flags, flag_curr,
+			diffuse_vert_field(themesh, flags, flag_curr, boundary,
 				a, i, invsigma2, nflt[i]);
 			normalize(nflt[i]);
 		}
 	} // #pragma omp parallel
 
-	themesh->normals = nflt;
+	themesh->normals.assign(nflt.begin(), nflt.end());
+	themesh->normals_gen = 0;
 
 	dprintf("Done.  Filtering took %f sec.\n", now() - t);
 }
@@ -361,16 +391,17 @@ void diffuse_curv(TriMesh *themesh, float sigma)
 
 	float invsigma2 = 1.0f / sqr(sigma);
 
-	vector<vec> cflt(nv);
+	vector< vec, ArenaAllocator<vec> > cflt(nv);
 #pragma omp parallel
 	{
 		// Thread-local flags
 		vector<unsigned> flags(nv);
 		unsigned flag_curr = 0;
+		vector<int> boundary;
 
 #pragma omp for
 		for (int i = 0; i < nv; i++)
-			diffuse_vert_field(themesh, flags, flag_curr,
+			diffuse_vert_field(themesh, flags, flag_curr, boundary,
 				AccumCurv(), i, invsigma2, cflt[i]);
 
 #pragma omp for
@@ -401,20 +432,21 @@ void diffuse_dcurv(TriMesh *themesh, float sigma)
 
 	float invsigma2 = 1.0f / sqr(sigma);
 
-	vector< Vec<4> > dflt(nv);
+	vector< Vec<4>, ArenaAllocator< Vec<4> > > dflt(nv);
 #pragma omp parallel
 	{
 		// Thread-local flags
 		vector<unsigned> flags(nv);
 		unsigned flag_curr = 0;
+		vector<int> boundary;
 
 #pragma omp for
 		for (int i = 0; i < nv; i++)
-			diffuse_vert_field(themesh, flags, flag_curr,
+			diffuse_vert_field(themesh, flags, flag_curr, boundary,
 				AccumDCurv(), i, invsigma2, dflt[i]);
 	} // #pragma omp parallel
 
-	themesh->dcurv = dflt;
+	themesh->dcurv.assign(dflt.begin(), dflt.end());
 	dprintf("Done.  Filtering took %f sec.\n", now() - t);
 }
 
@@ -170,6 +170,13 @@ void edgeflip(TriMesh *mesh)
 		}
 	}
 
+	// across_edge has been kept up to date, but the rest of the
+	// connectivity has not
+	mesh->clear_neighbors();
+	mesh->clear_adjacentfaces();
+	mesh->clear_opposite_corners();
+	mesh->changed_geometry();
+
 	dprintf("Done.\n");
 }
 
@@ -19,12 +19,14 @@ void faceflip(TriMesh *mesh)
 	bool had_tstrips = !mesh->tstrips.empty();
 	mesh->need_faces();
 	mesh->tstrips.clear();
+	mesh->clear_across_edge();
 
 	dprintf("Flipping faces... ");
 	int nf = mesh->faces.size();
 #pragma omp parallel for
 	for (int i = 0; i < nf; i++)
 		swap(mesh->faces[i][0], mesh->faces[i][2]);
+	mesh->changed_geometry();
 	dprintf("Done.\n");
 
 	if (had_tstrips)
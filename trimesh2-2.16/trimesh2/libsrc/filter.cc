@@ -34,37 +34,100 @@ void inflate(TriMesh *mesh, float amount)
 	for (int i = 0; i < nv; i++)
 		mesh->vertices[i] += amount * mesh->normals[i];
 	dprintf("Done.\n");
-	mesh->bbox.valid = false;
-	mesh->bsphere.valid = false;
+	mesh->changed_geometry();
 }
 
 
-// Transform the mesh by the given matrix
-void apply_xform(TriMesh *mesh, const xform &xf)
+// Transform (x, y, z) by the matrix m, doing the same arithmetic as xf * p.
+// If the bottom row of m is (0 0 0 1), the homogeneous divide is by exactly
+// 1, and AFFINE skips it.  UNIT normalizes the result the same way as
+// normalize().  There are no branches, so loops over this can vectorize.
+template <bool AFFINE, bool UNIT>
+static inline void xform_xyz(const double *m, float &x, float &y, float &z)
 {
-	int nv = mesh->vertices.size();
+	double v0 = x, v1 = y, v2 = z;
+	double h = AFFINE ? 1.0 :
+		1 / (m[3] * v0 + m[7] * v1 + m[11] * v2 + m[15]);
+	x = float(h * (m[0] * v0 + m[4] * v1 + m[8]  * v2 + m[12]));
+	y = float(h * (m[1] * v0 + m[5] * v1 + m[9]  * v2 + m[13]));
+	z = float(h * (m[2] * v0 + m[6] * v1 + m[10] * v2 + m[14]));
+	if (UNIT) {
+		float l = sqrt(sqr(x) + sqr(y) + sqr(z));
+		bool ok = (l > 0);
+		float il = 1 / l;
+		x = ok ? x * il : 0;
+		y = ok ? y * il : 0;
+		z = ok ? z * il : 1;
+	}
+}
 
-#pragma omp parallel for
-	for (int i = 0; i < nv; i++)
-		mesh->vertices[i] = xf * mesh->vertices[i];
 
-	if (!mesh->normals.empty()) {
-		xform nxf = norm_xf(xf);
+// Transform a vector of points or normals.  The compiler can vectorize
+// this.
+template <bool AFFINE, bool UNIT>
+static void xform_aos(const double *m, vector<vec> &v)
+{
+	int n = v.size();
 #pragma omp parallel for
-		for (int i = 0; i < nv; i++) {
-			mesh->normals[i] = nxf * mesh->normals[i];
-			normalize(mesh->normals[i]);
+	for (int i = 0; i < n; i++)
+		xform_xyz<AFFINE,UNIT>(m, v[i][0], v[i][1], v[i][2]);
+}
+
+
+// Transform vertices or normals, using the cheaper loop if the matrix
+// is affine
+template <bool UNIT>
+static void xform_all(const xform &xf, vector<vec> &v)
+{
+	const double *m = &xf[0];
+	bool affine = (m[3] == 0 && m[7] == 0 && m[11] == 0 && m[15] == 1);
+	if (affine)
+		xform_aos<true,UNIT>(m, v);
+	else
+		xform_aos<false,UNIT>(m, v);
+}
+
+
+// Is xf a rotation plus translation (up to roundoff)?
+static bool is_rigid(const xform &xf)
+{
+	if (xf[3] != 0 || xf[7] != 0 || xf[11] != 0 || xf[15] != 1)
+		return false;
+	const double eps = 1.0e-6;
+	for (int i = 0; i < 3; i++) {
+		for (int j = i; j < 3; j++) {
+			double d = xf[4*i] * xf[4*j] + xf[4*i+1] * xf[4*j+1] +
+			           xf[4*i+2] * xf[4*j+2];
+			if (fabs(d - (i == j ? 1.0 : 0.0)) > eps)
+				return false;
 		}
 	}
+	return true;
+}
 
-	if (mesh->bbox.valid) {
-		mesh->bbox.valid = false;
+
+// Transform the mesh by the given matrix.  Normals that were up to date
+// stay that way, as do point areas if the transformation is rigid.
+void apply_xform(TriMesh *mesh, const xform &xf)
+{
+	unsigned gen = mesh->geometry_gen;
+	bool normals_current = (mesh->normals_gen == gen);
+	bool pointareas_current = (mesh->pointareas_gen == gen) &&
+		is_rigid(xf);
+	xform_all<false>(xf, mesh->vertices);
+	if (!mesh->normals.empty())
+		xform_all<true>(norm_xf(xf), mesh->normals);
+
+	mesh->changed_geometry();
+	if (normals_current)
+		mesh->normals_gen = mesh->geometry_gen;
+	if (pointareas_current)
+		mesh->pointareas_gen = mesh->geometry_gen;
+	if (mesh->bbox.valid)
 		mesh->need_bbox();
-	}
-	if (mesh->bsphere.valid) {
-		mesh->bsphere.valid = false;
+	if (mesh->bsphere.valid)
 		mesh->need_bsphere();
-	}
+	mesh->clear_feature_size();
 }
 
 
@@ -397,7 +460,7 @@ void orient(TriMesh *mesh)
 			for (int j = 0; j < 3; j++) {
 				int v0 = mesh->faces[f][j];
 				int v1 = mesh->faces[f][NEXT_MOD3(j)];
-				const vector<int> &a = mesh->adjacentfaces[v0];
+				TriMesh::IndexList a = mesh->adjacentfaces_of(v0);
 				for (size_t k = 0; k < a.size(); k++) {
 					int f1 = a[k];
 					if (mesh->flags[f1] != NONE)
@@ -433,7 +496,7 @@ void orient(TriMesh *mesh)
 		else
 			if (v2[0] > v0[0]) j = 2;
 		int v = mesh->faces[f][j];
-		const vector<int> &a = mesh->adjacentfaces[v];
+		TriMesh::IndexList a = mesh->adjacentfaces_of(v);
 		vec n;
 		for (size_t k = 0; k < a.size(); k++) {
 			int f1 = a[k];
@@ -450,6 +513,8 @@ void orient(TriMesh *mesh)
 		if (cc_flip[mesh->flags[i]])
 			swap(mesh->faces[i][1], mesh->faces[i][2]);
 	}
+	mesh->clear_across_edge();
+	mesh->changed_geometry();
 	dprintf("Done.\n");
 }
 
@@ -476,9 +541,10 @@ void noisify(TriMesh *mesh, float amount)
 	for (int i = 0; i < nv; i++) {
 		point &v = mesh->vertices[i];
 		// Tangential
-		int nn = mesh->neighbors[i].size();
+		TriMesh::IndexList nbrs = mesh->neighbors_of(i);
+		int nn = nbrs.size();
 		for (int j = 0; j < nn; j++) {
-			const point &n = mesh->vertices[mesh->neighbors[i][j]];
+			const point &n = mesh->vertices[nbrs[j]];
 			float scale = amount / (amount + len(n-v));
 			disp[i] += uniform_rnd(scale) * (n-v);
 		}
@@ -489,6 +555,7 @@ void noisify(TriMesh *mesh, float amount)
 	}
 	for (int i = 0; i < nv; i++)
 		mesh->vertices[i] += disp[i];
+	mesh->changed_geometry();
 }
 
 } // namespace trimesh
@@ -0,0 +1,475 @@
+/*
+trimesh2 contributors
+Added to this tree; not part of the upstream trimesh2 distribution.
+
+grid_diffuse.cc
+Smoothing of range grids and per-vertex fields on them.
+
+Field smoothing uses a mask-aware Gaussian pyramid (normalized
+convolution: values are carried premultiplied by a validity weight),
+so the cost is O(N) for any sigma.  The pyramid is descended for as
+many levels as fit within the requested sigma, the remainder is
+applied at the coarsest level with a small separable Gaussian, and the
+result is interpolated back up to the full grid.  Each connected
+component of the grid (as the triangulation would connect it, without
+crossing depth discontinuities) gets a pyramid of its own.
+
+Bilateral smoothing of the geometry follows [Jones et al. 2003], as in
+bilateral_smooth_mesh(), but over a window of grid cells instead of a
+breadth-first search through the mesh.
+*/
+
+#include "TriMesh.h"
+#include "TriMesh_algo.h"
+#include "timestamp.h"
+using namespace std;
+#define dprintf TriMesh::dprintf
+
+
+namespace trimesh {
+
+// One level of the pyramid: field values premultiplied by weight
+template <class T>
+struct PyrLevel {
+	int w, h;
+	vector<T> val;
+	vector<float> wgt;
+
+	PyrLevel() : w(0), h(0)
+		{}
+	void resize(int w_, int h_)
+	{
+		w = w_; h = h_;
+		val.assign(w * h, T());
+		wgt.assign(w * h, 0.0f);
+	}
+};
+
+
+// A connected component of the grid: its bounding box, inclusive, and
+// the number of cells in it
+struct GridComponent {
+	int x0, y0, x1, y1, count;
+
+	GridComponent(int x, int y) : x0(x), y0(y), x1(x), y1(y), count(1)
+		{}
+	void add(int x, int y)
+	{
+		x0 = min(x0, x); y0 = min(y0, y);
+		x1 = max(x1, x); y1 = max(y1, y);
+		count++;
+	}
+	int area() const
+		{ return (x1 - x0 + 1) * (y1 - y0 + 1); }
+};
+
+
+// 5-tap binomial filter (variance 1)
+static const float binom[5] = { 0.0625f, 0.25f, 0.375f, 0.25f, 0.0625f };
+
+
+// Separable 1D filtering of a pyramid level, with output decimated by
+// "step".  Samples outside the grid contribute nothing.
+template <class T>
+static void filter_rows(const PyrLevel<T> &in, PyrLevel<T> &out,
+	const float *kernel, int radius, int step)
+{
+	int w = in.w, h = in.h;
+	int ow = (w + step - 1) / step;
+	out.resize(ow, h);
+
+#pragma omp parallel for
+	for (int y = 0; y < h; y++) {
+		const T *inval = &in.val[y * w];
+		const float *inwgt = &in.wgt[y * w];
+		T *outval = &out.val[y * ow];
+		float *outwgt = &out.wgt[y * ow];
+		for (int x = 0; x < ow; x++) {
+			int c = x * step;
+			int k0 = max(-radius, -c), k1 = min(radius, w - 1 - c);
+			T v = T();
+			float wt = 0.0f;
+			for (int k = k0; k <= k1; k++) {
+				v += kernel[k + radius] * inval[c + k];
+				wt += kernel[k + radius] * inwgt[c + k];
+			}
+			outval[x] = v;
+			outwgt[x] = wt;
+		}
+	}
+}
+
+template <class T>
+static void filter_cols(const PyrLevel<T> &in, PyrLevel<T> &out,
+	const float *kernel, int radius, int step)
+{
+	int w = in.w, h = in.h;
+	int oh = (h + step - 1) / step;
+	out.resize(w, oh);
+
+	// Go a row at a time, so that the inner loop runs over contiguous data
+#pragma omp parallel for
+	for (int y = 0; y < oh; y++) {
+		int c = y * step;
+		int k0 = max(-radius, -c), k1 = min(radius, h - 1 - c);
+		T *outval = &out.val[y * w];
+		float *outwgt = &out.wgt[y * w];
+		for (int k = k0; k <= k1; k++) {
+			float kw = kernel[k + radius];
+			const T *inval = &in.val[(c + k) * w];
+			const float *inwgt = &in.wgt[(c + k) * w];
+			for (int x = 0; x < w; x++) {
+				outval[x] += kw * inval[x];
+				outwgt[x] += kw * inwgt[x];
+			}
+		}
+	}
+}
+
+
+// Label the valid cells of the grid by connected component, linking each
+// cell to those of its 8 neighbors closer than the sliver threshold of
+// triangulate_grid().  So, like the triangulated grid, components do not
+// reach across depth discontinuities.  Invalid cells are labeled -1.
+// Returns the number of components, and fills in their bounding boxes.
+static int label_components(const TriMesh *themesh, vector<int> &label,
+	vector<GridComponent> &comps)
+{
+	const vector<int> &grid = themesh->grid;
+	const vector<point> &vertices = themesh->vertices;
+	int w = themesh->grid_width, h = themesh->grid_height;
+	int ngrid = w * h;
+	float l2thresh = themesh->grid_sliver_threshold();
+
+	// Which of the right, lower-left, lower, and lower-right neighbors
+	// each cell links to (bits 0-3)
+	vector<unsigned char> links(ngrid);
+#pragma omp parallel for
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			int i = x + y * w;
+			if (!themesh->grid_valid(i))
+				continue;
+			const point &p = vertices[grid[i]];
+			int j[4] = { i + 1, i + w - 1, i + w, i + w + 1 };
+			bool ok[4] = { x + 1 < w, x > 0 && y + 1 < h,
+			               y + 1 < h, x + 1 < w && y + 1 < h };
+			unsigned char l = 0;
+			for (int k = 0; k < 4; k++) {
+				if (ok[k] && themesh->grid_valid(j[k]) &&
+				    dist2(p, vertices[grid[j[k]]]) < l2thresh)
+					l |= (unsigned char) (1 << k);
+			}
+			links[i] = l;
+		}
+	}
+
+	// Union-find, with each set represented by its lowest cell
+	label.resize(ngrid);
+	for (int i = 0; i < ngrid; i++)
+		label[i] = themesh->grid_valid(i) ? i : -1;
+	for (int i = 0; i < ngrid; i++) {
+		if (!links[i])
+			continue;
+		int d[4] = { 1, w - 1, w, w + 1 };
+		for (int k = 0; k < 4; k++) {
+			if (!(links[i] & (1 << k)))
+				continue;
+			int a = i, b = i + d[k];
+			while (label[a] != a)
+				a = label[a] = label[label[a]];
+			while (label[b] != b)
+				b = label[b] = label[label[b]];
+			if (a < b)
+				label[b] = a;
+			else if (b < a)
+				label[a] = b;
+		}
+	}
+
+	// Number the components, in order of their lowest cell
+	comps.clear();
+	for (int i = 0; i < ngrid; i++) {
+		if (label[i] < 0)
+			continue;
+		int x = i % w, y = i / w;
+		if (label[i] == i) {
+			label[i] = comps.size();
+			comps.push_back(GridComponent(x, y));
+			continue;
+		}
+		// The root is lower, so it has already been numbered
+		int c = label[label[i]];
+		label[i] = c;
+		comps[c].add(x, y);
+	}
+	return comps.size();
+}
+
+
+// Diffuse the field over one component of the grid, within its bounding
+// box.  Cells of other components are treated like invalid ones.
+template <class T>
+static void diffuse_component(const TriMesh *themesh, vector<T> &field,
+	float sigma, const vector<int> &label, int c, const GridComponent &comp)
+{
+	const vector<int> &grid = themesh->grid;
+	int gw = themesh->grid_width;
+	int x0 = comp.x0, y0 = comp.y0;
+	int w = comp.x1 - x0 + 1, h = comp.y1 - y0 + 1;
+
+	// How many levels to descend?  After L levels, the binomial filters
+	// have accumulated variance (4^L - 1) / 3, and linear interpolation
+	// back up to the full grid will add another 4^L / 6.
+	float sigma2 = sqr(sigma);
+	int nlevels = 0;
+	while (true) {
+		float scale = float(1 << (nlevels + 1));
+		if ((sqr(scale) - 1.0f) / 3.0f + sqr(scale) / 6.0f > sigma2)
+			break;
+		if ((w >> (nlevels + 1)) < 2 || (h >> (nlevels + 1)) < 2)
+			break;
+		nlevels++;
+	}
+	float scale = float(1 << nlevels);
+	float acc2 = (sqr(scale) - 1.0f) / 3.0f;
+	if (nlevels)
+		acc2 += sqr(scale) / 6.0f;
+	float resid = sqrt(max(sigma2 - acc2, 0.0f)) / scale;
+
+	// Base level
+	PyrLevel<T> level, tmp;
+	level.resize(w, h);
+#pragma omp parallel for
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			int i = (x0 + x) + (y0 + y) * gw;
+			if (label[i] != c)
+				continue;
+			level.val[x + y * w] = field[grid[i]];
+			level.wgt[x + y * w] = 1.0f;
+		}
+	}
+
+	// Descend
+	for (int l = 0; l < nlevels; l++) {
+		filter_rows(level, tmp, binom, 2, 2);
+		filter_cols(tmp, level, binom, 2, 2);
+	}
+
+	// Remaining blur at the coarsest level
+	if (resid > 0.0f) {
+		int radius = int(ceil(3.0f * resid));
+		vector<float> kernel(2 * radius + 1);
+		float sum = 0.0f;
+		for (int k = -radius; k <= radius; k++)
+			sum += kernel[k + radius] = exp(-0.5f * sqr(k / resid));
+		for (int k = 0; k <= 2 * radius; k++)
+			kernel[k] /= sum;
+		filter_rows(level, tmp, &kernel[0], radius, 1);
+		filter_cols(tmp, level, &kernel[0], radius, 1);
+	}
+
+	// Interpolate back up to the cells of the component
+	int lw = level.w, lh = level.h;
+	float invscale = 1.0f / scale;
+#pragma omp parallel for
+	for (int y = 0; y < h; y++) {
+		float fy = y * invscale;
+		int ly0 = min(int(fy), lh - 1), ly1 = min(ly0 + 1, lh - 1);
+		float ay = fy - ly0;
+		for (int x = 0; x < w; x++) {
+			int i = (x0 + x) + (y0 + y) * gw;
+			if (label[i] != c)
+				continue;
+			float fx = x * invscale;
+			int lx0 = min(int(fx), lw - 1), lx1 = min(lx0 + 1, lw - 1);
+			float ax = fx - lx0;
+			float w00 = (1.0f - ax) * (1.0f - ay), w01 = ax * (1.0f - ay);
+			float w10 = (1.0f - ax) * ay, w11 = ax * ay;
+			int i00 = lx0 + ly0 * lw, i01 = lx1 + ly0 * lw;
+			int i10 = lx0 + ly1 * lw, i11 = lx1 + ly1 * lw;
+			float wt = w00 * level.wgt[i00] + w01 * level.wgt[i01] +
+			           w10 * level.wgt[i10] + w11 * level.wgt[i11];
+			if (wt <= 0.0f)
+				continue;
+			field[grid[i]] = (1.0f / wt) *
+				(w00 * level.val[i00] + w01 * level.val[i01] +
+				 w10 * level.val[i10] + w11 * level.val[i11]);
+		}
+	}
+}
+
+
+// Diffuse an arbitrary per-vertex field on a range grid, with a Gaussian
+// of width sigma (in grid cells).  Each connected component of the grid
+// is smoothed separately, so values do not leak across depth
+// discontinuities any more than they do in diffuse_vector().
+template <class T>
+void diffuse_grid_vector(TriMesh *themesh, vector<T> &field, float sigma)
+{
+	int w = themesh->grid_width, h = themesh->grid_height;
+	if (themesh->grid.empty() || w <= 0 || h <= 0 || !(sigma > 0.0f) ||
+	    field.size() != themesh->vertices.size())
+		return;
+
+	dprintf("\rSmoothing grid field... ");
+	timestamp t = now();
+
+	vector<int> label;
+	vector<GridComponent> comps;
+	int ncomps = label_components(themesh, label, comps);
+
+	// Big components are done one at a time, with the pyramid code
+	// itself running in parallel, and the rest in parallel with
+	// each other.  Single cells are left as they are.
+	const int big_area = 65536;
+	for (int c = 0; c < ncomps; c++) {
+		if (comps[c].area() >= big_area)
+			diffuse_component(themesh, field, sigma, label, c,
+				comps[c]);
+	}
+#pragma omp parallel for schedule(dynamic)
+	for (int c = 0; c < ncomps; c++) {
+		if (comps[c].count > 1 && comps[c].area() < big_area)
+			diffuse_component(themesh, field, sigma, label, c,
+				comps[c]);
+	}
+
+	dprintf("Done.  Filtering took %f sec.\n", now() - t);
+}
+
+
+// Diffuse the normals on a range grid
+void diffuse_grid_normals(TriMesh *themesh, float sigma)
+{
+	themesh->need_normals();
+	diffuse_grid_vector(themesh, themesh->normals, sigma);
+
+	int nv = themesh->normals.size();
+#pragma omp parallel for
+	for (int i = 0; i < nv; i++)
+		normalize(themesh->normals[i]);
+	themesh->normals_gen = 0;
+}
+
+
+// Same approximation to a Gaussian as in diffuse.cc, given d^2 / sigma^2
+static inline float wt(float d2)
+{
+	return (d2 >= 6.25f) ? 0.0f : 1.0f - d2 * (0.32f - d2 * 0.0256f);
+}
+
+
+// Bilateral smoothing of a range grid using the method of [Jones et al. 2003]
+void bilateral_smooth_grid(TriMesh *themesh, float sigma1, float sigma2)
+{
+	int w = themesh->grid_width, h = themesh->grid_height;
+	if (themesh->grid.empty() || w <= 0 || h <= 0)
+		return;
+
+	bool had_normals = !themesh->normals.empty();
+	themesh->need_normals();
+
+	// Window size, in grid cells
+	float cellsize = themesh->feature_size();
+	if (!(cellsize > 0.0f))
+		return;
+	int r = int(ceil(2.5f * sigma1 / cellsize));
+
+	diffuse_grid_normals(themesh, 0.5f * sigma1 / cellsize);
+
+	dprintf("\rSmoothing grid... ");
+	timestamp t = now();
+
+	float invsigma2_1 = 1.0f / sqr(sigma1);
+	float invsigma2_2 = 1.0f / sqr(sigma2);
+
+	// Positions in structure-of-arrays grid layout, with a zero weight
+	// at invalid cells, so the inner loop below needs no branches
+	const vector<int> &grid = themesh->grid;
+	int ngrid = w * h;
+	vector<float> px(ngrid), py(ngrid), pz(ngrid), valid(ngrid);
+#pragma omp parallel for
+	for (int i = 0; i < ngrid; i++) {
+		if (!themesh->grid_valid(i))
+			continue;
+		const point &p = themesh->vertices[grid[i]];
+		px[i] = p[0]; py[i] = p[1]; pz[i] = p[2];
+		valid[i] = 1.0f;
+	}
+
+	// Work in square tiles, so the window rows stay in cache
+	const int tilesize = 64;
+	int ntx = (w + tilesize - 1) / tilesize;
+	int nty = (h + tilesize - 1) / tilesize;
+#pragma omp parallel for schedule(dynamic)
+	for (int tile = 0; tile < ntx * nty; tile++) {
+		int tx0 = (tile % ntx) * tilesize, ty0 = (tile / ntx) * tilesize;
+		int tx1 = min(tx0 + tilesize, w), ty1 = min(ty0 + tilesize, h);
+		for (int y = ty0; y < ty1; y++) {
+			for (int x = tx0; x < tx1; x++) {
+				int i = x + y * w;
+				if (!valid[i])
+					continue;
+				const float p0 = px[i], p1 = py[i], p2 = pz[i];
+				const vec &norm = themesh->normals[grid[i]];
+				const float n0 = norm[0], n1 = norm[1], n2 = norm[2];
+
+				// Accumulate sum of w * q and sum of w * dn, where
+				// the prediction for p from q is q + dn * norm
+				float sw = 0.0f, sq0 = 0.0f, sq1 = 0.0f, sq2 = 0.0f;
+				float sdn = 0.0f;
+				int x0 = max(x - r, 0), x1 = min(x + r, w - 1);
+				int y0 = max(y - r, 0), y1 = min(y + r, h - 1);
+				for (int yy = y0; yy <= y1; yy++) {
+					const float *qx = &px[yy * w];
+					const float *qy = &py[yy * w];
+					const float *qz = &pz[yy * w];
+					const float *qv = &valid[yy * w];
+#pragma omp simd reduction(+:sw,sq0,sq1,sq2,sdn)
+					for (int xx = x0; xx <= x1; xx++) {
+						float d0 = p0 - qx[xx];
+						float d1 = p1 - qy[xx];
+						float d2 = p2 - qz[xx];
+						float dn = d0 * n0 + d1 * n1 + d2 * n2;
+						float wq = qv[xx] *
+							wt(invsigma2_1 * (d0 * d0 + d1 * d1 + d2 * d2)) *
+							wt(invsigma2_2 * dn * dn);
+						sw += wq;
+						sq0 += wq * qx[xx];
+						sq1 += wq * qy[xx];
+						sq2 += wq * qz[xx];
+						sdn += wq * dn;
+					}
+				}
+
+				// The center point always contributes, so sw > 0
+				float inv = 1.0f / sw;
+				themesh->vertices[grid[i]] = point(
+					inv * (sq0 + sdn * n0),
+					inv * (sq1 + sdn * n1),
+					inv * (sq2 + sdn * n2));
+			}
+		}
+	}
+
+	dprintf("Done.  Filtering took %f sec.\n", now() - t);
+	themesh->changed_geometry();
+	themesh->normals.clear();
+	if (had_normals)
+		themesh->need_normals();
+}
+
+
+// Instantiate a bunch of diffuse_grid_vector forms
+template void diffuse_grid_vector< float >(TriMesh *,
+	vector< float > &, float);
+template void diffuse_grid_vector< Vec<2,float> >(TriMesh *,
+	vector< Vec<2,float> > &, float);
+template void diffuse_grid_vector< Vec<3,float> >(TriMesh *,
+	vector< Vec<3,float> > &, float);
+template void diffuse_grid_vector< Vec<4,float> >(TriMesh *,
+	vector< Vec<4,float> > &, float);
+
+} // namespace trimesh
@@ -27,8 +27,8 @@ void shared(TriMesh *mesh, float tol)
 		return;
 	mesh->clear_tstrips();
 	mesh->clear_grid();
-	mesh->need_neighbors();
 	mesh->need_adjacentfaces();
+	mesh->need_opposite_corners();
 
 	// We only merge vertices on different connected components.
 	// First we find those components.
@@ -46,9 +46,9 @@ void shared(TriMesh *mesh, float tol)
 	vector<KDtree *> kd_trees(ncomps);
 	vector< vector<const float *> > comp_points(ncomps);
 	for (int i = 0; i < nv; i++) {
-		if (!bdy[i] || mesh->adjacentfaces[i].empty())
+		if (!bdy[i] || mesh->adjacentfaces_of(i).empty())
 			continue;
-		int i_comp = comps[mesh->adjacentfaces[i][0]];
+		int i_comp = comps[mesh->adjacentfaces_of(i)[0]];
 		comp_points[i_comp].push_back(&mesh->vertices[i][0]);
 	}
 	for (int i = 0; i < ncomps; i++)
@@ -62,9 +62,9 @@ void shared(TriMesh *mesh, float tol)
 	float tol2 = sqr(tol);
 	for (int i = 0; i < nv; i++) {
 		remap.push_back(i);
-		if (!bdy[i] || mesh->adjacentfaces[i].empty())
+		if (!bdy[i] || mesh->adjacentfaces_of(i).empty())
 			continue;
-		int i_comp = comps[mesh->adjacentfaces[i][0]];
+		int i_comp = comps[mesh->adjacentfaces_of(i)[0]];
 		for (int j = 0; j < i_comp; j++) {
 			const float *match = kd_trees[j]->
 				closest_to_pt(mesh->vertices[i], tol2);
@@ -206,8 +206,7 @@ TriMesh *join(const vector<TriMesh *> &meshes, float tol)
 		if (tol < 0.0f)
 			continue;
 
-		m->need_neighbors();
-		m->need_adjacentfaces();
+		m->need_opposite_corners();
 		vector<const float *> bdy_pts;
 		for (size_t j = 0; j < m->vertices.size(); j++) {
 			remap[onv + j] = onv + j;
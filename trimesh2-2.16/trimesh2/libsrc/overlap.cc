@@ -74,12 +74,10 @@ void find_overlap(TriMesh *mesh1, TriMesh *mesh2,
                   float &area, float &rmsdist)
 {
 	mesh1->need_normals();
-	mesh1->need_neighbors();
-	mesh1->need_adjacentfaces();
+	mesh1->need_opposite_corners();
 	mesh1->need_pointareas();
 	mesh2->need_normals();
-	mesh2->need_neighbors();
-	mesh2->need_adjacentfaces();
+	mesh2->need_opposite_corners();
 	mesh2->need_pointareas();
 
 	float area1, area2, non1, non2, rmsdist1, rmsdist2;
@@ -102,12 +100,10 @@ float iou(TriMesh *mesh1, TriMesh *mesh2,
 	  const KDtree *kd1, const KDtree *kd2)
 {
 	mesh1->need_normals();
-	mesh1->need_neighbors();
-	mesh1->need_adjacentfaces();
+	mesh1->need_opposite_corners();
 	mesh1->need_pointareas();
 	mesh2->need_normals();
-	mesh2->need_neighbors();
-	mesh2->need_adjacentfaces();
+	mesh2->need_opposite_corners();
 	mesh2->need_pointareas();
 
 	float area1, area2, non1, non2, rmsdist1, rmsdist2;
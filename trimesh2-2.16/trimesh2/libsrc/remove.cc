@@ -101,8 +101,7 @@ void remove_faces(TriMesh *mesh, const vector<bool> &toremove)
 	if (!had_faces)
 		mesh->clear_faces();
 
-	mesh->bbox.valid = false;
-	mesh->bsphere.valid = false;
+	mesh->changed_geometry();
 }
 
 
@@ -8,6 +8,7 @@ Reorder and remap vertices.
 
 #include "TriMesh.h"
 #include "TriMesh_algo.h"
+#include <algorithm>
 using namespace std;
 #define dprintf TriMesh::dprintf
 #define eprintf TriMesh::eprintf
@@ -143,11 +144,10 @@ void remap_verts(TriMesh *mesh, const std::vector<int> &remap_table)
 	}
 
 	// Recompute whatever needs recomputing...
-	if (!mesh->pointareas.empty() || !mesh->cornerareas.empty()) {
-		mesh->pointareas.clear();
-		mesh->cornerareas.clear();
-		mesh->need_pointareas();
-	}
+	bool had_pointareas = !mesh->pointareas.empty() ||
+		!mesh->cornerareas.empty();
+	mesh->pointareas.clear();
+	mesh->cornerareas.clear();
 	if (mesh->bbox.valid) {
 		mesh->bbox.valid = false;
 		mesh->need_bbox();
@@ -156,18 +156,29 @@ void remap_verts(TriMesh *mesh, const std::vector<int> &remap_table)
 		mesh->bsphere.valid = false;
 		mesh->need_bsphere();
 	}
-	if (!mesh->neighbors.empty()) {
-		mesh->neighbors.clear();
+	mesh->clear_feature_size();
+	// Clear all the connectivity before rebuilding any of it, since
+	// each part may be built from the others
+	bool had_neighbors = !mesh->neighbors.empty() ||
+		!mesh->neighbor_offsets.empty();
+	bool had_adjacentfaces = !mesh->adjacentfaces.empty() ||
+		!mesh->adjacentface_offsets.empty();
+	bool had_corners = !mesh->vertex_corners.empty();
+	bool had_across_edge = !mesh->across_edge.empty();
+	mesh->clear_neighbors();
+	mesh->clear_adjacentfaces();
+	mesh->clear_across_edge();
+	if (had_neighbors)
 		mesh->need_neighbors();
-	}
-	if (!mesh->adjacentfaces.empty()) {
-		mesh->adjacentfaces.clear();
+	if (had_adjacentfaces)
 		mesh->need_adjacentfaces();
-	}
-	if (!mesh->across_edge.empty()) {
-		mesh->across_edge.clear();
+	if (had_corners)
+		mesh->need_opposite_corners();
+	if (had_across_edge)
 		mesh->need_across_edge();
-	}
+	// After the connectivity, which need_pointareas() may use
+	if (had_pointareas)
+		mesh->need_pointareas();
 
 	// Must recompute tstrips after connectivity is recomputed...
 	if (have_tstrips)
@@ -180,17 +191,10 @@ void remap_verts(TriMesh *mesh, const std::vector<int> &remap_table)
 }
 
 
-// Reorder vertices in a mesh according to the order in which
-// they are referenced by the grid, tstrips, or faces.
-void reorder_verts(TriMesh *mesh)
+// Order vertices in the order in which they are referenced by the grid,
+// tstrips, or faces.  Returns the number of vertices ordered.
+static int refs_order(TriMesh *mesh, vector<int> &remap)
 {
-	if (mesh->grid.empty() && mesh->tstrips.empty() && mesh->faces.empty())
-		return;
-
-	dprintf("Reordering vertices... ");
-
-	int nv = mesh->vertices.size();
-	vector<int> remap(nv, -1);
 	int next = 0;
 	if (!mesh->grid.empty()) {
 		for (size_t i = 0; i < mesh->grid.size(); i++) {
@@ -219,6 +223,202 @@ void reorder_verts(TriMesh *mesh)
 			}
 		}
 	}
+	return next;
+}
+
+
+// Order the vertices of a range grid by square tiles of grid cells,
+// and in row-major order within each tile
+static int grid_tiles_order(TriMesh *mesh, int tile_size,
+	vector<int> &remap)
+{
+	int w = mesh->grid_width, h = mesh->grid_height;
+	int next = 0;
+	for (int ty = 0; ty < h; ty += tile_size) {
+		for (int tx = 0; tx < w; tx += tile_size) {
+			int y1 = min(ty + tile_size, h), x1 = min(tx + tile_size, w);
+			for (int y = ty; y < y1; y++) {
+				for (int x = tx; x < x1; x++) {
+					int v = mesh->grid[x + y * w];
+					if (v == -1)
+						continue;
+					if (remap[v] == -1)
+						remap[v] = next++;
+				}
+			}
+		}
+	}
+	return next;
+}
+
+
+// Spread the low 21 bits of x so that there are two zero bits
+// between each pair of bits
+static inline unsigned long long spread_bits(unsigned x)
+{
+	unsigned long long b = x & 0x1fffff;
+	b = (b | (b << 32)) & 0x1f00000000ffffull;
+	b = (b | (b << 16)) & 0x1f0000ff0000ffull;
+	b = (b | (b << 8))  & 0x100f00f00f00f00full;
+	b = (b | (b << 4))  & 0x10c30c30c30c30c3ull;
+	b = (b | (b << 2))  & 0x1249249249249249ull;
+	return b;
+}
+
+
+// Position along a Morton (Z-order) curve of the given point,
+// with coordinates in [0, 2^21)
+static inline unsigned long long morton_key(unsigned x, unsigned y,
+	unsigned z)
+{
+	return (spread_bits(x) << 2) | (spread_bits(y) << 1) | spread_bits(z);
+}
+
+
+// Position along a Hilbert curve of the given point, with coordinates in
+// [0, 2^21).  Uses Skilling's transform of the coordinates to the
+// "transposed" Hilbert index, whose bits are then interleaved.
+static inline unsigned long long hilbert_key(unsigned x, unsigned y,
+	unsigned z)
+{
+	unsigned X[3] = { x, y, z };
+	const unsigned M = 1u << 20;
+
+	// Inverse undo
+	for (unsigned Q = M; Q > 1; Q >>= 1) {
+		unsigned P = Q - 1;
+		for (int i = 0; i < 3; i++) {
+			if (X[i] & Q) {
+				X[0] ^= P;
+			} else {
+				unsigned t = (X[0] ^ X[i]) & P;
+				X[0] ^= t;
+				X[i] ^= t;
+			}
+		}
+	}
+
+	// Gray encode
+	X[1] ^= X[0];
+	X[2] ^= X[1];
+	unsigned t = 0;
+	for (unsigned Q = M; Q > 1; Q >>= 1) {
+		if (X[2] & Q)
+			t ^= Q - 1;
+	}
+	for (int i = 0; i < 3; i++)
+		X[i] ^= t;
+
+	return morton_key(X[0], X[1], X[2]);
+}
+
+
+// Order vertices along a space-filling curve through the bounding box
+static int curve_order(TriMesh *mesh, bool hilbert, vector<int> &remap)
+{
+	mesh->need_bbox();
+	int nv = mesh->vertices.size();
+	const point &bmin = mesh->bbox.min;
+	vec bsize = mesh->bbox.size();
+	float maxsize = max(max(bsize[0], bsize[1]), bsize[2]);
+	const float maxcoord = 2097151.0f; // 2^21 - 1
+	float scale = (maxsize > 0.0f) ? maxcoord / maxsize : 0.0f;
+
+	vector< pair<unsigned long long, int> > keys(nv);
+#pragma omp parallel for
+	for (int i = 0; i < nv; i++) {
+		vec p = scale * (mesh->vertices[i] - bmin);
+		unsigned x = unsigned(clamp(p[0], 0.0f, maxcoord));
+		unsigned y = unsigned(clamp(p[1], 0.0f, maxcoord));
+		unsigned z = unsigned(clamp(p[2], 0.0f, maxcoord));
+		keys[i].first = hilbert ? hilbert_key(x, y, z) :
+		                          morton_key(x, y, z);
+		keys[i].second = i;
+	}
+	sort(keys.begin(), keys.end());
+
+	for (int i = 0; i < nv; i++)
+		remap[keys[i].second] = i;
+	return nv;
+}
+
+
+// Sort faces by their lowest-numbered vertex, so that they are visited
+// in about the same order as the vertices.  Anything indexed by face
+// is recomputed or cleared.
+static void sort_faces(TriMesh *mesh)
+{
+	int nv = mesh->vertices.size(), nf = mesh->faces.size();
+	if (!nf)
+		return;
+
+	// Counting sort, which keeps faces with the same vertex in order
+	vector<int> start(nv + 1);
+	for (int i = 0; i < nf; i++) {
+		const TriMesh::Face &f = mesh->faces[i];
+		start[min(min(f[0], f[1]), f[2]) + 1]++;
+	}
+	for (int i = 0; i < nv; i++)
+		start[i+1] += start[i];
+	vector<TriMesh::Face> newfaces(nf);
+	for (int i = 0; i < nf; i++) {
+		const TriMesh::Face &f = mesh->faces[i];
+		newfaces[start[min(min(f[0], f[1]), f[2])]++] = f;
+	}
+	mesh->faces.swap(newfaces);
+
+	bool had_pointareas = !mesh->cornerareas.empty();
+	bool had_neighbors = !mesh->neighbors.empty() ||
+		!mesh->neighbor_offsets.empty();
+	bool had_adjacentfaces = !mesh->adjacentfaces.empty() ||
+		!mesh->adjacentface_offsets.empty();
+	bool had_corners = !mesh->vertex_corners.empty();
+	bool had_across_edge = !mesh->across_edge.empty();
+	mesh->clear_pointareas();
+	mesh->clear_neighbors();
+	mesh->clear_adjacentfaces();
+	mesh->clear_across_edge();
+	if (had_neighbors)
+		mesh->need_neighbors();
+	if (had_adjacentfaces)
+		mesh->need_adjacentfaces();
+	if (had_corners)
+		mesh->need_opposite_corners();
+	if (had_across_edge)
+		mesh->need_across_edge();
+	if (had_pointareas)
+		mesh->need_pointareas();
+}
+
+
+// Reorder vertices in a mesh, according to the given scheme
+void reorder_verts(TriMesh *mesh, ReorderScheme scheme /* = REORDER_REFS */,
+	int tile_size /* = 32 */)
+{
+	if (scheme == REORDER_GRID_TILES && mesh->grid.empty())
+		scheme = REORDER_HILBERT;
+	if (scheme == REORDER_REFS && mesh->grid.empty() &&
+	    mesh->tstrips.empty() && mesh->faces.empty())
+		return;
+
+	dprintf("Reordering vertices... ");
+
+	int nv = mesh->vertices.size();
+	vector<int> remap(nv, -1);
+	int next;
+	switch (scheme) {
+		case REORDER_MORTON:
+			next = curve_order(mesh, false, remap);
+			break;
+		case REORDER_HILBERT:
+			next = curve_order(mesh, true, remap);
+			break;
+		case REORDER_GRID_TILES:
+			next = grid_tiles_order(mesh, max(tile_size, 1), remap);
+			break;
+		default:
+			next = refs_order(mesh, remap);
+	}
 
 	if (next != nv) {
 		// Unreferenced vertices...  Just stick them at the end.
@@ -229,6 +429,10 @@ void reorder_verts(TriMesh *mesh)
 
 	remap_verts(mesh, remap);
 
+	// Faces stored alongside tstrips have to stay in strip order
+	if (scheme != REORDER_REFS && mesh->tstrips.empty())
+		sort_faces(mesh);
+
 	dprintf("Done.\n");
 }
 
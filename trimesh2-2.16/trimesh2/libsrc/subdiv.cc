@@ -70,7 +70,7 @@ static point new_loop_edge(TriMesh *mesh, int f1, int f2,
 		{ 0.3945288f, 0.1215267f, 0.01074729f, 0.01074729f, 0.1215267f },
 	};
 
-	int n = mesh->adjacentfaces[v1].size();
+	int n = mesh->adjacentfaces_of(v1).size();
 	if (n <= 3)
 		return loop(mesh, f1, f2, v0, v1, v2, v3);
 	point p;
@@ -120,7 +120,7 @@ static point zorin_edge(TriMesh *mesh, int f1, int f2,
 		{ 0.35f, 0.0309017f, -0.0809017f, -0.0809017f, 0.0309017f },
 	};
 
-	int n = mesh->adjacentfaces[v1].size();
+	int n = mesh->adjacentfaces_of(v1).size();
 	if (n < 3)
 		return butterfly(mesh, f1, f2, v0, v1, v2, v3);
 	point p;
@@ -158,7 +158,7 @@ static point avg_bdy(TriMesh *mesh, int v)
 {
 	point p;
 	int n = 0;
-	const vector<int> &a = mesh->adjacentfaces[v];
+	TriMesh::IndexList a = mesh->adjacentfaces_of(v);
 	for (size_t i = 0; i < a.size(); i++) {
 		int f = a[i];
 		for (int j = 0; j < 3; j++) {
@@ -233,8 +233,8 @@ static void insert_vert(TriMesh *mesh, SubdivScheme scheme, int f, int e)
 	if (scheme == SUBDIV_LOOP || scheme == SUBDIV_LOOP_ORIG) {
 		p = loop(mesh, f, ae, v0, v1, v2, v3);
 	} else if (scheme == SUBDIV_LOOP_NEW) {
-		bool e1 = (mesh->adjacentfaces[v1].size() != 6);
-		bool e2 = (mesh->adjacentfaces[v2].size() != 6);
+		bool e1 = (mesh->adjacentfaces_of(v1).size() != 6);
+		bool e2 = (mesh->adjacentfaces_of(v2).size() != 6);
 		if (e1 && e2)
 			p = 0.5f * (new_loop_edge(mesh, f, ae, v0, v1, v2, v3) +
 			            new_loop_edge(mesh, ae, f, v3, v2, v1, v0));
@@ -247,8 +247,8 @@ static void insert_vert(TriMesh *mesh, SubdivScheme scheme, int f, int e)
 	} else if (scheme == SUBDIV_BUTTERFLY) {
 		p = butterfly(mesh, f, ae, v0, v1, v2, v3);
 	} else if (scheme == SUBDIV_BUTTERFLY_MODIFIED) {
-		bool e1 = (mesh->adjacentfaces[v1].size() != 6);
-		bool e2 = (mesh->adjacentfaces[v2].size() != 6);
+		bool e1 = (mesh->adjacentfaces_of(v1).size() != 6);
+		bool e2 = (mesh->adjacentfaces_of(v2).size() != 6);
 		if (e1 && e2)
 			p = 0.5f * (zorin_edge(mesh, f, ae, v0, v1, v2, v3) +
 			            zorin_edge(mesh, ae, f, v3, v2, v1, v0));
@@ -276,6 +276,7 @@ void subdiv(TriMesh *mesh, SubdivScheme scheme)
 	mesh->clear_pointareas();
 	mesh->clear_bbox();
 	mesh->clear_bsphere();
+	mesh->clear_feature_size();
 	mesh->need_faces(); mesh->clear_tstrips(); mesh->clear_grid();
 	mesh->clear_neighbors();
 	mesh->need_adjacentfaces();
@@ -344,11 +345,12 @@ void subdiv(TriMesh *mesh, SubdivScheme scheme)
 		for (int i = 0; i < old_nv; i++) {
 			point bdyavg, nbdyavg;
 			int nbdy = 0, nnbdy = 0;
-			int naf = mesh->adjacentfaces[i].size();
+			TriMesh::IndexList a = mesh->adjacentfaces_of(i);
+			int naf = a.size();
 			if (!naf)
 				continue;
 			for (int j = 0; j < naf; j++) {
-				int af = mesh->adjacentfaces[i][j];
+				int af = a[j];
 				int afi = mesh->faces[af].indexof(i);
 				int n1 = NEXT_MOD3(afi);
 				int n2 = PREV_MOD3(afi);
@@ -385,7 +387,7 @@ void subdiv(TriMesh *mesh, SubdivScheme scheme)
 	}
 
 	// Insert new faces
-	mesh->clear_adjacentfaces(); mesh->clear_across_edge();
+	mesh->changed_faces();
 	mesh->faces.reserve(4*nf);
 	for (int i = 0; i < nf; i++) {
 		TriMesh::Face &v = mesh->faces[i];
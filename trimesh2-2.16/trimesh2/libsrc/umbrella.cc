@@ -17,7 +17,7 @@ namespace trimesh {
 void umbrella(TriMesh *mesh, float stepsize, bool tangent /* = false */)
 {
 	mesh->need_neighbors();
-	mesh->need_adjacentfaces();
+	mesh->need_opposite_corners();
 	if (tangent)
 		mesh->need_normals();
 	int nv = mesh->vertices.size();
@@ -28,14 +28,15 @@ void umbrella(TriMesh *mesh, float stepsize, bool tangent /* = false */)
 			// Change to #if 1 to smooth boundaries.
 			// This way, we leave boundaries alone.
 #if 0
-			int nn = mesh->neighbors[i].size();
+			TriMesh::IndexList nbrs = mesh->neighbors_of(i);
+			int nn = nbrs.size();
 			int nnused = 0;
 			if (!nn)
 				continue;
 			for (int j = 0; j < nn; j++) {
-				if (!mesh->is_bdy(mesh->neighbors[i][j]))
+				if (!mesh->is_bdy(nbrs[j]))
 					continue;
-				disp[i] += mesh->vertices[mesh->neighbors[i][j]];
+				disp[i] += mesh->vertices[nbrs[j]];
 				nnused++;
 			}
 			disp[i] /= nnused;
@@ -44,11 +45,12 @@ void umbrella(TriMesh *mesh, float stepsize, bool tangent /* = false */)
 			disp[i].clear();
 #endif
 		} else {
-			int nn = mesh->neighbors[i].size();
+			TriMesh::IndexList nbrs = mesh->neighbors_of(i);
+			int nn = nbrs.size();
 			if (!nn)
 				continue;
 			for (int j = 0; j < nn; j++)
-				disp[i] += mesh->vertices[mesh->neighbors[i][j]];
+				disp[i] += mesh->vertices[nbrs[j]];
 			disp[i] /= nn;
 			disp[i] -= mesh->vertices[i];
 		}
@@ -66,8 +68,7 @@ void umbrella(TriMesh *mesh, float stepsize, bool tangent /* = false */)
 			mesh->vertices[i] += stepsize * disp[i];
 	}
 
-	mesh->bbox.valid = false;
-	mesh->bsphere.valid = false;
+	mesh->changed_geometry();
 }
 
 
@@ -75,16 +76,13 @@ void umbrella(TriMesh *mesh, float stepsize, bool tangent /* = false */)
 void lmsmooth(TriMesh *mesh, int niters)
 {
 	mesh->need_neighbors();
-	mesh->need_adjacentfaces();
+	mesh->need_opposite_corners();
 	dprintf("Smoothing mesh... ");
 	for (int i = 0; i < niters; i++) {
 		umbrella(mesh, 0.330f);
 		umbrella(mesh, -0.331f);
 	}
 	dprintf("Done.\n");
-
-	mesh->bbox.valid = false;
-	mesh->bsphere.valid = false;
 }
 
 
@@ -97,11 +95,12 @@ void numbrella(TriMesh *mesh, float stepsize)
 	std::vector<vec> disp(nv);
 #pragma omp parallel for
 	for (int i = 0; i < nv; i++) {
-		int nn = mesh->neighbors[i].size();
+		TriMesh::IndexList nbrs = mesh->neighbors_of(i);
+		int nn = nbrs.size();
 		if (!nn)
 			continue;
 		for (int j = 0; j < nn; j++)
-			disp[i] += mesh->normals[mesh->neighbors[i][j]];
+			disp[i] += mesh->normals[nbrs[j]];
 		disp[i] /= nn;
 		disp[i] -= mesh->normals[i];
 	}
@@ -111,6 +110,7 @@ void numbrella(TriMesh *mesh, float stepsize)
 		mesh->normals[i] += stepsize * disp[i];
 		normalize(mesh->normals[i]);
 	}
+	mesh->normals_gen = 0;
 }
 
 } // namespace trimesh
@@ -9,14 +9,56 @@
 // Diego Nehab, Princeton, NJ, 5/2007
 //---------------------------------------------------------------------------
 #include <cstdio> 
+#include <cstdlib> 
+#include <cctype> 
 #include <vector> 
 #include <cstdarg> 
 #include <string.h>
 #include "suitesparse/cholmod.h"
 #include "TriMesh.h"
 #include "TriMesh_algo.h"
+#include "Arena.h"
+#include "DepthMap.h"
+#include "mesh_opt_kernels.h"
 using namespace trimesh;
 using namespace std;
+
+// Scratch memory for everything done in a job, including CHOLMOD's 
+// allocations.  Reset after each job, so a batch reuses the same memory.
+static Arena arena;
+
+// CHOLMOD memory manager on top of the arena
+static void *job_malloc(size_t size) { 
+    return arena.pool_malloc(size); 
+}
+static void *job_calloc(size_t n, size_t size) { 
+    return arena.pool_calloc(n, size); 
+}
+static void *job_realloc(void *p, size_t size) { 
+    return arena.pool_realloc(p, size); 
+}
+static void job_free(void *p) { 
+    arena.pool_free(p); 
+}
+
+// Print memory use at each stage of a job (-memreport)
+static bool memreport = false;
+
+static void report_memory(const TriMesh *mesh, const char *stage) {
+    if (!memreport) return;
+    fprintf(stderr, "\n");
+    mesh->print_memory_usage(stderr, stage);
+    fprintf(stderr, "  %-24s %9.2f MB in use, %9.2f MB peak\n", "scratch",
+        arena.stats().in_use / 1048576.0, 
+        arena.stats().peak_in_use / 1048576.0);
+}
+
+static void report_cholmod(const cholmod_common &c, const char *stage) {
+    if (!memreport) return;
+    fprintf(stderr, "\n  CHOLMOD (%s): %.2f MB in use, %.2f MB peak\n", 
+        stage, c.memory_inuse / 1048576.0, c.memory_usage / 1048576.0);
+}
+
 // CHOLMOD error handler
 static void handler(int status, const char *file, int line, const char *message) {
     fprintf(stderr, "\ncholmod error: file: %s line: %d status: %d: %s\n\n",
@@ -26,16 +68,30 @@ static void handler(int status, const char *file, int line, const char *message)
 
 static void usage(const char *myname) {
     fprintf(stderr, "Usage: %s infile [options] [outfile]\n", myname);
+    fprintf(stderr, "Infile may be a mesh, or a depth map (.pfm, .npy, or .raw) that needs -fc\n");
+    fprintf(stderr, "Outfile may be a depth map (.pfm, .npy, or depth:file.raw), with NaN\n");
+    fprintf(stderr, "for invalid pixels; norm:outfile also writes the normal map to outfile_normals\n");
+    fprintf(stderr, "Range grids load fastest from .rgrid files, which any tool can write\n");
+    fprintf(stderr, "(.rgridz for a losslessly compressed copy)\n");
     fprintf(stderr, "Options:\n");
     fprintf(stderr, "   -fc file.fc     Range grid camera intrinsics (i.e. fx fy cx cy)\n");
+    fprintf(stderr, "   -normals file   Normal map to go with a depth map\n");
+    fprintf(stderr, "   -confmap file   Confidence map to go with a depth map\n");
+    fprintf(stderr, "   -zrange z0:z1   Keep only depths in [z0,z1] from a depth map\n");
+    fprintf(stderr, "   -rawsize WxH    Size of .raw depth, normal, and confidence maps\n");
     fprintf(stderr, "   -lambda l       Geometry weight\n");
     fprintf(stderr, "   -blambda b      Boundary geometry weight\n");
     fprintf(stderr, "   -fixnorm s[:n]  Fix normals by smoothing n times with sigma=s*edgelength\n");
     fprintf(stderr, "   -smooth s[:n]   Smooth positions n times with sigma=s*edgelength\n");
+    fprintf(stderr, "   -bilat sd:sr    Bilateral smoothing of positions with domain, range sigmas\n");
     fprintf(stderr, "   -opt            Run one optimization round\n");
     fprintf(stderr, "   -noopt          Do not optimize\n");
     fprintf(stderr, "   -noconf         Remove per-vertex confidence\n");
     fprintf(stderr, "   -nogrid         Unpack range grid to faces\n");
+    fprintf(stderr, "   -allocstats     Print scratch memory statistics\n");
+    fprintf(stderr, "   -memreport      Print memory use after each stage\n");
+    fprintf(stderr, "Or: %s -batch jobs.txt\n", myname);
+    fprintf(stderr, "   Run each line of jobs.txt (infile [options] [outfile]) as a job\n");
 }
 
 static void usage_error(const char *myname, const char *fmt = NULL, ...) {
@@ -51,6 +107,20 @@ static void usage_error(const char *myname, const char *fmt = NULL, ...) {
     exit(1);
 }
 
+// Report a problem with a job, if given a message.  Returns false, for
+// the caller to pass on.
+static bool job_error(const char *fmt = NULL, ...) {
+    if (fmt) {
+        fprintf(stderr, "\n");
+        va_list ap;
+        va_start(ap, fmt);
+        vfprintf(stderr, fmt, ap);
+        va_end(ap);
+        fprintf(stderr, "\n\n");
+    }
+    return false;
+}
+
 // Derivative types possible at a range grid vertex
 typedef enum _e_di {
     NONE, // No derivative possible
@@ -83,7 +153,10 @@ typedef struct _t_var {
     // Index of vertex associated to optimization variable
     int i;
 } t_var;
-typedef std::vector<t_var> t_map;
+typedef std::vector<t_var, ArenaAllocator<t_var> > t_map;
+
+// Scratch copies of normal fields
+typedef std::vector<vec, ArenaAllocator<vec> > scratch_vecs;
 
 // Intrinsics
 typedef struct _t_fc {
@@ -93,8 +166,9 @@ typedef struct _t_fc {
 // Checks if two verticdes are neighbors 
 static int isneighbor(TriMesh *mesh, int i, int j) {
     if (i == j) return 1;
-    for (int v = 0; v < mesh->neighbors[i].size(); v++)
-        if (mesh->neighbors[i][v] == j) return 1;
+    TriMesh::IndexList n = mesh->neighbors_of(i);
+    for (size_t v = 0; v < n.size(); v++)
+        if (n[v] == j) return 1;
     return 0;
 }
 
@@ -284,15 +358,18 @@ static void optimize_grid(TriMesh *mesh, float lambda, float blambda,
     cholmod_dense *Atb = cholmod_zeros(At->nrow, 1, At->xtype, &c);
     cholmod_sdmult(At, 0, one, zero, b, Atb, &c);
     fprintf(stderr, "Done.\n");
+    report_cholmod(c, "system built");
     fprintf(stderr, "  Analyzing matrix... ");
     cholmod_factor *L = cholmod_analyze (At, &c) ;   
     fprintf(stderr, "Done.\n");
     fprintf(stderr, "  Factoring matrix... ");
     cholmod_factorize (At, L, &c);
     fprintf(stderr, "Done.\n");
+    report_cholmod(c, "factored");
     fprintf(stderr, "  Back substituting... ");
     cholmod_dense *z = cholmod_solve(CHOLMOD_A, L, Atb, &c);
     fprintf(stderr, "Done.\n");
+    report_cholmod(c, "solved");
     fprintf(stderr, "  Updating range grid... ");
     for (int i = 0; i < h; i++) {
         for (int j = 0; j < w; j++) {
@@ -305,6 +382,7 @@ static void optimize_grid(TriMesh *mesh, float lambda, float blambda,
             }
         }
     }
+    mesh->changed_geometry();
     // Cleanup
     cholmod_free_dense(&b, &c);
     cholmod_free_sparse(&At, &c);
@@ -336,7 +414,7 @@ static void optimize_mesh(TriMesh *mesh, float lambda, float blambda) {
     // Count normal constraints
     int neqns = 0;
     for (int i = 0; i < nvars; i++)
-        neqns += mesh->adjacentfaces[i].size(); 
+        neqns += mesh->adjacentfaces_of(i).size(); 
     // One coefficient per position constraint, two per normal constraint
     int nnzs = nvars + neqns*2;
     // Add position constraints
@@ -362,7 +440,7 @@ static void optimize_mesh(TriMesh *mesh, float lambda, float blambda) {
     // Normal constraints
     int row = nvars;
     for (int v = 0; v < nvars; v++) {
-        const vector<int> &af = mesh->adjacentfaces[v];
+        TriMesh::IndexList af = mesh->adjacentfaces_of(v);
         int nf = af.size();
         float conf = 0.5;
         if (!mesh->confidences.empty())
@@ -389,20 +467,23 @@ static void optimize_mesh(TriMesh *mesh, float lambda, float blambda) {
     cholmod_dense *Atb = cholmod_zeros(At->nrow, 1, At->xtype, &c);
     cholmod_sdmult(At, 0, one, zero, b, Atb, &c);
     fprintf(stderr, "Done.\n");
+    report_cholmod(c, "system built");
     fprintf(stderr, "  Analyzing matrix... ");
     cholmod_factor *L = cholmod_analyze (At, &c) ;   
     fprintf(stderr, "Done.\n");
     fprintf(stderr, "  Factoring matrix... ");
     cholmod_factorize (At, L, &c);
     fprintf(stderr, "Done.\n");
+    report_cholmod(c, "factored");
     fprintf(stderr, "  Back substituting... ");
     cholmod_dense *d = cholmod_solve(CHOLMOD_A, L, Atb, &c);
     fprintf(stderr, "Done.\n");
+    report_cholmod(c, "solved");
     fprintf(stderr, "  Updating mesh... ");
-    for (int v = 0; v < nvars; v++) {
-        double delta = ((double *) d->x)[v];
-        mesh->vertices[v] += ((float) delta)*mesh->normals[v];
-    }
+    if (nvars)
+        kernels::displace(nvars, &mesh->vertices[0], &mesh->normals[0],
+            (double *) d->x);
+    mesh->changed_geometry();
     // Cleanup
     cholmod_free_dense(&b, &c);
     cholmod_free_sparse(&At, &c);
@@ -413,55 +494,75 @@ static void optimize_mesh(TriMesh *mesh, float lambda, float blambda) {
     fprintf(stderr, "Done.\n");
 } 
 
-// Rodrigues formula for rotation
-static vec rotate(vec v, vec u, float cs, float s) {
-    return cs * v + s * (u CROSS v) + (1.0f - cs) * (u DOT v) * u;
+// Low-pass the current normal field, as n passes of smoothing with sigma 
+// s times the edge length. On range grids, this uses an image pyramid, 
+// whose cost does not depend on s or n (n passes with sigma s amount to 
+// one with sigma s*sqrt(n), and grid cells are about one edge length).
+static void lowpass_normals(TriMesh *themesh, float s, int n) {
+    if (!themesh->grid.empty()) {
+        diffuse_grid_normals(themesh, s * sqrt((float) n));
+    } else {
+        float amount = s * themesh->feature_size();
+        for (int i = 0; i < n; i++)
+            diffuse_normals(themesh, amount);
+    }
 }
 
 // Replace low frequency in normal field with that from geometry
 static void fix_normals(TriMesh *themesh, float s, int n) {
     fprintf(stderr, "Fixing normals (%g:%d)... \n", s, n);
-    float amount = s * themesh->feature_size();
     // Save measured normals
-    std::vector<vec> measured = themesh->normals;
+    scratch_vecs measured(themesh->normals.begin(), themesh->normals.end());
     // Smooth measured normals and save
-    for (int i = 0; i < n; i++)
-        diffuse_normals(themesh, amount);
-    std::vector<vec> smeasured = themesh->normals;
-    // Compute and smooth normals from triangulation
+    lowpass_normals(themesh, s, n);
+    scratch_vecs smeasured(themesh->normals.begin(), themesh->normals.end());
+    // Compute and smooth normals from geometry (taken directly from the
+    // range grid, if there is one, without triangulating)
     themesh->normals.clear();
     themesh->need_normals();
-    for (int i = 0; i < n; i++)
-        diffuse_normals(themesh, amount);
-    for (int i = 0; i < themesh->normals.size(); i++) {
-        vec st = themesh->normals[i];
-        vec sm = smeasured[i];
-        vec m = measured[i];
-        // Rotation axis and angles
-        vec u = sm CROSS m; 
-        float l = len(u);
-        if (l > 0.01) { // Make sure axis is not degenerate
-            u = u/l;
-            float cs = sm DOT m;
-            float s = sqrt(1.0f-cs*cs);
-            themesh->normals[i] = rotate(st, u, cs, s);
-        } 
-    }
+    lowpass_normals(themesh, s, n);
+    // Rotate geometry normals by the rotation taking smoothed measured
+    // normals to measured normals
+    int nv = themesh->normals.size();
+    if (nv)
+        kernels::merge_normals(nv, &themesh->normals[0],
+            &smeasured[0], &measured[0], &themesh->normals[0]);
     fprintf(stderr, "Done. \n");
 }
 
 static void smooth(TriMesh *themesh, float s, int n) {
     fprintf(stderr, "Smoothing positions (%g:%d)... \n", s, n);
     float amount = s * themesh->feature_size();
-    std::vector<vec> backup = themesh->normals;
-    for (int i = 0; i < n; i++) {
+    scratch_vecs backup(themesh->normals.begin(), themesh->normals.end());
+    for (int i = 0; i < n; i++)
         smooth_mesh(themesh, amount);
-        themesh->pointareas.clear();
-    }
-    themesh->normals = backup;
+    // Keep the measured normals, even though positions have changed
+    themesh->normals.assign(backup.begin(), backup.end());
+    themesh->normals_gen = 0;
+    fprintf(stderr, "Done.\n");
+}
+
+// Bilateral (Jones) smoothing of positions. Sigmas are in multiples of 
+// the edge length. Range grids are filtered over a window of grid cells.
+static void bilateral(TriMesh *themesh, float sd, float sr) {
+    fprintf(stderr, "Bilateral smoothing (%g:%g)... \n", sd, sr);
+    float fs = themesh->feature_size();
+    scratch_vecs backup(themesh->normals.begin(), themesh->normals.end());
+    if (!themesh->grid.empty())
+        bilateral_smooth_grid(themesh, sd*fs, sr*fs);
+    else
+        bilateral_smooth_mesh(themesh, sd*fs, sr*fs);
+    themesh->normals.assign(backup.begin(), backup.end());
+    themesh->normals_gen = 0;
     fprintf(stderr, "Done.\n");
 }
 
+static int isbilatarg(const char *c, float *sd, float *sr) {
+    int e = 0;
+    if (sscanf(c, "%f:%f%n", sd, sr, &e) == 2 && c[e] == '\0') return 1;
+    else return 0;
+}
+
 static int issmootharg(const char *c, float *s, int *n) {
     int e = 0;
     *s = 2.f; *n = 1;
@@ -477,25 +578,25 @@ static int isanumber(const char *c, float *s) {
     else return 0;
 }
 
-int main(int argc,char *argv[]) {
-    if (argc < 3) 
-        usage_error(argv[0]);
-    const char *filename = argv[1];
-    TriMesh *themesh = TriMesh::read(filename);
-    if (!themesh) 
-        usage_error(argv[0]);
-    if (themesh->vertices.size() != themesh->normals.size())
-        usage_error(argv[0], "need vertex normals");
-    if (!themesh->confidences.empty() && 
-            themesh->vertices.size() != themesh->confidences.size()) 
-        usage_error(argv[0], "not enough vertex confidence values");
+// Run the options of a job on the mesh, in order.  Returns false if
+// any of them fails.
+static bool run_stages(TriMesh *themesh, int argc, char *argv[]) {
     bool has_intrinsics = false, no_optimize = false, has_blambda = false;
     t_fc fc; 
     float lambda = 0.1, blambda = 0.1;
     bool optimized = false;
     for (int i = 2; i < argc; i++) {
+        const char *stage = argv[i][0] == '-' ? argv[i] : "output";
         if (!strcmp(argv[i], "-noopt")) {
             no_optimize = true;
+        } else if (!strcmp(argv[i], "-allocstats") ||
+                !strcmp(argv[i], "-memreport")) {
+            // Handled in run()
+        } else if (i + 1 < argc && (!strcmp(argv[i], "-normals") ||
+                !strcmp(argv[i], "-confmap") || !strcmp(argv[i], "-zrange") ||
+                !strcmp(argv[i], "-rawsize"))) {
+            // Handled in run()
+            i++;
         } else if (!strcmp(argv[i], "-noconf")) {
             themesh->confidences.clear();
         } else if (!strcmp(argv[i], "-nogrid")) {
@@ -506,7 +607,7 @@ int main(int argc,char *argv[]) {
             float s = 1;
             int n = 1;
             if (!(i < argc && issmootharg(argv[i], &s, &n)))
-                usage_error(argv[0], "-fixnorm requires a parameter "
+                return job_error("-fixnorm requires a parameter "
                     "in the form: s[:n] (i.e. %%f[:%%d])");
             fix_normals(themesh, s, n);
 
@@ -515,33 +616,41 @@ int main(int argc,char *argv[]) {
             float s = 1;
             int n = 1;
             if (!(i < argc && issmootharg(argv[i], &s, &n)))
-                usage_error(argv[0], "-fixnorm requires a parameter "
+                return job_error("-fixnorm requires a parameter "
                     "in the form: s[:n] (i.e. %%f[:%%d])");
             smooth(themesh, s, n);
+        } else if (!strcmp(argv[i], "-bilat")) {
+            i++;
+            float sd = 1, sr = 1;
+            if (!(i < argc && isbilatarg(argv[i], &sd, &sr)))
+                return job_error("-bilat requires a parameter "
+                    "in the form: sd:sr (i.e. %%f:%%f)");
+            bilateral(themesh, sd, sr);
         } else if (!strcmp(argv[i], "-fc")) {
             i++;
             if (!(i < argc))
-                usage_error(argv[0], "-fc requires one filename argument");
+                return job_error("-fc requires one filename argument");
             FILE *fp = fopen(argv[i], "r");
-            if (!fp) usage_error(argv[0], "unable to open -fc '%s'", argv[i]);
+            if (!fp)
+                return job_error("unable to open -fc '%s'", argv[i]);
             if (fscanf(fp,"%f %f %f %f",&fc.fx, &fc.fy, &fc.cx, &fc.cy) != 4) {
                 fclose(fp);
-                usage_error(argv[0], "invalid fc file");
+                return job_error("invalid fc file");
             }
             fclose(fp);
             has_intrinsics = true;
         } else if (!strcmp(argv[i], "-lambda")) {
             i++;
             if (!(i < argc && isanumber(argv[i], &lambda)))
-                usage_error(argv[0], "-lambda requires one float parameter");
+                return job_error("-lambda requires one float parameter");
             else if (lambda < 0 || lambda > 1)
-                usage_error(argv[0], "lambda value must be within [0,1]");
+                return job_error("lambda value must be within [0,1]");
         } else if (!strcmp(argv[i], "-blambda")) {
             i++;
             if (!(i < argc && isanumber(argv[i], &blambda)))
-                usage_error(argv[0], "-blambda requires one float parameter");
+                return job_error("-blambda requires one float parameter");
             else if (blambda < 0 || blambda > 1)
-                usage_error(argv[0], "blambda value must be within [0,1]");
+                return job_error("blambda value must be within [0,1]");
             has_blambda = true;
         } else if (!strcmp(argv[i], "-opt")) {
             if (!has_blambda) 
@@ -549,7 +658,7 @@ int main(int argc,char *argv[]) {
             optimized = true;
             if (has_intrinsics) {
                 if (themesh->grid.empty())
-                    usage_error(argv[0], "fc requires a range grid");
+                    return job_error("fc requires a range grid");
                 optimize_grid(themesh, lambda, blambda, fc);
             } else optimize_mesh(themesh, lambda, blambda);
         } else if (i == argc - 1 &&
@@ -559,14 +668,129 @@ int main(int argc,char *argv[]) {
             if (!no_optimize && !optimized) {
                 if (has_intrinsics) {
                     if (themesh->grid.empty())
-                        usage_error(argv[0], "fc requires a range grid");
+                        return job_error("fc requires a range grid");
                     optimize_grid(themesh, lambda, blambda, fc);
                 } else optimize_mesh(themesh, lambda, blambda);
             }
             optimized = true;
-            themesh->write(argv[i]);
+            if (!themesh->write(argv[i]))
+                return job_error("unable to write [%s]", argv[i]);
         } else
-            usage_error(argv[0], "unrecognized option [%s]", argv[i]);
+            return job_error("unrecognized option [%s]", argv[i]);
+        if (strcmp(stage, "-memreport"))
+            report_memory(themesh, stage);
     }
+    return true;
+}
+
+// Run one job, given its command line.  Returns false if it fails.
+static bool run(int argc, char *argv[]) {
+    if (argc < 3) 
+        return job_error();
+    const char *filename = argv[1];
+    memreport = false;
+    bool allocstats = false;
+    // Options needed before reading
+    const char *fcfile = NULL, *normalfile = NULL, *conffile = NULL;
+    DepthCamera cam;
+    int raw_width = 0, raw_height = 0;
+    for (int i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "-memreport")) {
+            memreport = true;
+        } else if (!strcmp(argv[i], "-allocstats")) {
+            allocstats = true;
+        } else if (i + 1 >= argc) {
+            break;
+        } else if (!strcmp(argv[i], "-fc")) {
+            fcfile = argv[++i];
+        } else if (!strcmp(argv[i], "-normals")) {
+            normalfile = argv[++i];
+        } else if (!strcmp(argv[i], "-confmap")) {
+            conffile = argv[++i];
+        } else if (!strcmp(argv[i], "-zrange")) {
+            if (sscanf(argv[++i], "%f:%f", &cam.zmin, &cam.zmax) != 2)
+                return job_error("-zrange requires a parameter "
+                    "in the form: z0:z1 (i.e. %%f:%%f)");
+        } else if (!strcmp(argv[i], "-rawsize")) {
+            if (sscanf(argv[++i], "%dx%d", &raw_width, &raw_height) != 2)
+                return job_error("-rawsize requires a parameter "
+                    "in the form: WxH (i.e. %%dx%%d)");
+        }
+    }
+    TriMesh *themesh;
+    if (is_depth_map(filename)) {
+        if (!fcfile)
+            return job_error("depth maps require -fc");
+        if (!cam.read_fc(fcfile))
+            return job_error("invalid fc file");
+        themesh = read_depth_grid(filename, normalfile, conffile, cam,
+            raw_width, raw_height);
+    } else {
+        if (normalfile || conffile)
+            return job_error("-normals and -confmap need a depth map");
+        themesh = TriMesh::read(filename);
+    }
+    if (!themesh) 
+        return job_error();
+    report_memory(themesh, "read");
+    bool ok = true;
+    if (themesh->vertices.size() != themesh->normals.size())
+        ok = job_error("need vertex normals");
+    else if (!themesh->confidences.empty() && 
+            themesh->vertices.size() != themesh->confidences.size()) 
+        ok = job_error("not enough vertex confidence values");
+    if (ok) {
+        // Everything here goes through neighbors_of() and adjacentfaces_of()
+        themesh->compact_connectivity = true;
+        ok = run_stages(themesh, argc, argv);
+    }
+    delete themesh;
+    if (allocstats)
+        arena.print_stats();
+    return ok;
+}
+
+// Run each line of a file as a job.  A job that fails is reported, and
+// the rest still run.  Returns the number of failed jobs.
+static int run_batch(const char *myname, const char *jobfile) {
+    FILE *fp = fopen(jobfile, "r");
+    if (!fp) usage_error(myname, "unable to open -batch '%s'", jobfile);
+    int njobs = 0, nfailed = 0;
+    char line[4096];
+    while (fgets(line, sizeof(line), fp)) {
+        // Split on whitespace, in place (not with strtok, which the 
+        // mesh readers use)
+        vector<char *> args(1, (char *) myname);
+        for (char *t = line; *t; ) {
+            while (*t && isspace((unsigned char) *t)) *t++ = '\0';
+            if (*t) args.push_back(t);
+            while (*t && !isspace((unsigned char) *t)) t++;
+        }
+        if (args.size() == 1 || args[1][0] == '#')
+            continue;
+        fprintf(stderr, "Job %d: %s\n", ++njobs, args[1]);
+        if (!run((int) args.size(), &args[0])) {
+            fprintf(stderr, "Job %d failed\n", njobs);
+            nfailed++;
+        }
+        arena.reset();
+    }
+    fclose(fp);
+    arena.print_stats();
+    if (nfailed)
+        fprintf(stderr, "%d of %d jobs failed\n", nfailed, njobs);
+    return nfailed;
+}
+
+int main(int argc, char *argv[]) {
+    Arena::set_current(&arena);
+    SuiteSparse_config.malloc_func = job_malloc;
+    SuiteSparse_config.calloc_func = job_calloc;
+    SuiteSparse_config.realloc_func = job_realloc;
+    SuiteSparse_config.free_func = job_free;
+    if (argc == 3 && !strcmp(argv[1], "-batch"))
+        return run_batch(argv[0], argv[2]) ? 1 : 0;
+    if (!run(argc, argv))
+        usage_error(argv[0]);
     return 0;
 }
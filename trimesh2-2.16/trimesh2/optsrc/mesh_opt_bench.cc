@@ -0,0 +1,127 @@
+//---------------------------------------------------------------------------
+// Microbenchmark for the per-vertex kernels in mesh_opt_kernels.h.
+//
+// Runs each kernel on the vertices and normals of the given mesh with the
+// original per-vertex loops, the scalar block kernels and the AVX2 block
+// kernels, and reports per-vertex throughput and the largest difference
+// from the original loops.
+//---------------------------------------------------------------------------
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "TriMesh.h"
+#include "timestamp.h"
+#include "mesh_opt_kernels.h"
+using namespace trimesh;
+using namespace std;
+
+static void usage(const char *myname) {
+    fprintf(stderr, "Usage: %s infile [repetitions]\n", myname);
+    exit(1);
+}
+
+// Largest componentwise difference between two vector fields
+static float maxdiff(const vector<vec> &a, const vector<vec> &b) {
+    float d = 0.0f;
+    for (size_t i = 0; i < a.size(); i++)
+        for (int j = 0; j < 3; j++)
+            d = max(d, fabs(a[i][j] - b[i][j]));
+    return d;
+}
+
+static void report(const char *what, const char *how, int n, int reps,
+        double t, float diff) {
+    printf("  %-10s %-8s %8.1f Mverts/s   (max diff %g)\n", what, how,
+        double(n) * reps / t * 1e-6, diff);
+}
+
+// The loops that the kernels replace, as originally written in mesh_opt
+static vec rotate(vec v, vec u, float cs, float s) {
+    return cs * v + s * (u CROSS v) + (1.0f - cs) * (u DOT v) * u;
+}
+
+static void merge_reference(int n, const vec *st, const vec *sm,
+        const vec *m, vec *out) {
+    for (int i = 0; i < n; i++) {
+        vec u = sm[i] CROSS m[i];
+        float l = len(u);
+        out[i] = st[i];
+        if (l > 0.01) {
+            u = u/l;
+            float cs = sm[i] DOT m[i];
+            float s = sqrt(1.0f-cs*cs);
+            out[i] = rotate(st[i], u, cs, s);
+        }
+    }
+}
+
+static void displace_reference(int n, vec *v, const vec *normals,
+        const double *delta) {
+    for (int i = 0; i < n; i++)
+        v[i] += ((float) delta[i])*normals[i];
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2)
+        usage(argv[0]);
+    int reps = argc > 2 ? atoi(argv[2]) : 20;
+    if (reps < 1)
+        usage(argv[0]);
+    TriMesh::set_verbose(0);
+    TriMesh *mesh = TriMesh::read(argv[1]);
+    if (!mesh)
+        usage(argv[0]);
+    int nv = mesh->vertices.size();
+    if (!nv || mesh->normals.size() != mesh->vertices.size()) {
+        fprintf(stderr, "need vertex normals\n");
+        exit(1);
+    }
+    printf("%d vertices, %d repetitions, AVX2 %s\n", nv, reps,
+        kernels::has_avx2() ? "available" : "not available");
+
+    // Inputs resembling those in fix_normals: measured, smoothed measured
+    // and smoothed geometric normals
+    vector<vec> m = mesh->normals, sm(nv), st(nv);
+    for (int i = 0; i < nv; i++) {
+        sm[i] = normalized(m[i] + vec(0.05f, -0.03f, 0.02f));
+        st[i] = normalized(m[i] + vec(-0.02f, 0.04f, 0.01f));
+    }
+    vector<vec> ref(nv), out(nv);
+    timestamp t = now();
+    for (int r = 0; r < reps; r++)
+        merge_reference(nv, &st[0], &sm[0], &m[0], &ref[0]);
+    report("merge", "original", nv, reps, now() - t, 0.0f);
+    t = now();
+    for (int r = 0; r < reps; r++)
+        kernels::merge_normals(nv, &st[0], &sm[0], &m[0], &out[0], false);
+    report("merge", "scalar", nv, reps, now() - t, maxdiff(ref, out));
+    if (kernels::has_avx2()) {
+        t = now();
+        for (int r = 0; r < reps; r++)
+            kernels::merge_normals(nv, &st[0], &sm[0], &m[0], &out[0]);
+        report("merge", "avx2", nv, reps, now() - t, maxdiff(ref, out));
+    }
+
+    // Displacement along normals, alternating in sign
+    vector<double> delta(nv);
+    for (int i = 0; i < nv; i++)
+        delta[i] = (i & 1) ? 0.001 : -0.001;
+    ref = mesh->vertices;
+    t = now();
+    for (int r = 0; r < reps; r++)
+        displace_reference(nv, &ref[0], &mesh->normals[0], &delta[0]);
+    report("displace", "original", nv, reps, now() - t, 0.0f);
+    out = mesh->vertices;
+    t = now();
+    for (int r = 0; r < reps; r++)
+        kernels::displace(nv, &out[0], &mesh->normals[0], &delta[0], false);
+    report("displace", "scalar", nv, reps, now() - t, maxdiff(ref, out));
+    if (kernels::has_avx2()) {
+        out = mesh->vertices;
+        t = now();
+        for (int r = 0; r < reps; r++)
+            kernels::displace(nv, &out[0], &mesh->normals[0], &delta[0]);
+        report("displace", "avx2", nv, reps, now() - t, maxdiff(ref, out));
+    }
+    return 0;
+}
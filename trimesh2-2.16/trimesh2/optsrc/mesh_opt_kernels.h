@@ -0,0 +1,215 @@
+//---------------------------------------------------------------------------
+// Per-vertex kernels used by mesh_opt: merging of normal fields (Rodrigues
+// rotation) and displacement of vertices along their normals.
+//
+// Vertices are processed in blocks that are converted to structure-of-arrays
+// form. Blocks are distributed among threads with OpenMP, and each block is
+// processed with AVX2 when the CPU supports it, or with scalar code
+// otherwise.
+//---------------------------------------------------------------------------
+#ifndef MESH_OPT_KERNELS_H
+#define MESH_OPT_KERNELS_H
+
+#include <cmath>
+#include <algorithm>
+#include "TriMesh.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_AVX2
+#include <immintrin.h>
+#define AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+
+namespace kernels {
+
+using trimesh::vec;
+
+// Number of vertices per block (a multiple of the SIMD width)
+static const int BLOCK = 256;
+
+// A block of 3-vectors in structure-of-arrays form
+typedef struct _t_soa3 {
+    float x[BLOCK], y[BLOCK], z[BLOCK];
+} t_soa3;
+
+// Does the CPU support the AVX2 kernels?
+static bool has_avx2(void) {
+#ifdef KERNELS_AVX2
+    static int avx2 = -1;
+    if (avx2 < 0)
+        avx2 = __builtin_cpu_supports("avx2") &&
+            __builtin_cpu_supports("fma");
+    return avx2 != 0;
+#else
+    return false;
+#endif
+}
+
+// Convert n vectors to a block, zero-padding up to the SIMD width
+static inline void load(t_soa3 &b, const vec *v, int n) {
+    for (int i = 0; i < n; i++) {
+        b.x[i] = v[i][0]; b.y[i] = v[i][1]; b.z[i] = v[i][2];
+    }
+    for (int i = n; i < ((n+7) & ~7); i++)
+        b.x[i] = b.y[i] = b.z[i] = 0.0f;
+}
+
+// Convert a block back to n vectors
+static inline void store(const t_soa3 &b, vec *v, int n) {
+    for (int i = 0; i < n; i++)
+        v[i] = vec(b.x[i], b.y[i], b.z[i]);
+}
+
+//---------------------------------------------------------------------------
+// Normal merging: rotate st by the rotation taking sm to m, unless the
+// rotation axis is degenerate
+//---------------------------------------------------------------------------
+static void merge_block(int n, const t_soa3 &st, const t_soa3 &sm,
+        const t_soa3 &m, t_soa3 &out) {
+    for (int i = 0; i < n; i++) {
+        // Rotation axis and angles
+        float ux = sm.y[i]*m.z[i] - sm.z[i]*m.y[i];
+        float uy = sm.z[i]*m.x[i] - sm.x[i]*m.z[i];
+        float uz = sm.x[i]*m.y[i] - sm.y[i]*m.x[i];
+        float l = std::sqrt(ux*ux + uy*uy + uz*uz);
+        float vx = st.x[i], vy = st.y[i], vz = st.z[i];
+        if (l > 0.01f) { // Make sure axis is not degenerate
+            float il = 1.0f / l;
+            ux *= il; uy *= il; uz *= il;
+            float cs = sm.x[i]*m.x[i] + sm.y[i]*m.y[i] + sm.z[i]*m.z[i];
+            float s = std::sqrt(1.0f - cs*cs);
+            // Rodrigues formula
+            float ud = (1.0f - cs) * (ux*vx + uy*vy + uz*vz);
+            out.x[i] = cs*vx + s*(uy*vz - uz*vy) + ud*ux;
+            out.y[i] = cs*vy + s*(uz*vx - ux*vz) + ud*uy;
+            out.z[i] = cs*vz + s*(ux*vy - uy*vx) + ud*uz;
+        } else {
+            out.x[i] = vx; out.y[i] = vy; out.z[i] = vz;
+        }
+    }
+}
+
+#ifdef KERNELS_AVX2
+AVX2_TARGET
+static void merge_block_avx2(int n, const t_soa3 &st, const t_soa3 &sm,
+        const t_soa3 &m, t_soa3 &out) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 thresh = _mm256_set1_ps(0.01f);
+    for (int i = 0; i < n; i += 8) {
+        __m256 smx = _mm256_loadu_ps(sm.x+i), smy = _mm256_loadu_ps(sm.y+i),
+               smz = _mm256_loadu_ps(sm.z+i);
+        __m256 mx = _mm256_loadu_ps(m.x+i), my = _mm256_loadu_ps(m.y+i),
+               mz = _mm256_loadu_ps(m.z+i);
+        __m256 vx = _mm256_loadu_ps(st.x+i), vy = _mm256_loadu_ps(st.y+i),
+               vz = _mm256_loadu_ps(st.z+i);
+        // Rotation axis and angles
+        __m256 ux = _mm256_fmsub_ps(smy, mz, _mm256_mul_ps(smz, my));
+        __m256 uy = _mm256_fmsub_ps(smz, mx, _mm256_mul_ps(smx, mz));
+        __m256 uz = _mm256_fmsub_ps(smx, my, _mm256_mul_ps(smy, mx));
+        __m256 l = _mm256_sqrt_ps(_mm256_fmadd_ps(ux, ux,
+            _mm256_fmadd_ps(uy, uy, _mm256_mul_ps(uz, uz))));
+        __m256 ok = _mm256_cmp_ps(l, thresh, _CMP_GT_OQ);
+        __m256 il = _mm256_div_ps(one, l);
+        ux = _mm256_mul_ps(ux, il);
+        uy = _mm256_mul_ps(uy, il);
+        uz = _mm256_mul_ps(uz, il);
+        __m256 cs = _mm256_fmadd_ps(smx, mx,
+            _mm256_fmadd_ps(smy, my, _mm256_mul_ps(smz, mz)));
+        __m256 s = _mm256_sqrt_ps(_mm256_fnmadd_ps(cs, cs, one));
+        // Rodrigues formula
+        __m256 ud = _mm256_mul_ps(_mm256_sub_ps(one, cs),
+            _mm256_fmadd_ps(ux, vx, _mm256_fmadd_ps(uy, vy,
+                _mm256_mul_ps(uz, vz))));
+        __m256 cx = _mm256_fmsub_ps(uy, vz, _mm256_mul_ps(uz, vy));
+        __m256 cy = _mm256_fmsub_ps(uz, vx, _mm256_mul_ps(ux, vz));
+        __m256 cz = _mm256_fmsub_ps(ux, vy, _mm256_mul_ps(uy, vx));
+        __m256 rx = _mm256_fmadd_ps(cs, vx, _mm256_fmadd_ps(s, cx,
+            _mm256_mul_ps(ud, ux)));
+        __m256 ry = _mm256_fmadd_ps(cs, vy, _mm256_fmadd_ps(s, cy,
+            _mm256_mul_ps(ud, uy)));
+        __m256 rz = _mm256_fmadd_ps(cs, vz, _mm256_fmadd_ps(s, cz,
+            _mm256_mul_ps(ud, uz)));
+        // Keep st where the axis is degenerate
+        _mm256_storeu_ps(out.x+i, _mm256_blendv_ps(vx, rx, ok));
+        _mm256_storeu_ps(out.y+i, _mm256_blendv_ps(vy, ry, ok));
+        _mm256_storeu_ps(out.z+i, _mm256_blendv_ps(vz, rz, ok));
+    }
+}
+#endif
+
+// out[i] = st[i] rotated by the rotation taking sm[i] to m[i].
+// out may be the same as any of the inputs.
+static void merge_normals(int n, const vec *st, const vec *sm, const vec *m,
+        vec *out, bool simd = true) {
+    bool avx2 = simd && has_avx2();
+#pragma omp parallel for
+    for (int b = 0; b < n; b += BLOCK) {
+        int nb = std::min(BLOCK, n - b);
+        t_soa3 bst, bsm, bm, bout;
+        load(bst, st+b, nb); load(bsm, sm+b, nb); load(bm, m+b, nb);
+#ifdef KERNELS_AVX2
+        if (avx2) merge_block_avx2(nb, bst, bsm, bm, bout);
+        else
+#endif
+        merge_block(nb, bst, bsm, bm, bout);
+        store(bout, out+b, nb);
+    }
+    (void) avx2;
+}
+
+//---------------------------------------------------------------------------
+// Arbitrary mesh update: displace each vertex by delta along its normal
+//---------------------------------------------------------------------------
+static void displace_block(int n, t_soa3 &p, const t_soa3 &nrm,
+        const float *d) {
+    for (int i = 0; i < n; i++) {
+        p.x[i] += d[i] * nrm.x[i];
+        p.y[i] += d[i] * nrm.y[i];
+        p.z[i] += d[i] * nrm.z[i];
+    }
+}
+
+#ifdef KERNELS_AVX2
+AVX2_TARGET
+static void displace_block_avx2(int n, t_soa3 &p, const t_soa3 &nrm,
+        const float *d) {
+    for (int i = 0; i < n; i += 8) {
+        __m256 di = _mm256_loadu_ps(d+i);
+        _mm256_storeu_ps(p.x+i, _mm256_fmadd_ps(di,
+            _mm256_loadu_ps(nrm.x+i), _mm256_loadu_ps(p.x+i)));
+        _mm256_storeu_ps(p.y+i, _mm256_fmadd_ps(di,
+            _mm256_loadu_ps(nrm.y+i), _mm256_loadu_ps(p.y+i)));
+        _mm256_storeu_ps(p.z+i, _mm256_fmadd_ps(di,
+            _mm256_loadu_ps(nrm.z+i), _mm256_loadu_ps(p.z+i)));
+    }
+}
+#endif
+
+// v[i] += delta[i] * normals[i]
+static void displace(int n, vec *v, const vec *normals, const double *delta,
+        bool simd = true) {
+    bool avx2 = simd && has_avx2();
+#pragma omp parallel for
+    for (int b = 0; b < n; b += BLOCK) {
+        int nb = std::min(BLOCK, n - b);
+        t_soa3 p, nrm;
+        float d[BLOCK];
+        load(p, v+b, nb); load(nrm, normals+b, nb);
+        for (int i = 0; i < nb; i++)
+            d[i] = (float) delta[b+i];
+        for (int i = nb; i < ((nb+7) & ~7); i++)
+            d[i] = 0.0f;
+#ifdef KERNELS_AVX2
+        if (avx2) displace_block_avx2(nb, p, nrm, d);
+        else
+#endif
+        displace_block(nb, p, nrm, d);
+        store(p, v+b, nb);
+    }
+    (void) avx2;
+}
+
+} // namespace kernels
+
+#endif
@@ -0,0 +1,166 @@
+/*
+trimesh2 contributors
+Added to this tree; not part of the upstream trimesh2 distribution.
+
+connectivity_test.cc
+Regression checks for mesh connectivity, run on the given scans.
+*/
+
+#include "TriMesh.h"
+#include "TriMesh_algo.h"
+#include <cstdio>
+#include <cstdlib>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+using namespace std;
+using namespace trimesh;
+
+
+// Read a scan, triangulated and without its grid
+static TriMesh *read_faces(const char *filename)
+{
+	TriMesh *mesh = TriMesh::read(filename);
+	if (!mesh)
+		return NULL;
+	mesh->need_faces();
+	mesh->clear_grid();
+	return mesh;
+}
+
+
+// Compare is_bdy() with a vertex having more neighbors than adjacent
+// faces, which does not depend on the orientation of the faces
+static bool check_bdy(TriMesh *mesh, const char *filename, const char *what)
+{
+	TriMesh *ref = new TriMesh;
+	ref->vertices = mesh->vertices;
+	ref->faces = mesh->faces;
+	ref->need_neighbors();
+	ref->need_adjacentfaces();
+
+	int nv = mesh->vertices.size(), nbdy = 0, nref = 0, ndiff = 0;
+	for (int i = 0; i < nv; i++) {
+		bool bdy = mesh->is_bdy(i);
+		bool refbdy = ref->neighbors[i].size() !=
+		              ref->adjacentfaces[i].size();
+		nbdy += bdy;
+		nref += refbdy;
+		ndiff += (bdy != refbdy);
+	}
+	bool ok = (ndiff == 0);
+	printf("%s: %d boundary vertices %s, %d expected: %s\n",
+		filename, nbdy, what, nref, ok ? "OK" : "FAILED");
+	delete ref;
+	return ok;
+}
+
+
+// Boundary vertices should not depend on face orientation, and should
+// be up to date after orient()
+static bool check_boundary(const char *filename)
+{
+	TriMesh *mesh = read_faces(filename);
+	if (!mesh)
+		return false;
+
+	bool ok = check_bdy(mesh, filename, "as read");
+	int nf = mesh->faces.size();
+	for (int i = 0; i < nf; i += 7)
+		swap(mesh->faces[i][1], mesh->faces[i][2]);
+	mesh->clear_across_edge();
+	ok = check_bdy(mesh, filename, "with flipped faces") && ok;
+	orient(mesh);
+	ok = check_bdy(mesh, filename, "after orient") && ok;
+
+	delete mesh;
+	return ok;
+}
+
+
+// Compute the per-vertex quantities that sum over corners
+static void need_all(TriMesh *mesh)
+{
+	mesh->need_pointareas();
+	mesh->need_normals();
+	mesh->need_curvatures();
+}
+
+
+// Are the per-vertex quantities of the two meshes identical?
+static bool same_all(const TriMesh *mesh1, const TriMesh *mesh2)
+{
+	return mesh1->pointareas == mesh2->pointareas &&
+	       mesh1->normals == mesh2->normals &&
+	       mesh1->curv1 == mesh2->curv1 &&
+	       mesh1->curv2 == mesh2->curv2;
+}
+
+
+// Quantities computed after edgeflip() should match those of a fresh
+// mesh with the same faces, with any number of threads
+static bool check_edgeflip(const char *filename)
+{
+	TriMesh *mesh = read_faces(filename);
+	if (!mesh)
+		return false;
+
+	int nthreads = 1;
+#ifdef _OPENMP
+	int max_threads = omp_get_max_threads();
+	nthreads = max(max_threads, 4);
+#endif
+	bool ok = true;
+	for (int t = 1; t <= nthreads; t *= 4) {
+#ifdef _OPENMP
+		omp_set_num_threads(t);
+#endif
+		TriMesh *flipped = new TriMesh;
+		flipped->vertices = mesh->vertices;
+		flipped->faces = mesh->faces;
+		need_all(flipped);
+		edgeflip(flipped);
+		need_all(flipped);
+
+		TriMesh *ref = new TriMesh;
+		ref->vertices = flipped->vertices;
+		ref->faces = flipped->faces;
+		need_all(ref);
+
+		bool same = same_all(flipped, ref);
+		printf("%s: quantities after edgeflip with %d thread(s): %s\n",
+			filename, t, same ? "OK" : "FAILED");
+		ok = ok && same;
+		delete ref;
+		delete flipped;
+	}
+#ifdef _OPENMP
+	omp_set_num_threads(max_threads);
+#endif
+	delete mesh;
+	return ok;
+}
+
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s scan.ply ...\n", argv[0]);
+		exit(1);
+	}
+
+	TriMesh::set_verbose(0);
+	int nfailed = 0;
+	for (int i = 1; i < argc; i++) {
+		if (!check_boundary(argv[i]))
+			nfailed++;
+		if (!check_edgeflip(argv[i]))
+			nfailed++;
+	}
+
+	if (nfailed) {
+		printf("%d checks FAILED\n", nfailed);
+		exit(1);
+	}
+	printf("All checks passed\n");
+}
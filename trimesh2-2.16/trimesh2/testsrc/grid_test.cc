@@ -0,0 +1,201 @@
+/*
+trimesh2 contributors
+Added to this tree; not part of the upstream trimesh2 distribution.
+
+grid_test.cc
+Regression checks for range grid code, run on the given scans.
+*/
+
+#include "TriMesh.h"
+#include "TriMesh_algo.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+using namespace std;
+using namespace trimesh;
+
+
+// feature_size() samples range grids directly.  It should agree with
+// the estimate from the faces of the triangulated grid.
+static bool check_feature_size(const char *filename)
+{
+	TriMesh *mesh = TriMesh::read(filename);
+	if (!mesh)
+		return false;
+	float grid_fs = mesh->feature_size();
+
+	TriMesh *tri = new TriMesh;
+	tri->vertices = mesh->vertices;
+	mesh->need_faces();
+	tri->faces = mesh->faces;
+	float face_fs = tri->feature_size();
+
+	float err = fabs(grid_fs - face_fs) / face_fs;
+	bool ok = (err < 0.05f);
+	printf("%s: feature_size %g from grid, %g from faces: %s\n",
+		filename, grid_fs, face_fs, ok ? "OK" : "FAILED");
+	delete tri;
+	delete mesh;
+	return ok;
+}
+
+
+// A copy of the range grid of mesh, without faces
+static TriMesh *grid_copy(const TriMesh *mesh)
+{
+	TriMesh *copy = new TriMesh;
+	copy->vertices = mesh->vertices;
+	copy->grid = mesh->grid;
+	copy->grid_width = mesh->grid_width;
+	copy->grid_height = mesh->grid_height;
+	return copy;
+}
+
+
+// triangulate_grid() drops slivers as it goes.  It should make the same
+// faces as triangulating everything and then calling remove_sliver_faces()
+// on the result, with any number of threads.
+static bool check_triangulation(const char *filename)
+{
+	TriMesh *mesh = TriMesh::read(filename);
+	if (!mesh)
+		return false;
+
+	TriMesh *ref = grid_copy(mesh);
+	ref->triangulate_grid(false);
+	ref->grid.clear();
+	remove_sliver_faces(ref);
+
+	int nthreads = 1;
+#ifdef _OPENMP
+	int max_threads = omp_get_max_threads();
+	nthreads = max(max_threads, 4);
+#endif
+	bool ok = true;
+	for (int t = 1; t <= nthreads; t *= 4) {
+#ifdef _OPENMP
+		omp_set_num_threads(t);
+#endif
+		TriMesh *tri = grid_copy(mesh);
+		tri->triangulate_grid(true);
+		if (tri->faces != ref->faces)
+			ok = false;
+		printf("%s: %d faces with %d thread(s), %d expected: %s\n",
+			filename, int(tri->faces.size()), t,
+			int(ref->faces.size()), ok ? "OK" : "FAILED");
+		delete tri;
+	}
+#ifdef _OPENMP
+	omp_set_num_threads(max_threads);
+#endif
+	delete ref;
+	delete mesh;
+	return ok;
+}
+
+
+// need_normals() differences the grid directly, without crossing depth
+// discontinuities.  It should agree with the normals of the triangulated
+// grid, except at a few noisy vertices, and once there are faces it
+// should use them.
+static bool check_normals(const char *filename)
+{
+	TriMesh *mesh = TriMesh::read(filename);
+	if (!mesh)
+		return false;
+
+	TriMesh *fromgrid = grid_copy(mesh);
+	fromgrid->need_normals();
+	TriMesh *tri = grid_copy(mesh);
+	tri->need_faces();
+	tri->need_normals();
+	TriMesh *fromfaces = new TriMesh;
+	fromfaces->vertices = tri->vertices;
+	fromfaces->faces = tri->faces;
+	fromfaces->need_normals();
+	fromfaces->need_adjacentfaces();
+
+	// Only vertices with at least two faces have well-defined normals
+	int n = 0, nbad = 0;
+	const float cos60 = 0.5f;
+	for (size_t i = 0; i < mesh->vertices.size(); i++) {
+		if (fromfaces->adjacentfaces_of(i).size() < 2)
+			continue;
+		n++;
+		if ((fromgrid->normals[i] DOT fromfaces->normals[i]) < cos60)
+			nbad++;
+	}
+	bool ok = (nbad < 0.001f * n) && (tri->normals == fromfaces->normals);
+	printf("%s: %d of %d grid normals off by more than 60 degrees, "
+		"%s face normals once triangulated: %s\n", filename, nbad, n,
+		tri->normals == fromfaces->normals ? "same" : "different",
+		ok ? "OK" : "FAILED");
+	delete fromfaces;
+	delete tri;
+	delete fromgrid;
+	delete mesh;
+	return ok;
+}
+
+
+// diffuse_grid_vector() should not smooth across a depth discontinuity.
+// A field that is constant on each side of a step should stay that way.
+static bool check_diffusion_step()
+{
+	const int w = 64, h = 48;
+	TriMesh *mesh = new TriMesh;
+	mesh->resize_grid(w, h);
+	vector<float> field;
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			bool near = (x < w / 2);
+			mesh->grid[x + y * w] = mesh->vertices.size();
+			mesh->vertices.push_back(point(x + 1, y + 1,
+				near ? -100.0f : -150.0f));
+			field.push_back(near ? 1.0f : -1.0f);
+		}
+	}
+	diffuse_grid_vector(mesh, field, 5.0f);
+
+	float maxerr = 0.0f;
+	for (int i = 0; i < w * h; i++) {
+		float expected = (i % w < w / 2) ? 1.0f : -1.0f;
+		maxerr = max(maxerr, fabs(field[i] - expected));
+	}
+	bool ok = (maxerr < 1.0e-5f);
+	printf("Diffusion across a depth step: max error %g: %s\n",
+		maxerr, ok ? "OK" : "FAILED");
+	delete mesh;
+	return ok;
+}
+
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s scan.ply ...\n", argv[0]);
+		exit(1);
+	}
+
+	TriMesh::set_verbose(0);
+	int nfailed = 0;
+	if (!check_diffusion_step())
+		nfailed++;
+	for (int i = 1; i < argc; i++) {
+		if (!check_feature_size(argv[i]))
+			nfailed++;
+		if (!check_triangulation(argv[i]))
+			nfailed++;
+		if (!check_normals(argv[i]))
+			nfailed++;
+	}
+
+	if (nfailed) {
+		printf("%d checks FAILED\n", nfailed);
+		exit(1);
+	}
+	printf("All checks passed\n");
+}
@@ -0,0 +1,405 @@
+/*
+trimesh2 contributors
+Added to this tree; not part of the upstream trimesh2 distribution.
+
+io_test.cc
+Round-trip checks for mesh and range grid I/O, run on the given scans.
+
+Files are read both from disk, where the readers work from a memory
+mapping, and through a named pipe, which cannot be mapped and so takes
+the stdio readers.  The two must give the same mesh.
+*/
+
+#include "TriMesh.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+using namespace std;
+using namespace trimesh;
+
+
+// Scratch directory for the files written by the checks
+static string tmpdir;
+
+static string tmpname(const char *name)
+{
+	return tmpdir + "/" + name;
+}
+
+
+// The part of a filename after the last '.', including the '.'
+static string extension(const char *filename)
+{
+	const char *dot = strrchr(filename, '.');
+	return dot ? string(dot) : string();
+}
+
+
+// Read filename through a named pipe, so the stdio readers are used.
+// If window is given, read just that part of the range grid.
+static TriMesh *read_piped(const char *filename, const int *window = NULL)
+{
+	string pipename = tmpname("pipe") + extension(filename);
+	unlink(pipename.c_str());
+	if (mkfifo(pipename.c_str(), 0600) != 0) {
+		perror("mkfifo");
+		return NULL;
+	}
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		unlink(pipename.c_str());
+		return NULL;
+	}
+	if (pid == 0) {
+		// Copy the file into the pipe.  The reader may stop early.
+		signal(SIGPIPE, SIG_DFL);
+		int in = open(filename, O_RDONLY);
+		int out = open(pipename.c_str(), O_WRONLY);
+		if (in < 0 || out < 0)
+			_exit(1);
+		char buf[65536];
+		ssize_t n;
+		while ((n = read(in, buf, sizeof(buf))) > 0) {
+			if (write(out, buf, n) != n)
+				_exit(1);
+		}
+		_exit(0);
+	}
+
+	TriMesh *mesh = window ?
+		TriMesh::read_window(pipename.c_str(),
+			window[0], window[1], window[2], window[3]) :
+		TriMesh::read(pipename.c_str());
+	waitpid(pid, NULL, 0);
+	unlink(pipename.c_str());
+	return mesh;
+}
+
+
+// Do two values agree to within tol, relative to their size?
+static inline bool close(float a, float b, float tol)
+{
+	if (a == b || (a != a && b != b))
+		return true;
+	return fabs(a - b) <= tol * max(1.0f, fabs(a));
+}
+
+template <class T>
+static bool close(const vector<T> &a, const vector<T> &b, float tol)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); i++)
+		for (int j = 0; j < 3; j++)
+			if (!close(a[i][j], b[i][j], tol))
+				return false;
+	return true;
+}
+
+
+// Compare two meshes.  Positions, confidences and (if ndeg is zero)
+// normals must agree to within tol, and colors to within 1e-6.
+// With ndeg > 0, normals must agree to within ndeg degrees.
+static bool same_mesh(const TriMesh *a, const TriMesh *b, float tol,
+	float ndeg = 0.0f)
+{
+	if (a->grid_width != b->grid_width ||
+	    a->grid_height != b->grid_height || a->grid != b->grid)
+		return false;
+	if (a->faces.size() != b->faces.size())
+		return false;
+	for (size_t i = 0; i < a->faces.size(); i++)
+		if (a->faces[i] != b->faces[i])
+			return false;
+	if (!close(a->vertices, b->vertices, tol) ||
+	    !close(a->colors, b->colors, max(tol, 1.0e-6f)))
+		return false;
+
+	if (a->confidences.size() != b->confidences.size())
+		return false;
+	for (size_t i = 0; i < a->confidences.size(); i++)
+		if (!close(a->confidences[i], b->confidences[i], tol))
+			return false;
+
+	if (ndeg == 0.0f)
+		return close(a->normals, b->normals, tol);
+	if (a->normals.size() != b->normals.size())
+		return false;
+	float mindot = cos(ndeg * M_PIf / 180.0f);
+	for (size_t i = 0; i < a->normals.size(); i++)
+		if ((a->normals[i] DOT b->normals[i]) < mindot)
+			return false;
+	return true;
+}
+
+
+// Report the result of one check
+static bool report(const char *filename, const char *what, bool ok)
+{
+	printf("%s: %s: %s\n", filename, what, ok ? "OK" : "FAILED");
+	return ok;
+}
+
+
+// Read filename from disk and through a pipe, and compare the two with
+// each other and, if given, with the expected mesh
+static bool read_both(const char *filename, const TriMesh *expected = NULL,
+	float tol = 0.0f, float ndeg = 0.0f)
+{
+	TriMesh *mapped = TriMesh::read(filename);
+	TriMesh *piped = read_piped(filename);
+	bool ok = mapped && piped && same_mesh(mapped, piped, 0.0f);
+	if (ok && expected)
+		ok = same_mesh(expected, mapped, tol, ndeg);
+	delete mapped;
+	delete piped;
+	return ok;
+}
+
+
+// A copy of the parts of mesh that a file of some type can hold
+static TriMesh *copy_of(const TriMesh *mesh, bool normals, bool colors,
+	bool grid)
+{
+	TriMesh *copy = new TriMesh;
+	copy->vertices = mesh->vertices;
+	if (normals)
+		copy->normals = mesh->normals;
+	if (colors) {
+		copy->colors = mesh->colors;
+		copy->confidences = mesh->confidences;
+	}
+	if (grid) {
+		copy->grid = mesh->grid;
+		copy->grid_width = mesh->grid_width;
+		copy->grid_height = mesh->grid_height;
+	} else {
+		copy->faces = mesh->faces;
+	}
+	return copy;
+}
+
+
+// Write mesh as name (with any prefixes in prefix), then read it back
+static bool check_write(const char *filename, TriMesh *mesh,
+	const char *prefix, const char *name, const TriMesh *expected,
+	float tol, float ndeg = 0.0f)
+{
+	string outname = tmpname(name);
+	string what = string("write ") + prefix + name;
+	bool ok = mesh->write(prefix + outname) &&
+		read_both(outname.c_str(), expected, tol, ndeg);
+	unlink(outname.c_str());
+	return report(filename, what.c_str(), ok);
+}
+
+
+// Write the scan in each PLY variant, and as .rgrid and .rgridz, and
+// read each one back
+static int check_grid_formats(const char *filename)
+{
+	TriMesh *mesh = TriMesh::read(filename);
+	if (!mesh)
+		return 1;
+	mesh->need_normals();
+
+	// 8-bit colors, so they survive every format exactly
+	int nv = mesh->vertices.size();
+	mesh->colors.resize(nv);
+	for (int i = 0; i < nv; i++)
+		mesh->colors[i] = Color(i & 0xff, (i >> 8) & 0xff,
+			(i * 7) & 0xff);
+
+	// ASCII is written with 7 significant digits
+	const float asc_tol = 1.0e-6f;
+	TriMesh *plain = copy_of(mesh, false, true, true);
+	TriMesh *full = copy_of(mesh, true, true, true);
+
+	int nfailed = 0;
+	nfailed += !check_write(filename, mesh, "", "le.ply", plain, 0.0f);
+	nfailed += !check_write(filename, mesh, "be:", "be.ply", plain, 0.0f);
+	nfailed += !check_write(filename, mesh, "norm:", "norm.ply", full, 0.0f);
+	nfailed += !check_write(filename, mesh, "be:norm:cflt:", "becflt.ply",
+		full, 0.0f);
+	nfailed += !check_write(filename, mesh, "ascii:", "asc.ply",
+		plain, asc_tol);
+	nfailed += !check_write(filename, mesh, "ascii:norm:", "ascnorm.ply",
+		full, asc_tol);
+
+	// Normals are stored with 16-bit octahedral coordinates
+	const float rgrid_deg = 0.05f;
+	nfailed += !check_write(filename, mesh, "", "grid.rgrid",
+		full, 0.0f, rgrid_deg);
+	nfailed += !check_write(filename, mesh, "", "grid.rgridz",
+		full, 0.0f, rgrid_deg);
+
+	delete full;
+	delete plain;
+	delete mesh;
+	return nfailed;
+}
+
+
+// Write the triangulated scan as OBJ, OFF, SM and PTS, and read each
+// one back
+static int check_face_formats(const char *filename)
+{
+	TriMesh *mesh = TriMesh::read(filename);
+	if (!mesh)
+		return 1;
+	mesh->need_normals();
+	mesh->need_faces();
+	mesh->clear_grid();
+	mesh->confidences.clear();
+
+	// OBJ and OFF are written with 7 significant digits, and PTS with
+	// 6 places after the decimal point
+	const float asc_tol = 1.0e-6f;
+	TriMesh *obj = copy_of(mesh, true, false, false);
+	TriMesh *off = copy_of(mesh, false, false, false);
+	TriMesh *pts = copy_of(mesh, true, false, false);
+	pts->faces.clear();
+
+	int nfailed = 0;
+	nfailed += !check_write(filename, mesh, "norm:", "mesh.obj",
+		obj, asc_tol);
+	nfailed += !check_write(filename, mesh, "", "mesh.off", off, asc_tol);
+	nfailed += !check_write(filename, mesh, "", "mesh.sm", off, asc_tol);
+	nfailed += !check_write(filename, mesh, "", "mesh.pts", pts, asc_tol);
+
+	delete pts;
+	delete off;
+	delete obj;
+	delete mesh;
+	return nfailed;
+}
+
+
+// The window x0 <= x < x1, y0 <= y < y1 of mesh's range grid, made by
+// hand: the referenced vertices, in their original order
+static TriMesh *crop(const TriMesh *mesh, int x0, int y0, int x1, int y1)
+{
+	x0 = max(x0, 0);  x1 = min(x1, mesh->grid_width);
+	y0 = max(y0, 0);  y1 = min(y1, mesh->grid_height);
+	if (x1 < x0) x1 = x0;
+	if (y1 < y0) y1 = y0;
+
+	vector<int> remap(mesh->vertices.size(), -1);
+	for (int y = y0; y < y1; y++)
+		for (int x = x0; x < x1; x++) {
+			int i = mesh->grid[x + y * mesh->grid_width];
+			if (i >= 0)
+				remap[i] = 0;
+		}
+
+	TriMesh *out = new TriMesh;
+	for (size_t i = 0; i < remap.size(); i++) {
+		if (remap[i] < 0)
+			continue;
+		remap[i] = out->vertices.size();
+		out->vertices.push_back(mesh->vertices[i]);
+		if (!mesh->normals.empty())
+			out->normals.push_back(mesh->normals[i]);
+		if (!mesh->colors.empty())
+			out->colors.push_back(mesh->colors[i]);
+		if (!mesh->confidences.empty())
+			out->confidences.push_back(mesh->confidences[i]);
+	}
+
+	out->resize_grid(x1 - x0, y1 - y0);
+	for (int y = y0; y < y1; y++)
+		for (int x = x0; x < x1; x++) {
+			int i = mesh->grid[x + y * mesh->grid_width];
+			if (i >= 0)
+				out->grid[(x - x0) + (y - y0) * out->grid_width] =
+					remap[i];
+		}
+	return out;
+}
+
+
+// read_window() should give the same mesh as reading everything and
+// cropping, from disk and through a pipe
+static int check_windows(const char *filename)
+{
+	TriMesh *mesh = TriMesh::read(filename);
+	if (!mesh)
+		return 1;
+	int w = mesh->grid_width, h = mesh->grid_height;
+	const int windows[][4] = {
+		{ w / 4, h / 3, w / 2, h / 2 },
+		{ -10, -10, w / 3, 64 },
+		{ w - 17, h - 100, w + 50, h + 50 },
+		{ 0, 0, w, h },
+		{ 0, h / 2, w, h / 2 + 1 },
+		{ w + 1, 0, w + 10, h },
+	};
+	int nwindows = sizeof(windows) / sizeof(windows[0]);
+
+	int nfailed = 0;
+	for (int i = 0; i < nwindows; i++) {
+		const int *win = windows[i];
+		TriMesh *expected = crop(mesh, win[0], win[1], win[2], win[3]);
+		TriMesh *mapped = TriMesh::read_window(filename,
+			win[0], win[1], win[2], win[3]);
+		TriMesh *piped = read_piped(filename, win);
+		bool ok = mapped && piped &&
+			same_mesh(expected, mapped, 0.0f) &&
+			same_mesh(expected, piped, 0.0f);
+		char what[128];
+		sprintf(what, "read_window(%d, %d, %d, %d)",
+			win[0], win[1], win[2], win[3]);
+		nfailed += !report(filename, what, ok);
+		delete piped;
+		delete mapped;
+		delete expected;
+	}
+	delete mesh;
+	return nfailed;
+}
+
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s scan.ply ...\n", argv[0]);
+		exit(1);
+	}
+
+	const char *tmp = getenv("TMPDIR");
+	string dirname = string(tmp && *tmp ? tmp : "/tmp") + "/io_testXXXXXX";
+	vector<char> dirbuf(dirname.begin(), dirname.end());
+	dirbuf.push_back('\0');
+	if (!mkdtemp(&dirbuf[0])) {
+		perror("mkdtemp");
+		exit(1);
+	}
+	tmpdir = &dirbuf[0];
+
+	TriMesh::set_verbose(0);
+	int nfailed = 0;
+	for (int i = 1; i < argc; i++) {
+		if (!report(argv[i], "read", read_both(argv[i])))
+			nfailed++;
+		nfailed += check_grid_formats(argv[i]);
+		nfailed += check_face_formats(argv[i]);
+		nfailed += check_windows(argv[i]);
+	}
+	rmdir(tmpdir.c_str());
+
+	if (nfailed) {
+		printf("%d checks FAILED\n", nfailed);
+		exit(1);
+	}
+	printf("All checks passed\n");
+}
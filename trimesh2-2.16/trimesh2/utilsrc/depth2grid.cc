@@ -0,0 +1,80 @@
+/*
+trimesh2 contributors
+Added to this tree; not part of the upstream trimesh2 distribution.
+
+depth2grid.cc
+Turn a depth map (and optionally normal and confidence maps) into a
+range grid.
+*/
+
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include "TriMesh.h"
+#include "DepthMap.h"
+#ifdef _WIN32
+# include "wingetopt.h"
+#else
+# include <unistd.h>
+#endif
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+using namespace std;
+using namespace trimesh;
+
+
+void usage(const char *myname)
+{
+	fprintf(stderr, "Usage: %s [options] depth.{pfm,npy,raw} out.ply\n", myname);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "	-f file.fc	Camera intrinsics (fx fy cx cy) - required\n");
+	fprintf(stderr, "	-n normals	Normal map (normals are written to out.ply)\n");
+	fprintf(stderr, "	-c conf		Confidence map\n");
+	fprintf(stderr, "	-z zmin:zmax	Keep only depths in this range\n");
+	fprintf(stderr, "	-s WxH		Size of raw depth maps\n");
+	exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char *fcfile = NULL, *normalfile = NULL, *conffile = NULL;
+	int raw_width = 0, raw_height = 0;
+	DepthCamera cam;
+
+	int c;
+	while ((c = getopt(argc, argv, "hf:n:c:z:s:")) != EOF) {
+		switch (c) {
+			case 'f': fcfile = optarg; break;
+			case 'n': normalfile = optarg; break;
+			case 'c': conffile = optarg; break;
+			case 'z':
+				if (sscanf(optarg, "%f:%f", &cam.zmin, &cam.zmax) != 2)
+					usage(argv[0]);
+				break;
+			case 's':
+				if (sscanf(optarg, "%dx%d", &raw_width, &raw_height) != 2)
+					usage(argv[0]);
+				break;
+			default: usage(argv[0]);
+		}
+	}
+	if (argc - optind != 2 || !fcfile)
+		usage(argv[0]);
+	if (!cam.read_fc(fcfile))
+		exit(1);
+
+	TriMesh *mesh = read_depth_grid(argv[optind], normalfile, conffile,
+		cam, raw_width, raw_height);
+	if (!mesh)
+		exit(1);
+	// Normals are the point of giving a normal map, so always write them
+	string outfile = argv[optind+1];
+	if (normalfile)
+		outfile = "norm:" + outfile;
+	if (!mesh->write(outfile))
+		exit(1);
+	delete mesh;
+}
@@ -0,0 +1,295 @@
+/*
+trimesh2 contributors
+Added to this tree; not part of the upstream trimesh2 distribution.
+
+grid_merge.cc
+Merge a range grid that was cut into overlapping tiles back into one grid.
+
+The grid is cut into nx x ny tiles.  Along each side, every tile but the
+last gets size/n cells, and the last gets the rest.  Each tile is then
+grown by the overlap on every side that is not at the edge of the grid.
+Only the cells of a tile's own (core) region are kept.
+*/
+
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include "TriMesh.h"
+#ifdef _WIN32
+# include "wingetopt.h"
+#else
+# include <unistd.h>
+#endif
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+using namespace std;
+using namespace trimesh;
+
+
+void usage(const char *myname)
+{
+	fprintf(stderr, "Usage: %s [options] tileprefix out.ply\n", myname);
+	fprintf(stderr, "Reads the tile in row i, column j from \"tileprefix<i> <j>.ply\",\n");
+	fprintf(stderr, "or, if tileprefix has a %%, from the file named by the printf format\n");
+	fprintf(stderr, "tileprefix with arguments i and j (e.g., tile_%%d_%%d.ply)\n");
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "	-s WxH		Size of the whole grid - required\n");
+	fprintf(stderr, "	-n N or NXxNY	Number of tiles across and down (default 5x5)\n");
+	fprintf(stderr, "	-o overlap	Cells of overlap on each side of a tile (default 0)\n");
+	fprintf(stderr, "	-m		Allow missing tiles, leaving their cells empty\n");
+	exit(1);
+}
+
+
+// The cells [start, end) of the core of tile i of n along a side of the
+// given size
+static void tile_core(int size, int n, int i, int &start, int &end)
+{
+	int step = size / n;
+	start = i * step;
+	end = (i == n - 1) ? size : start + step;
+}
+
+
+// The name of the tile in row i, column j
+static string tile_name(const char *prefix, int i, int j)
+{
+	if (strchr(prefix, '%')) {
+		size_t len = strlen(prefix) + 64;
+		vector<char> buf(len);
+		snprintf(&buf[0], len, prefix, i, j);
+		return string(&buf[0]);
+	}
+	char buf[64];
+	sprintf(buf, "%d %d.ply", i, j);
+	return string(prefix) + buf;
+}
+
+
+// The valid cells of the core of a tile, and their vertices, in
+// row-major order
+struct Tile {
+	bool loaded, bad;
+	int w, h;                  // Size of the core
+	vector<int> row_count;     // Valid cells in each row
+	vector<size_t> row_start;  // Index of first output vertex of each row
+	vector<bool> valid;
+	vector<point> vertices;
+	vector<vec> normals;
+	vector<Color> colors;
+	vector<float> confidences;
+
+	Tile() : loaded(false), bad(false), w(0), h(0)
+		{}
+
+	// Give back the memory of the vertices
+	void release()
+	{
+		vector<point>().swap(vertices);
+		vector<vec>().swap(normals);
+		vector<Color>().swap(colors);
+		vector<float>().swap(confidences);
+	}
+};
+
+
+// Read a tile, and keep its core (x0, y0, w, h) within the tile.  A tile
+// that cannot be read is an error unless allow_missing is set.
+static void load_tile(const string &name, int tile_w, int tile_h,
+	int x0, int y0, bool allow_missing, Tile &tile)
+{
+	TriMesh *mesh = TriMesh::read(name);
+	if (!mesh) {
+		if (allow_missing) {
+			fprintf(stderr, "Missing tile %s - leaving it empty\n",
+				name.c_str());
+		} else {
+			fprintf(stderr, "Missing tile %s\n", name.c_str());
+			tile.bad = true;
+		}
+		return;
+	}
+	if (mesh->grid_width != tile_w || mesh->grid_height != tile_h ||
+	    mesh->grid.size() != size_t(tile_w) * tile_h) {
+		fprintf(stderr, "Tile %s is %d x %d, but should be %d x %d\n",
+			name.c_str(), mesh->grid_width, mesh->grid_height,
+			tile_w, tile_h);
+		tile.bad = true;
+		delete mesh;
+		return;
+	}
+
+	int nv = mesh->vertices.size();
+	bool have_norm = !mesh->normals.empty();
+	bool have_color = !mesh->colors.empty();
+	bool have_conf = !mesh->confidences.empty();
+	tile.valid.resize(size_t(tile.w) * tile.h);
+	tile.row_count.resize(tile.h);
+	tile.row_start.resize(tile.h);
+	for (int y = 0; y < tile.h; y++) {
+		const int *row = &mesh->grid[size_t(y0 + y) * tile_w + x0];
+		for (int x = 0; x < tile.w; x++) {
+			int ind = row[x];
+			if (ind < 0 || ind >= nv)
+				continue;
+			tile.valid[size_t(y) * tile.w + x] = true;
+			tile.row_count[y]++;
+			tile.vertices.push_back(mesh->vertices[ind]);
+			if (have_norm)
+				tile.normals.push_back(mesh->normals[ind]);
+			if (have_color)
+				tile.colors.push_back(mesh->colors[ind]);
+			if (have_conf)
+				tile.confidences.push_back(mesh->confidences[ind]);
+		}
+	}
+	tile.loaded = true;
+	delete mesh;
+}
+
+
+int main(int argc, char *argv[])
+{
+	int width = 0, height = 0, nx = 5, ny = 5, overlap = 0;
+	bool allow_missing = false;
+
+	int c;
+	while ((c = getopt(argc, argv, "hs:n:o:m")) != EOF) {
+		switch (c) {
+			case 's':
+				if (sscanf(optarg, "%dx%d", &width, &height) != 2)
+					usage(argv[0]);
+				break;
+			case 'n':
+				if (sscanf(optarg, "%dx%d", &nx, &ny) != 2) {
+					nx = ny = atoi(optarg);
+				}
+				break;
+			case 'o': overlap = atoi(optarg); break;
+			case 'm': allow_missing = true; break;
+			default: usage(argv[0]);
+		}
+	}
+	if (argc - optind != 2 || width <= 0 || height <= 0)
+		usage(argv[0]);
+	if (nx < 1 || ny < 1 || nx > width || ny > height || overlap < 0) {
+		fprintf(stderr, "Bad tile layout\n");
+		usage(argv[0]);
+	}
+	const char *prefix = argv[optind], *outfile = argv[optind+1];
+
+	// Read the tiles, several at once, keeping just their cores
+	int ntiles = nx * ny;
+	vector<Tile> tiles(ntiles);
+	TriMesh::set_verbose(0);
+#pragma omp parallel for schedule(dynamic)
+	for (int t = 0; t < ntiles; t++) {
+		int i = t / nx, j = t % nx;
+		int cx0, cx1, cy0, cy1;
+		tile_core(width, nx, j, cx0, cx1);
+		tile_core(height, ny, i, cy0, cy1);
+		int tx0 = max(cx0 - overlap, 0), tx1 = min(cx1 + overlap, width);
+		int ty0 = max(cy0 - overlap, 0), ty1 = min(cy1 + overlap, height);
+		tiles[t].w = cx1 - cx0;
+		tiles[t].h = cy1 - cy0;
+		load_tile(tile_name(prefix, i, j), tx1 - tx0, ty1 - ty0,
+			cx0 - tx0, cy0 - ty0, allow_missing, tiles[t]);
+	}
+	TriMesh::set_verbose(1);
+
+	// Attributes are kept if every tile has them
+	bool any = false, bad = false;
+	bool have_norm = true, have_color = true, have_conf = true;
+	for (int t = 0; t < ntiles; t++) {
+		bad = bad || tiles[t].bad;
+		if (!tiles[t].loaded || tiles[t].vertices.empty())
+			continue;
+		any = true;
+		have_norm = have_norm && !tiles[t].normals.empty();
+		have_color = have_color && !tiles[t].colors.empty();
+		have_conf = have_conf && !tiles[t].confidences.empty();
+	}
+	if (bad)
+		exit(1);
+	if (!any) {
+		fprintf(stderr, "No vertices in any tile\n");
+		exit(1);
+	}
+
+	// Output vertices are in row-major order of their cells, so the first
+	// one in each row of each tile comes from a prefix sum over the valid
+	// cells in the rows of the tiles, taken across and then down
+	size_t nv = 0;
+	for (int i = 0; i < ny; i++) {
+		int h = tiles[i * nx].h;
+		for (int y = 0; y < h; y++) {
+			for (int j = 0; j < nx; j++) {
+				Tile &tile = tiles[i * nx + j];
+				if (!tile.loaded)
+					continue;
+				tile.row_start[y] = nv;
+				nv += tile.row_count[y];
+			}
+		}
+	}
+
+	TriMesh *mesh = new TriMesh;
+	mesh->grid_width = width;
+	mesh->grid_height = height;
+	mesh->grid.resize(size_t(width) * height, TriMesh::GRID_INVALID);
+	mesh->vertices.resize(nv);
+	if (have_norm)
+		mesh->normals.resize(nv);
+	if (have_color)
+		mesh->colors.resize(nv);
+	if (have_conf)
+		mesh->confidences.resize(nv);
+
+	// Each tile fills in its own cells and vertices
+#pragma omp parallel for schedule(dynamic)
+	for (int t = 0; t < ntiles; t++) {
+		Tile &tile = tiles[t];
+		if (!tile.loaded)
+			continue;
+		int i = t / nx, j = t % nx, cx0, cx1, cy0, cy1;
+		tile_core(width, nx, j, cx0, cx1);
+		tile_core(height, ny, i, cy0, cy1);
+		size_t src = 0;
+		for (int y = 0; y < tile.h; y++) {
+			int *grid = &mesh->grid[size_t(cy0 + y) * width + cx0];
+			size_t dst = tile.row_start[y];
+			for (int x = 0; x < tile.w; x++) {
+				if (!tile.valid[size_t(y) * tile.w + x])
+					continue;
+				grid[x] = int(dst);
+				mesh->vertices[dst] = tile.vertices[src];
+				if (have_norm)
+					mesh->normals[dst] = tile.normals[src];
+				if (have_color)
+					mesh->colors[dst] = tile.colors[src];
+				if (have_conf)
+					mesh->confidences[dst] =
+						tile.confidences[src];
+				src++, dst++;
+			}
+		}
+		tile.release();
+	}
+	tiles.clear();
+
+	printf("Merged %d x %d tiles into a %d x %d grid with %lu vertices\n",
+		nx, ny, width, height, (unsigned long) nv);
+
+	// Keep the normals, which the PLY writer leaves out unless asked
+	string outname = outfile;
+	if (have_norm)
+		outname = "norm:" + outname;
+	if (!mesh->write(outname))
+		exit(1);
+	delete mesh;
+}
@@ -128,9 +128,10 @@ bool bad_edge(const TriMesh *themesh,
 {
 	int numforwards = 0, numbackwards = 0;
 
-	int naf1 = themesh->adjacentfaces[v1].size();
+	TriMesh::IndexList a1 = themesh->adjacentfaces_of(v1);
+	int naf1 = a1.size();
 	for (int i = 0; i < naf1; i++) {
-		int ind = themesh->adjacentfaces[v1][i];
+		int ind = a1[i];
 		if (bad_faces[ind])
 			continue;
 		const TriMesh::Face &f = themesh->faces[ind];
@@ -308,21 +309,21 @@ int main(int argc, char *argv[])
 	vector<int> suspect_faces;
 	for (int i = 0; i < nf; i++) {
 		if (bad_edge(in, in->faces[i][0], in->faces[i][1], bad_faces)) {
-			if (in->adjacentfaces[in->faces[i][2]].size() == 1) {
+			if (in->adjacentfaces_of(in->faces[i][2]).size() == 1) {
 				bad_faces[i] = true;
 				num_bad_faces++;
 			} else {
 				suspect_faces.push_back(i);
 			}
 		} else if (bad_edge(in, in->faces[i][1], in->faces[i][2], bad_faces)) {
-			if (in->adjacentfaces[in->faces[i][0]].size() == 1) {
+			if (in->adjacentfaces_of(in->faces[i][0]).size() == 1) {
 				bad_faces[i] = true;
 				num_bad_faces++;
 			} else {
 				suspect_faces.push_back(i);
 			}
 		} else if (bad_edge(in, in->faces[i][2], in->faces[i][0], bad_faces)) {
-			if (in->adjacentfaces[in->faces[i][1]].size() == 1) {
+			if (in->adjacentfaces_of(in->faces[i][1]).size() == 1) {
 				bad_faces[i] = true;
 				num_bad_faces++;
 			} else {
@@ -350,7 +351,7 @@ int main(int argc, char *argv[])
 	}
 	printf("Done.\n");
 
-	in->adjacentfaces.clear();
+	in->clear_adjacentfaces();
 	if (num_bad_faces) {
 		remove_faces(in, bad_faces);
 		had_problems = true;
@@ -92,6 +92,9 @@ void usage(const char *myname)
 	fprintf(stderr, "	-nogrid		Unpack range grid to faces\n");
 	fprintf(stderr, "	-nofaces	Delete all tris/tstrips/grid\n");
 	fprintf(stderr, "	-reorder	Optimize order of vertices\n");
+	fprintf(stderr, "	-morton		Order vertices and faces along a Morton curve\n");
+	fprintf(stderr, "	-hilbert	Order vertices and faces along a Hilbert curve\n");
+	fprintf(stderr, "	-gridtiles n	Order range grid vertices by n x n tiles\n");
 	fprintf(stderr, "	-orient		Auto-orient faces within the mesh\n");
 	fprintf(stderr, "	-faceflip	Flip the order of vertices within each face\n");
 	fprintf(stderr, "	-edgeflip	Optimize triangle connectivity by flipping edges\n");
@@ -186,6 +189,17 @@ int main(int argc, char *argv[])
 			themesh->grid.clear();
 		} else if (!strcmp(argv[i], "-reorder")) {
 			reorder_verts(themesh);
+		} else if (!strcmp(argv[i], "-morton")) {
+			reorder_verts(themesh, REORDER_MORTON);
+		} else if (!strcmp(argv[i], "-hilbert")) {
+			reorder_verts(themesh, REORDER_HILBERT);
+		} else if (!strcmp(argv[i], "-gridtiles")) {
+			i++;
+			if (!(i < argc && isanint(argv[i]) && atoi(argv[i]) > 0)) {
+				fprintf(stderr, "\n-gridtiles requires one int parameter: n\n\n");
+				usage(argv[0]);
+			}
+			reorder_verts(themesh, REORDER_GRID_TILES, atoi(argv[i]));
 		} else if (!strcmp(argv[i], "-orient")) {
 			orient(themesh);
 		} else if (!strcmp(argv[i], "-faceflip")) {
@@ -212,7 +226,6 @@ int main(int argc, char *argv[])
 			}
 			float amount = ATOF(argv[i]) * themesh->feature_size();
 			smooth_mesh(themesh, amount);
-			themesh->pointareas.clear();
 			themesh->normals.clear();
 		} else if (!strcmp(argv[i], "-bilat")) {
 			i++;
@@ -228,7 +241,10 @@ int main(int argc, char *argv[])
 				usage(argv[0]);
 			}
 			float sr = ATOF(argv[i]) * fs;
-			bilateral_smooth_mesh(themesh, sd, sr);
+			if (!themesh->grid.empty())
+				bilateral_smooth_grid(themesh, sd, sr);
+			else
+				bilateral_smooth_mesh(themesh, sd, sr);
 			themesh->normals.clear();
 		} else if (!strcmp(argv[i], "-sharpen")) {
 			i++;
@@ -242,7 +258,7 @@ int main(int argc, char *argv[])
 			for (size_t v = 0; v < themesh->vertices.size(); v++)
 				themesh->vertices[v] += 2.0f *
 					(origverts[v] - themesh->vertices[v]);
-			themesh->pointareas.clear();
+			themesh->changed_geometry();
 			themesh->normals.clear();
 		} else if (!strcmp(argv[i], "-smoothnorm")) {
 			i++;
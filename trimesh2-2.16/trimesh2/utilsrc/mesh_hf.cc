@@ -8,6 +8,7 @@ Based on initial ideas developed together with Olaf Hall-Holt.
 */
 
 #include "TriMesh.h"
+#include "CornerTable.h"
 #ifdef _WIN32
 # include "wingetopt.h"
 #else
@@ -98,38 +99,17 @@ void update_neighbor(FaceStruct &f, int i, int j)
 }
 
 
-// Find all the boundary edges
-edgeset *find_boundary_edges(const TriMesh *themesh)
-{
-	printf("Finding boundary edges... "); fflush(stdout);
-	edgeset *edges = new edgeset;
-
-	for (size_t f = 0; f < themesh->faces.size(); f++) {
-		for (int i = 0; i < 3; i++) {
-			int v1 = themesh->faces[f][i];
-			int v2 = themesh->faces[f][NEXT_MOD3(i)];
-
-			// Opposite-pointing edges cancel each other
-			if (!edges->erase(make_pair(v2,v1)))
-				edges->insert(make_pair(v1,v2));
-		}
-	}
-
-	printf("Done.\n");
-	return edges;
-}
-
-
 // Find the initial (before hole-filling) neighbors of all the boundary verts
 void find_initial_edge_neighbors(const TriMesh *themesh,
-                                 const edgeset *edges,
+                                 const vector<hole> *holes,
                                  map< int, set<int> > &initial_edge_neighbors)
 {
 	size_t nv = themesh->vertices.size(), nf = themesh->faces.size();
 	vector<bool> is_edge(nv);
-	for (edgeset::const_iterator i = edges->begin(); i != edges->end(); i++) {
-		is_edge[i->first] = true;
-		is_edge[i->second] = true;
+	for (size_t i = 0; i < holes->size(); i++) {
+		const hole &h = (*holes)[i];
+		for (size_t j = 0; j < h.size(); j++)
+			is_edge[h[j]] = true;
 	}
 
 	for (size_t i = 0; i < nf; i++) {
@@ -152,81 +132,51 @@ void find_initial_edge_neighbors(const TriMesh *themesh,
 }
 
 
-// Find a list of holes, given the boundary edges
-vector<hole> *find_holes(edgeset *edges)
+// Split a boundary loop that passes through some vertex more than once
+// (where several fans of faces meet) into holes that do not, appending
+// them to holelist
+void split_loop(const vector<int> &loop, vector<hole> *holelist)
 {
-	printf("Finding holes... "); fflush(stdout);
-	vector<hole> *holelist = new vector<hole>;
-	edgeset badedges;
-
-	while (!edges->empty()) {
-		// Find an edge at which to start
-		const edge &firstedge = *(edges->begin());
-		int firstvert = firstedge.first;
-		int lastvert = firstedge.second;
-		edges->erase(edges->begin());
-
-		// Add the verts as the first two in a new hole
-		holelist->push_back(hole());
-		hole &newhole = holelist->back();
-		newhole.push_back(firstvert);
-		newhole.push_back(lastvert);
-
-		// Follow edges to find the rest of this hole
-		while (1) {
-
-			// Find an edge that starts at lastvert
-			edgeset::iterator ei = edges->upper_bound(make_pair(lastvert,-1));
-			if (ei == edges->end() || ei->first != lastvert) {
-				fprintf(stderr, "\nCouldn't find an edge out of vert %d\n", lastvert);
-				exit(1);
-			}
-			int nextvert = ei->second;
-			edges->erase(ei);
-
-			// Are we done?
-			if (nextvert == firstvert)
-				break;
-
-			// Have we encountered this vertex before in this hole?
-			// XXX - linear search.  Yuck.
-			hole::iterator hi = find(newhole.begin(), newhole.end(),
-			                         nextvert);
-			if (hi != newhole.end()) {
-				// Assuming everything is OK topologically,
-				// this could only have been caused if there
-				// was a choice of ways to go the last time
-				// we encountered this vertex.  Obviously,
-				// we chose the wrong way, so find a different
-				// way to go.
-				edgeset::iterator nei = edges->upper_bound(make_pair(nextvert,-1));
-				if (nei == edges->end() || nei->first != nextvert) {
-					fprintf(stderr, "\nCouldn't find an edge out of vert %d\n", nextvert);
-					exit(1);
-				}
-				// XXX - for paranoia's sake, we should check
-				// that nei->second is not in newhole
-
-				// Put the bad edges into "badedges"
-				for (hole::iterator tmp = hi; tmp+1 != newhole.end(); tmp++)
-					badedges.insert(make_pair(*tmp, *(tmp+1)));
-				badedges.insert(make_pair(lastvert, nextvert));
-				newhole.erase(hi+1, newhole.end());
-
-				// Take the new edge, and run with it
-				lastvert = nei->second;
-				newhole.push_back(lastvert);
-				edges->erase(nei);
-			} else {
-				// All OK.  Add this vert to the hole and go on
-				newhole.push_back(nextvert);
-				lastvert = nextvert;
-			}
+	hole h;
+	map<int, size_t> where;
+	for (size_t i = 0; i < loop.size(); i++) {
+		int v = loop[i];
+		map<int, size_t>::iterator wi = where.find(v);
+		if (wi == where.end()) {
+			where[v] = h.size();
+			h.push_back(v);
+			continue;
 		}
-		edges->insert(badedges.begin(), badedges.end());
-		badedges.clear();
+		// Back at v, so everything since then is a hole of its own
+		size_t start = wi->second;
+		holelist->push_back(hole(h.begin() + start, h.end()));
+		for (size_t j = start + 1; j < h.size(); j++)
+			where.erase(h[j]);
+		h.erase(h.begin() + start + 1, h.end());
 	}
+	holelist->push_back(h);
+}
 
+
+// Find a list of holes: the boundary loops of the mesh, traced by walking
+// around vertices through the opposite-corner table
+vector<hole> *find_holes(TriMesh *themesh)
+{
+	printf("Finding holes... "); fflush(stdout);
+	vector< vector<int> > loops;
+	CornerTable(themesh).boundary_loops(loops);
+	vector<hole> *holelist = new vector<hole>;
+	for (size_t i = 0; i < loops.size(); i++)
+		split_loop(loops[i], holelist);
+
+	// Start each hole at its lowest-numbered vertex and list the holes
+	// in order of their first edge, so the fill is independent of
+	// face order
+	for (size_t i = 0; i < holelist->size(); i++) {
+		hole &h = (*holelist)[i];
+		rotate(h.begin(), min_element(h.begin(), h.end()), h.end());
+	}
+	sort(holelist->begin(), holelist->end());
 	printf("Done.\n");
 	return holelist;
 }
@@ -1056,13 +1006,10 @@ int main(int argc, char *argv[])
 	bool had_tstrips = !themesh->tstrips.empty();
 	themesh->tstrips.clear();
 
-	edgeset *edges = find_boundary_edges(themesh);
+	vector<hole> *holes = find_holes(themesh);
 
 	map< int, set<int> > initial_edge_neighbors;
-	find_initial_edge_neighbors(themesh, edges, initial_edge_neighbors);
-
-	vector<hole> *holes = find_holes(edges);
-	delete edges;
+	find_initial_edge_neighbors(themesh, holes, initial_edge_neighbors);
 
 	if (listonly) {
 		print_holes(holes, true);
@@ -21,7 +21,7 @@ using namespace trimesh;
 
 void usage(const char *myname)
 {
-	fprintf(stderr, "Usage: %s infile [-noxf] ( desired_info | stat_op desired_stat )\n", myname);
+	fprintf(stderr, "Usage: %s infile [-noxf] [-memreport] ( desired_info | stat_op desired_stat )\n", myname);
 	fprintf(stderr, "\nInfo:\n");
 	fprintf(stderr, "	faces		Number of faces\n");
 	fprintf(stderr, "	vertices	Number of vertices\n");
@@ -57,11 +57,21 @@ void usage(const char *myname)
 	fprintf(stderr, "	y		Vertex Y coordinate\n");
 	fprintf(stderr, "	z		Vertex Z coordinate\n");
 	fprintf(stderr, "\nAutomatically reads infile.xf unless -noxf is passed\n");
+	fprintf(stderr, "-memreport prints the memory used by the mesh to stderr\n");
 	fprintf(stderr, "\n");
 	exit(1);
 }
 
 
+// Report memory use after the query, if requested
+static int done(const TriMesh *mesh, bool memreport)
+{
+	if (memreport)
+		mesh->print_memory_usage(stderr, "after query");
+	return 0;
+}
+
+
 int main(int argc, char *argv[])
 {
 	// Don't clutter the output
@@ -72,16 +82,20 @@ int main(int argc, char *argv[])
 		usage(argv[0]);
 
 	const char *filename = argv[1];
-	const char *info_type = argv[2];
-	const char *info_param = (argc > 3) ? argv[3] : NULL;
-	bool use_xf = true;
-	if (!strcmp(argv[2], "-noxf")) {
-		if (argc < 4)
-			usage(argv[0]);
-		use_xf = false;
-		info_type = argv[3];
-		info_param = (argc > 4) ? argv[4] : NULL;
+	bool use_xf = true, memreport = false;
+	int i = 2;
+	for ( ; i < argc; i++) {
+		if (!strcmp(argv[i], "-noxf"))
+			use_xf = false;
+		else if (!strcmp(argv[i], "-memreport"))
+			memreport = true;
+		else
+			break;
 	}
+	if (i >= argc)
+		usage(argv[0]);
+	const char *info_type = argv[i];
+	const char *info_param = (argc > i + 1) ? argv[i + 1] : NULL;
 
 	TriMesh *mesh = TriMesh::read(filename);
 	if (!mesh)
@@ -92,73 +106,75 @@ int main(int argc, char *argv[])
 		if (xf.read(xfname(filename)))
 			apply_xform(mesh, xf);
 	}
+	if (memreport)
+		mesh->print_memory_usage(stderr, "after reading");
 
 	// Figure out what we want
 	if (!strcmp(info_type, "faces")) {
 		mesh->need_faces();
 		printf("%d\n", (int) mesh->faces.size());
-		return 0;
+		return done(mesh, memreport);
 	} else if (!strcmp(info_type, "vertices")) {
 		printf("%d\n", (int) mesh->vertices.size());
-		return 0;
+		return done(mesh, memreport);
 	} else if (!strcmp(info_type, "bbox")) {
 		mesh->need_bbox();
 		printf("%g %g %g\n%g %g %g\n",
 			mesh->bbox.min[0], mesh->bbox.min[1], mesh->bbox.min[2],
 			mesh->bbox.max[0], mesh->bbox.max[1], mesh->bbox.max[2]);
-		return 0;
+		return done(mesh, memreport);
 	} else if (!strcmp(info_type, "csize")) {
 		mesh->need_bbox();
 		printf("%g %g %g\n%g %g %g\n",
 			mesh->bbox.center()[0], mesh->bbox.center()[1], mesh->bbox.center()[2],
 			mesh->bbox.size()[0], mesh->bbox.size()[1], mesh->bbox.size()[2]);
-		return 0;
+		return done(mesh, memreport);
 	} else if (!strcmp(info_type, "bsphere")) {
 		mesh->need_bsphere();
 		printf("%g %g %g\n%g\n",
 			mesh->bsphere.center[0], mesh->bsphere.center[1], mesh->bsphere.center[2],
 			mesh->bsphere.r);
-		return 0;
+		return done(mesh, memreport);
 	} else if (!strcmp(info_type, "vert_mean")) {
 		point p = point_center_of_mass(mesh->vertices);
 		printf("%g %g %g\n", p[0], p[1], p[2]);
-		return 0;
+		return done(mesh, memreport);
 	} else if (!strcmp(info_type, "face_mean")) {
 		point p = mesh_center_of_mass(mesh);
 		printf("%g %g %g\n", p[0], p[1], p[2]);
-		return 0;
+		return done(mesh, memreport);
 	} else if (!strcmp(info_type, "vert_stdev")) {
 		trans(mesh, -point_center_of_mass(mesh->vertices));
 		float C[3][3];
 		point_covariance(mesh->vertices, C);
 		printf("%g\n", sqrt(C[0][0] + C[1][1] + C[2][2]));
-		return 0;
+		return done(mesh, memreport);
 	} else if (!strcmp(info_type, "face_stdev")) {
 		trans(mesh, -mesh_center_of_mass(mesh));
 		float C[3][3];
 		mesh_covariance(mesh, C);
 		printf("%g\n", sqrt(C[0][0] + C[1][1] + C[2][2]));
-		return 0;
+		return done(mesh, memreport);
 	} else if (!strcmp(info_type, "overlap") && info_param) {
 		TriMesh *mesh2 = TriMesh::read(info_param);
 		if (!mesh2)
 			usage(argv[0]);
 		xform xf2;
 		if (use_xf)
-			xf2.read(xfname(argv[3]));
+			xf2.read(xfname(info_param));
 		float area = 0.0f, rmsdist = 0.0f;
 		find_overlap(mesh, mesh2, xform(), xf2, area, rmsdist);
 		printf("%g %g\n", area, rmsdist);
-		return 0;
+		return done(mesh, memreport);
 	} else if (!strcmp(info_type, "iou") && info_param) {
 		TriMesh *mesh2 = TriMesh::read(info_param);
 		if (!mesh2)
 			usage(argv[0]);
 		xform xf2;
 		if (use_xf)
-			xf2.read(xfname(argv[3]));
+			xf2.read(xfname(info_param));
 		printf("%g\n", iou(mesh, mesh2, xform(), xf2));
-		return 0;
+		return done(mesh, memreport);
 	}
 
 	// If it wasn't any of those, see whether it's a StatOp
@@ -217,5 +233,5 @@ int main(int argc, char *argv[])
 
 	printf("%g\n", mesh->stat(op, val));
 
-	return 0;
+	return done(mesh, memreport);
 }
@@ -0,0 +1,147 @@
+/*
+trimesh2 contributors
+Added to this tree; not part of the upstream trimesh2 distribution.
+
+mesh_reorder_bench.cc
+Time per-vertex computations that gather from neighboring vertices
+(point areas, curvatures, normal diffusion) on meshes with their vertices
+in different orders.
+*/
+
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include "TriMesh.h"
+#include "TriMesh_algo.h"
+#include "timestamp.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+using namespace std;
+using namespace trimesh;
+
+
+// Orders to try
+enum { ORDER_FILE, ORDER_RANDOM, ORDER_REFS,
+	ORDER_MORTON, ORDER_HILBERT, ORDER_TILES, NORDERS };
+static const char *order_names[NORDERS] = {
+	"file", "random", "refs", "morton", "hilbert", "gridtiles" };
+
+// Things to time
+enum { OP_POINTAREAS, OP_CURVATURES, OP_DIFFUSE, NOPS };
+static const char *op_names[NOPS] = {
+	"pointareas", "curvatures", "diffuse" };
+
+
+// Put the vertices of a mesh in the given order
+static void apply_order(TriMesh *mesh, int order)
+{
+	switch (order) {
+		case ORDER_RANDOM: {
+			// Shuffle the vertices, leaving faces in place
+			int nv = mesh->vertices.size();
+			vector<int> remap(nv);
+			for (int i = 0; i < nv; i++)
+				remap[i] = i;
+			xorshift_rnd(0);
+			for (int i = nv - 1; i > 0; i--)
+				swap(remap[i], remap[uniform_rnd(i + 1)]);
+			remap_verts(mesh, remap);
+			break;
+		}
+		case ORDER_REFS:
+			reorder_verts(mesh, REORDER_REFS); break;
+		case ORDER_MORTON:
+			reorder_verts(mesh, REORDER_MORTON); break;
+		case ORDER_HILBERT:
+			reorder_verts(mesh, REORDER_HILBERT); break;
+		case ORDER_TILES:
+			reorder_verts(mesh, REORDER_GRID_TILES); break;
+		default:
+			break;
+	}
+}
+
+
+// Time each operation on a copy of mesh, in the given order.
+// Times are accumulated into t.
+static void time_ops(const TriMesh *mesh, int order, int reps, double *t)
+{
+	TriMesh m = *mesh;
+	apply_order(&m, order);
+	m.need_faces();
+	m.need_normals();
+	m.need_neighbors();
+	float sigma = 2.0f * m.feature_size();
+
+	for (int r = 0; r < reps; r++) {
+		m.clear_pointareas();
+		timestamp t0 = now();
+		m.need_pointareas();
+		t[OP_POINTAREAS] += now() - t0;
+
+		m.clear_curvatures();
+		t0 = now();
+		m.need_curvatures();
+		t[OP_CURVATURES] += now() - t0;
+
+		vector<vec> normals = m.normals;
+		t0 = now();
+		diffuse_normals(&m, sigma);
+		t[OP_DIFFUSE] += now() - t0;
+		m.normals.swap(normals);
+	}
+}
+
+
+void usage(const char *myname)
+{
+	fprintf(stderr, "Usage: %s [-r reps] in.ply...\n", myname);
+	exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+	int reps = 3, first = 1;
+	if (argc > 2 && !strcmp(argv[1], "-r")) {
+		reps = atoi(argv[2]);
+		first = 3;
+	}
+	if (first >= argc || reps < 1)
+		usage(argv[0]);
+
+	TriMesh::set_verbose(0);
+	double t[NORDERS][NOPS] = { { 0 } };
+	int nfiles = 0, nverts = 0;
+	for (int i = first; i < argc; i++) {
+		TriMesh *mesh = TriMesh::read(argv[i]);
+		if (!mesh) {
+			fprintf(stderr, "Couldn't read %s\n", argv[i]);
+			continue;
+		}
+		nfiles++;
+		nverts += mesh->vertices.size();
+		for (int order = 0; order < NORDERS; order++)
+			time_ops(mesh, order, reps, t[order]);
+		delete mesh;
+	}
+	if (!nfiles)
+		usage(argv[0]);
+
+	printf("%d meshes, %d vertices, %d repetitions (ms per pass)\n",
+		nfiles, nverts, reps);
+	printf("%-10s", "order");
+	for (int op = 0; op < NOPS; op++)
+		printf(" %12s", op_names[op]);
+	printf("\n");
+	for (int order = 0; order < NORDERS; order++) {
+		printf("%-10s", order_names[order]);
+		for (int op = 0; op < NOPS; op++)
+			printf(" %12.1f", 1000.0 * t[order][op] / reps);
+		printf("\n");
+	}
+	return 0;
+}
@@ -195,8 +195,9 @@ void bdyshade(TriMesh *mesh, const char *nedges_)
 		mesh->flags[i] = mesh->is_bdy(i) ? 0 : nedges;
 	for (int iter = 1; iter < nedges; iter++) {
 		for (int i = 0; i < nv; i++) {
-			for (size_t j = 0; j < mesh->neighbors[i].size(); j++) {
-				int n = mesh->neighbors[i][j];
+			TriMesh::IndexList nbrs = mesh->neighbors_of(i);
+			for (size_t j = 0; j < nbrs.size(); j++) {
+				int n = nbrs[j];
 				if (mesh->flags[n] + 1 < mesh->flags[i])
 					mesh->flags[i] = mesh->flags[n] + 1;
 			}
@@ -277,7 +278,7 @@ bool find_closest_pt(const TriMesh *mesh, const KDtree *kd, const point &p,
 	if (ind < 0 || ind >= nv)
 		return false;
 
-	const vector<int> &a = mesh->adjacentfaces[ind];
+	TriMesh::IndexList a = mesh->adjacentfaces_of(ind);
 	if (a.empty()) {
 		pmatch = mesh->vertices[ind];
 		return true;
@@ -341,8 +342,9 @@ void findvert(TriMesh *mesh, const char *v_, const char *nedges_)
 		mesh->flags[i] = (i == v) ? 0 : nedges;
 	for (int iter = 1; iter < nedges; iter++) {
 		for (int i = 0; i < nv; i++) {
-			for (size_t j = 0; j < mesh->neighbors[i].size(); j++) {
-				int n = mesh->neighbors[i][j];
+			TriMesh::IndexList nbrs = mesh->neighbors_of(i);
+			for (size_t j = 0; j < nbrs.size(); j++) {
+				int n = nbrs[j];
 				if (mesh->flags[n] + 1 < mesh->flags[i])
 					mesh->flags[i] = mesh->flags[n] + 1;
 			}